@@ -0,0 +1,67 @@
+// Compile-time benchmark: one wide struct pushed through every reflection path.
+// Built once per size by compile_bench.cmake, which times the compiler frontend.
+// PACKALL_COMPILE_MEMBERS selects the member count (10, 50, 100, 150, 200 or 250).
+
+#include <string>
+#include <vector>
+
+#include "../include/packall/packall.h"
+#include "../include/packall/packall_text.h"
+
+#ifndef PACKALL_COMPILE_MEMBERS
+#define PACKALL_COMPILE_MEMBERS 50
+#endif
+
+#define M10(p)                                                                                                         \
+	int p##0;                                                                                                          \
+	uint64_t p##1;                                                                                                     \
+	std::string p##2;                                                                                                  \
+	double p##3;                                                                                                       \
+	std::vector<int> p##4;                                                                                             \
+	int p##5;                                                                                                          \
+	bool p##6;                                                                                                         \
+	std::vector<std::string> p##7;                                                                                     \
+	float p##8;                                                                                                        \
+	int16_t p##9;
+#define M50(p) M10(p##0) M10(p##1) M10(p##2) M10(p##3) M10(p##4)
+#define M100(p) M50(p##a) M50(p##b)
+
+struct wide
+{
+#if PACKALL_COMPILE_MEMBERS == 10
+	M10(m)
+#elif PACKALL_COMPILE_MEMBERS == 50
+	M50(m)
+#elif PACKALL_COMPILE_MEMBERS == 100
+	M100(m)
+#elif PACKALL_COMPILE_MEMBERS == 150
+	M100(m) M50(n)
+#elif PACKALL_COMPILE_MEMBERS == 200
+	M100(m) M100(n)
+#elif PACKALL_COMPILE_MEMBERS == 250
+	M100(m) M100(n) M50(o)
+#else
+#error "Unsupported PACKALL_COMPILE_MEMBERS"
+#endif
+};
+
+static_assert(packall::detail::aggregate_arity<wide>::value == PACKALL_COMPILE_MEMBERS);
+
+int main()
+{
+	wide w{};
+	std::vector<uint8_t> bytes;
+	packall::pack(w, bytes);
+	packall::pack<packall::options::variable_length_encoding>(w, bytes);
+	if(packall::unpack(w, bytes) != packall::status::ok)
+		return 1;
+
+	std::string text;
+	packall::lua::format(w, text);
+	if(packall::lua::parse(w, text) != packall::status::ok)
+		return 1;
+	packall::json::format(w, text);
+	if(packall::json::parse(w, text) != packall::status::ok)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,34 @@
+# Times the compiler frontend on compile_bench.cc for each struct size.
+# cmake -DCXX=<compiler> -DCXX_ID=<GNU|Clang|MSVC> -DSOURCE=<compile_bench.cc> [-DJSON=path] -P compile_bench.cmake
+cmake_minimum_required(VERSION 3.23)
+
+if(CXX_ID STREQUAL "MSVC")
+  set(flags /nologo /std:c++20 /Zs)
+  set(define /D)
+else()
+  set(flags -std=c++20 -fsyntax-only)
+  set(define -D)
+endif()
+
+set(results "")
+foreach(members 10 50 100 150 200 250)
+  string(TIMESTAMP start "%s%f" UTC)
+  execute_process(
+    COMMAND ${CXX} ${flags} ${define}PACKALL_COMPILE_MEMBERS=${members} ${SOURCE}
+    RESULT_VARIABLE rc
+  )
+  string(TIMESTAMP end "%s%f" UTC)
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "compile_bench.cc failed with ${members} members")
+  endif()
+  math(EXPR ms "(${end} - ${start}) / 1000")
+  message("${members} members: ${ms} ms")
+  if(results)
+    string(APPEND results ",\n")
+  endif()
+  string(APPEND results "  {\"members\": ${members}, \"ms\": ${ms}}")
+endforeach()
+
+if(JSON)
+  file(WRITE ${JSON} "[\n${results}\n]\n")
+endif()
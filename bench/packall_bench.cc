@@ -0,0 +1,579 @@
+// Throughput benchmarks for the binary and text encoders.
+// packall_bench [--filter=substring] [--min-time=seconds] [--json=path]
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/packall/packall.h"
+#include "../include/packall/packall_diff.h"
+#include "../include/packall/packall_text.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Hardware counters, these are silently unavailable if perf_event_open is not permitted
+struct perf_counters
+{
+	static constexpr int kCount = 3;
+	static constexpr const char *kNames[kCount] = {"cycles", "instructions", "cache_misses"};
+
+	int fd[kCount] = {-1, -1, -1};
+	uint64_t values[kCount] = {};
+
+	perf_counters()
+	{
+#ifdef __linux__
+		static constexpr uint64_t kConfigs[kCount] = {
+		    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+		for(int i = 0; i < kCount; i++) {
+			perf_event_attr attr{};
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = kConfigs[i];
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+#endif
+	}
+	~perf_counters()
+	{
+#ifdef __linux__
+		for(int f : fd)
+			if(f >= 0)
+				close(f);
+#endif
+	}
+
+	bool available() const
+	{
+		return fd[0] >= 0;
+	}
+
+	void start()
+	{
+#ifdef __linux__
+		for(int f : fd) {
+			if(f >= 0) {
+				ioctl(f, PERF_EVENT_IOC_RESET, 0);
+				ioctl(f, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+	void stop()
+	{
+#ifdef __linux__
+		for(int i = 0; i < kCount; i++) {
+			values[i] = 0;
+			if(fd[i] >= 0) {
+				ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+				if(read(fd[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+					values[i] = 0;
+			}
+		}
+#endif
+	}
+};
+
+struct result
+{
+	std::string workload;
+	std::string op;
+	size_t bytes = 0;
+	uint64_t iterations = 0;
+	double ns_per_op = 0;
+	double mb_per_s = 0;
+	bool has_counters = false;
+	double counters[perf_counters::kCount] = {};
+};
+
+struct bench_options
+{
+	std::string filter;
+	std::string json;
+	double min_time = 0.2;
+};
+
+struct runner
+{
+	bench_options opts;
+	perf_counters counters;
+	std::vector<result> results;
+
+	// fn must process bytes bytes per call
+	template<typename Fn>
+	void run(const std::string& workload, const std::string& op, size_t bytes, Fn&& fn)
+	{
+		std::string name = workload + "/" + op;
+		if(!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+			return;
+
+		using clock = std::chrono::steady_clock;
+		// Warm up and find an iteration count that runs for roughly the minimum time
+		uint64_t n = 1;
+		for(;;) {
+			auto t0 = clock::now();
+			for(uint64_t i = 0; i < n; i++) fn();
+			double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+			if(elapsed >= opts.min_time / 4 || n >= (1ull << 30))
+				break;
+			n *= 2;
+		}
+		n *= 4;
+
+		counters.start();
+		auto t0 = clock::now();
+		for(uint64_t i = 0; i < n; i++) fn();
+		double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+		counters.stop();
+
+		result r;
+		r.workload = workload;
+		r.op = op;
+		r.bytes = bytes;
+		r.iterations = n;
+		r.ns_per_op = elapsed * 1e9 / n;
+		r.mb_per_s = (double)bytes * n / elapsed / 1e6;
+		r.has_counters = counters.available();
+		for(int i = 0; i < perf_counters::kCount; i++) r.counters[i] = (double)counters.values[i] / n;
+
+		printf("%-32s %-16s %10zu B %12.1f ns/op %10.1f MB/s", workload.c_str(), op.c_str(), bytes, r.ns_per_op,
+		    r.mb_per_s);
+		if(r.has_counters)
+			printf(" %12.0f cyc %12.0f ins %8.1f miss", r.counters[0], r.counters[1], r.counters[2]);
+		printf("\n");
+		results.push_back(std::move(r));
+	}
+
+	void write_json() const
+	{
+		if(opts.json.empty())
+			return;
+		FILE *f = fopen(opts.json.c_str(), "w");
+		if(!f) {
+			fprintf(stderr, "unable to open %s\n", opts.json.c_str());
+			return;
+		}
+		fprintf(f, "[\n");
+		for(size_t i = 0; i < results.size(); i++) {
+			const auto& r = results[i];
+			fprintf(f,
+			    "  {\"workload\": \"%s\", \"op\": \"%s\", \"bytes\": %zu, \"iterations\": %llu, \"ns_per_op\": %.2f, "
+			    "\"mb_per_s\": %.2f",
+			    r.workload.c_str(), r.op.c_str(), r.bytes, (unsigned long long)r.iterations, r.ns_per_op, r.mb_per_s);
+			if(r.has_counters) {
+				for(int c = 0; c < perf_counters::kCount; c++)
+					fprintf(f, ", \"%s\": %.1f", perf_counters::kNames[c], r.counters[c]);
+			}
+			fprintf(f, "}%s\n", i + 1 < results.size() ? "," : "");
+		}
+		fprintf(f, "]\n");
+		fclose(f);
+	}
+};
+
+template<typename T>
+void do_not_optimize(T& v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r"(&v) : "memory");
+#endif
+}
+
+// Workloads, all generated from a fixed seed so that runs are comparable
+
+struct Config
+{
+	std::string device;
+	std::pair<unsigned, unsigned> resolution;
+	std::array<double, 9> K_matrix;
+	std::vector<double> distortion_coeffients;
+	std::map<std::string, std::variant<uint16_t, std::string, bool>> parameters;
+
+	bool operator==(const Config&) const = default;
+};
+
+struct numeric
+{
+	std::vector<double> doubles;
+	std::vector<int32_t> ints;
+	std::vector<uint64_t> large;
+
+	bool operator==(const numeric&) const = default;
+};
+
+struct strings
+{
+	std::map<std::string, std::string> entries;
+
+	bool operator==(const strings&) const = default;
+};
+
+struct leaf
+{
+	int32_t value;
+	std::string name;
+
+	bool operator==(const leaf&) const = default;
+};
+struct branch1
+{
+	int32_t value;
+	std::vector<leaf> children;
+
+	bool operator==(const branch1&) const = default;
+};
+struct branch2
+{
+	int32_t value;
+	std::vector<branch1> children;
+
+	bool operator==(const branch2&) const = default;
+};
+struct branch3
+{
+	int32_t value;
+	std::vector<branch2> children;
+
+	bool operator==(const branch3&) const = default;
+};
+struct nested
+{
+	std::vector<branch3> roots;
+
+	bool operator==(const nested&) const = default;
+};
+
+struct variants
+{
+	std::vector<std::variant<uint16_t, std::string, bool>> values;
+
+	bool operator==(const variants&) const = default;
+};
+
+// 120 named settings, the shape of a large application config
+#define WIDE_GROUP(p)                                                                                                  \
+	int32_t p##_count;                                                                                                 \
+	double p##_scale;                                                                                                  \
+	std::string p##_path;                                                                                              \
+	bool p##_enabled;                                                                                                  \
+	uint16_t p##_port;                                                                                                 \
+	std::string p##_name;                                                                                              \
+	int64_t p##_timeout_ms;                                                                                            \
+	float p##_ratio;                                                                                                   \
+	uint32_t p##_retries;                                                                                              \
+	bool p##_verbose;
+struct wide_config
+{
+	WIDE_GROUP(net)
+	WIDE_GROUP(disk)
+	WIDE_GROUP(cache)
+	WIDE_GROUP(render)
+	WIDE_GROUP(audio)
+	WIDE_GROUP(input)
+	WIDE_GROUP(log)
+	WIDE_GROUP(script)
+	WIDE_GROUP(physics)
+	WIDE_GROUP(ui)
+	WIDE_GROUP(save)
+	WIDE_GROUP(stats)
+
+	bool operator==(const wide_config&) const = default;
+};
+#undef WIDE_GROUP
+
+struct wide
+{
+	std::vector<wide_config> configs;
+
+	bool operator==(const wide&) const = default;
+};
+
+Config make_config()
+{
+	return Config{"/dev/video0", {640, 480},
+	    {223.28249888247538, 0.0, 152.30570853111396, 0.0, 223.8756535707556, 124.5606000035353, 0.0, 0.0, 1.0},
+	    {-0.44158343539568284, 0.23861463831967872, 0.0016338407443826572, 0.0034950038632981604, -0.05239245892096022},
+	    {{"start_server", bool{true}}, {"max_depth", uint16_t{5}}, {"model_path", std::string{"foo/bar.pt"}}}};
+}
+
+std::string random_string(std::mt19937& rng, size_t min, size_t max)
+{
+	static const char kChars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_/. ";
+	std::string s(std::uniform_int_distribution<size_t>(min, max)(rng), ' ');
+	for(auto& c : s) c = kChars[std::uniform_int_distribution<size_t>(0, sizeof(kChars) - 2)(rng)];
+	return s;
+}
+
+numeric make_numeric(std::mt19937& rng)
+{
+	numeric n;
+	std::normal_distribution<double> d(0, 1000);
+	std::geometric_distribution<int32_t> small(0.01);
+	for(int i = 0; i < 16384; i++) {
+		n.doubles.push_back(d(rng));
+		n.ints.push_back(small(rng) * ((i & 1) ? -1 : 1));
+		n.large.push_back(rng() * (uint64_t)rng());
+	}
+	return n;
+}
+
+strings make_strings(std::mt19937& rng)
+{
+	strings s;
+	while(s.entries.size() < 2048) s.entries.emplace(random_string(rng, 4, 24), random_string(rng, 0, 200));
+	return s;
+}
+
+nested make_nested(std::mt19937& rng)
+{
+	nested n;
+	n.roots.resize(8);
+	for(auto& b3 : n.roots) {
+		b3.value = (int32_t)rng();
+		b3.children.resize(8);
+		for(auto& b2 : b3.children) {
+			b2.value = (int32_t)rng();
+			b2.children.resize(8);
+			for(auto& b1 : b2.children) {
+				b1.value = (int32_t)rng();
+				b1.children.resize(4);
+				for(auto& l : b1.children) {
+					l.value = (int32_t)rng();
+					l.name = random_string(rng, 2, 12);
+				}
+			}
+		}
+	}
+	return n;
+}
+
+variants make_variants(std::mt19937& rng)
+{
+	variants v;
+	for(int i = 0; i < 8192; i++) {
+		switch(rng() % 3) {
+		case 0:
+			v.values.emplace_back((uint16_t)rng());
+			break;
+		case 1:
+			v.values.emplace_back(random_string(rng, 0, 32));
+			break;
+		default:
+			v.values.emplace_back((bool)(rng() & 1));
+			break;
+		}
+	}
+	return v;
+}
+
+struct wide_filler
+{
+	std::mt19937& rng;
+
+	void enter(std::string_view) {}
+	void leave() {}
+
+	template<typename M>
+	void visit(size_t, std::string_view, M& m)
+	{
+		if constexpr(std::is_same_v<M, std::string>)
+			m = random_string(rng, 0, 24);
+		else if constexpr(std::is_same_v<M, bool>)
+			m = rng() & 1;
+		else
+			m = static_cast<M>(rng() % 1000);
+	}
+};
+
+wide make_wide(std::mt19937& rng)
+{
+	wide w;
+	w.configs.resize(64);
+	wide_filler f{rng};
+	for(auto& c : w.configs) packall::foreach_member(c, f);
+	return w;
+}
+
+template<packall::options o, typename T>
+void bench_binary(runner& r, const std::string& name, const T& obj, const char *suffix)
+{
+	std::vector<uint8_t> bytes;
+	packall::pack<o>(obj, bytes);
+	r.run(name, std::string("pack_") + suffix, bytes.size(), [&]() {
+		std::vector<uint8_t> out;
+		packall::pack<o>(obj, out);
+		do_not_optimize(out);
+	});
+	r.run(name, std::string("unpack_") + suffix, bytes.size(), [&]() {
+		T v{};
+		if(packall::unpack<o>(v, bytes) != packall::status::ok)
+			abort();
+		do_not_optimize(v);
+	});
+	std::vector<uint8_t> summed;
+	packall::pack<o | packall::options::checksum>(obj, summed);
+	r.run(name, std::string("pack_checksum_") + suffix, summed.size(), [&]() {
+		std::vector<uint8_t> out;
+		packall::pack<o | packall::options::checksum>(obj, out);
+		do_not_optimize(out);
+	});
+	r.run(name, std::string("unpack_checksum_") + suffix, summed.size(), [&]() {
+		T v{};
+		if(packall::unpack<o | packall::options::checksum>(v, summed) != packall::status::ok)
+			abort();
+		do_not_optimize(v);
+	});
+	r.run(name, std::string("unpack_trusted_") + suffix, bytes.size(), [&]() {
+		T v{};
+		if(packall::unpack<o | packall::options::trusted>(v, bytes) != packall::status::ok)
+			abort();
+		do_not_optimize(v);
+	});
+}
+
+template<typename T>
+void bench_workload(runner& r, const std::string& name, const T& obj)
+{
+	bench_binary<packall::options::none>(r, name, obj, "fixed");
+	bench_binary<packall::options::variable_length_encoding>(r, name, obj, "varint");
+
+	std::string lua;
+	packall::lua::format(obj, lua);
+	r.run(name, "lua_format", lua.size(), [&]() {
+		std::string out;
+		packall::lua::format(obj, out);
+		do_not_optimize(out);
+	});
+	r.run(name, "lua_parse", lua.size(), [&]() {
+		T v{};
+		if(packall::lua::parse(v, lua) != packall::status::ok)
+			abort();
+		do_not_optimize(v);
+	});
+
+	std::string json;
+	packall::json::format(obj, json);
+	r.run(name, "json_format", json.size(), [&]() {
+		std::string out;
+		packall::json::format(obj, out);
+		do_not_optimize(out);
+	});
+	r.run(name, "json_parse", json.size(), [&]() {
+		T v{};
+		if(packall::json::parse(v, json) != packall::status::ok)
+			abort();
+		do_not_optimize(v);
+	});
+
+	// Straight between binary and text, without a T in between
+	std::vector<uint8_t> bytes;
+	packall::pack(obj, bytes);
+	r.run(name, "json_transcode", json.size(), [&]() {
+		std::string out;
+		if(packall::json::binary_to_text<T>(bytes, out) != packall::status::ok)
+			abort();
+		do_not_optimize(out);
+	});
+	r.run(name, "json_to_binary", json.size(), [&]() {
+		std::vector<uint8_t> out;
+		if(packall::json::text_to_binary<T>(json, out) != packall::status::ok)
+			abort();
+		do_not_optimize(out);
+	});
+
+	std::string pretty = packall::json::prettyprint(json);
+	r.run(name, "json_pretty", pretty.size(), [&]() {
+		T v{};
+		if(packall::json::parse(v, pretty) != packall::status::ok)
+			abort();
+		do_not_optimize(v);
+	});
+	for(auto& [op, text] : {std::pair<const char *, std::string&>{"json_parse_idx", json}, {"json_pretty_idx", pretty}}) {
+		r.run(name, op, text.size(), [&]() {
+			T v{};
+			if(packall::json::parse(v, text, {.structural_index = true}) != packall::status::ok)
+				abort();
+			do_not_optimize(v);
+		});
+	}
+	r.run(name, "json_pretty_fmt", pretty.size(), [&]() {
+		std::string out;
+		packall::json::format(obj, out, {.pretty = true});
+		do_not_optimize(out);
+	});
+	r.run(name, "json_prettyprint", pretty.size(), [&]() {
+		std::string out;
+		packall::json::format(obj, out);
+		out = packall::json::prettyprint(out);
+		do_not_optimize(out);
+	});
+}
+
+// Replication of a few changed fields, bytes is the patch size
+void bench_diff(runner& r, const wide& obj)
+{
+	wide now = obj;
+	now.configs[7].net_port++;
+	now.configs[40].ui_name += "!";
+	std::vector<uint8_t> patch;
+	packall::diff(obj, now, patch);
+	r.run("wide", "diff", patch.size(), [&]() {
+		std::vector<uint8_t> out;
+		packall::diff(obj, now, out);
+		do_not_optimize(out);
+	});
+	r.run("wide", "apply", patch.size(), [&]() {
+		wide v = obj;
+		if(packall::apply(v, patch) != packall::status::ok)
+			abort();
+		do_not_optimize(v);
+	});
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	runner r;
+	for(int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+		if(arg.starts_with("--filter="))
+			r.opts.filter = arg.substr(9);
+		else if(arg.starts_with("--json="))
+			r.opts.json = arg.substr(7);
+		else if(arg.starts_with("--min-time="))
+			r.opts.min_time = atof(argv[i] + 11);
+		else {
+			fprintf(stderr, "usage: %s [--filter=substring] [--min-time=seconds] [--json=path]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(!r.counters.available())
+		printf("perf_event_open unavailable, hardware counters disabled\n");
+
+	std::mt19937 rng(12345);
+	bench_workload(r, "config", make_config());
+	bench_workload(r, "numeric", make_numeric(rng));
+	bench_workload(r, "strings", make_strings(rng));
+	bench_workload(r, "nested", make_nested(rng));
+	bench_workload(r, "variants", make_variants(rng));
+	wide w = make_wide(rng);
+	bench_workload(r, "wide", w);
+	bench_diff(r, w);
+
+	r.write_json();
+	return 0;
+}
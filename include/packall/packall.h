@@ -3,7 +3,9 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
+#include <chrono>
 #include <concepts>
 #include <memory>
 #include <optional>
@@ -19,6 +21,24 @@
 
 #include <string.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// CRC32C uses the SSE4.2 instruction on x64 when the CPU has it, and the ARMv8 one when building for it
+#if !defined(PACKALL_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define PACKALL_CRC32C_X64 1
+#include <nmmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define PACKALL_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define PACKALL_TARGET_SSE42
+#endif
+#elif !defined(PACKALL_NO_SIMD) && defined(__ARM_FEATURE_CRC32)
+#define PACKALL_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
 #include "packall_forward.h"
 
 namespace packall {
@@ -109,6 +129,38 @@ constexpr std::string_view get_type_name();
 template<typename T, typename Foreach>
 void foreach_member(T& obj, Foreach& c);
 
+// Instrumentation, enabled per call by options::instrument / options::instrument_nested or for every call by
+// defining PACKALL_INSTRUMENT / PACKALL_INSTRUMENT_NESTED. When disabled no code is generated.
+enum class instrument_op : uint8_t
+{
+	pack,
+	unpack,
+};
+
+struct instrument_event
+{
+	instrument_op op;
+	// false for the top-level call. true for the per-struct events of instrument_nested, which include the top-level
+	// struct itself; their cost is also part of every enclosing event.
+	bool nested;
+	std::string_view type;
+	// Bytes produced or consumed
+	size_t bytes;
+	// Timestamp counter ticks where available, otherwise nanoseconds
+	uint64_t cycles;
+};
+
+// Called from whichever thread does the work, implementations must be thread-safe.
+// Only successful operations are reported.
+struct instrumentation
+{
+	virtual ~instrumentation() = default;
+	virtual void record(const instrument_event& ev) = 0;
+};
+
+// Install the process-wide hook and return the previous one. nullptr stops reporting.
+instrumentation *set_instrumentation(instrumentation *hook);
+
 template<typename T>
 struct bytebuffer_impl;
 
@@ -232,16 +284,30 @@ struct any final
 	constexpr operator type() const;
 };
 
-template<class T, class... Args>
-    requires(std::is_aggregate_v<std::remove_cvref_t<T>>)
-inline constexpr auto count_members = [] {
-	using V = std::remove_cvref_t<T>;
-	if constexpr(requires { V{Args{}..., any{}}; }) {
-		return count_members<V, Args..., any>;
+template<size_t>
+using any_t = any;
+
+template<class T, size_t N>
+inline constexpr bool brace_constructible_with = []<size_t... I>(std::index_sequence<I...>) {
+	return requires { T{any_t<I>{}...}; };
+}(std::make_index_sequence<N>());
+
+// Binary search for the largest initializer count, so a struct costs log2(255) probes rather than one per member
+template<class T, size_t Lo = 0, size_t Hi = 255>
+consteval size_t search_members()
+{
+	if constexpr(Lo == Hi) {
+		return Lo;
+	} else if constexpr(brace_constructible_with<T, (Lo + Hi + 1) / 2>) {
+		return search_members<T, (Lo + Hi + 1) / 2, Hi>();
 	} else {
-		return sizeof...(Args);
+		return search_members<T, Lo, (Lo + Hi + 1) / 2 - 1>();
 	}
-}();
+}
+
+template<class T>
+    requires(std::is_aggregate_v<std::remove_cvref_t<T>>)
+inline constexpr size_t count_members = search_members<std::remove_cvref_t<T>>();
 
 template<class T>
 struct aggregate_arity
@@ -252,7 +318,51 @@ struct aggregate_arity
 template<size_t>
 struct decompose;
 
-// Decomposition of structs up to 50 elements
+// A flat (non-recursive) pack of member pointers, so indexing it costs one deduction instead of a tuple instantiation
+template<size_t I, class M>
+struct indexed_member
+{
+	M *p;
+};
+
+template<class Seq, class... M>
+struct member_pointers;
+
+template<size_t... I, class... M>
+struct member_pointers<std::index_sequence<I...>, M...> : indexed_member<I, M>...
+{
+};
+
+template<size_t I, class M>
+constexpr M& pick_member(const indexed_member<I, M>& m)
+{
+	return *m.p;
+}
+
+struct tie_members
+{
+	template<class... M>
+	constexpr auto operator()(M&... m) const
+	{
+		return member_pointers<std::index_sequence_for<M...>, M...>{{&m}...};
+	}
+};
+
+// Each decompose<N> binds the members once in apply(), get<I> is shared
+template<class D>
+struct decompose_get
+{
+	template<size_t I, class T>
+	constexpr static auto& get(T&& o)
+	{
+		return pick_member<I>(D::apply(o, tie_members{}));
+	}
+};
+
+// Decomposition of structs up to 250 elements. Defining this lower skips parsing the larger ones.
+#ifndef PACKALL_MAX_DECOMPOSE
+#define PACKALL_MAX_DECOMPOSE 250
+#endif
 #include "struct_decompose.inc"
 
 template<typename T>
@@ -298,14 +408,158 @@ constexpr T zigzag_decode(T v)
 	return (v >> 1) ^ (~(v & 1) + 1);
 }
 
-template<bool VariableEncoding>
+// The options::checksum trailer, a CRC32C of everything before it
+static constexpr size_t kChecksumSize = 4;
+// Finished bytes are folded into the checksum once about this many have built up, while they are still in cache
+static constexpr size_t kChecksumBlock = 16384;
+
+struct crc32c_tables
+{
+	uint32_t t[8][256];
+};
+
+consteval crc32c_tables make_crc32c_tables()
+{
+	crc32c_tables r{};
+	for(uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for(int j = 0; j < 8; j++) c = (c >> 1) ^ (0x82F63B78 & ~((c & 1) - 1));
+		r.t[0][i] = c;
+	}
+	for(int k = 1; k < 8; k++)
+		for(uint32_t i = 0; i < 256; i++) r.t[k][i] = (r.t[k - 1][i] >> 8) ^ r.t[0][r.t[k - 1][i] & 0xFF];
+	return r;
+}
+
+inline constexpr crc32c_tables kCrc32cTables = make_crc32c_tables();
+
+// Eight bytes at a time, one lookup per byte
+inline uint32_t crc32c_table(uint32_t c, const uint8_t *p, size_t n)
+{
+	auto& t = kCrc32cTables.t;
+	for(; n >= 8; p += 8, n -= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		v ^= c;
+		c = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^ t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF] ^
+		    t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^ t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+	}
+	for(; n > 0; p++, n--) c = (c >> 8) ^ t[0][(c ^ *p) & 0xFF];
+	return c;
+}
+
+#ifdef PACKALL_CRC32C_X64
+PACKALL_TARGET_SSE42 inline uint32_t crc32c_sse42(uint32_t c, const uint8_t *p, size_t n)
+{
+	uint64_t c64 = c;
+	for(; n >= 8; p += 8, n -= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c64 = _mm_crc32_u64(c64, v);
+	}
+	c = (uint32_t)c64;
+	for(; n > 0; p++, n--) c = _mm_crc32_u8(c, *p);
+	return c;
+}
+
+inline bool cpu_has_sse42()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return info[2] & (1 << 20);
+#else
+	return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#endif
+
+#ifdef PACKALL_CRC32C_ARM
+inline uint32_t crc32c_arm(uint32_t c, const uint8_t *p, size_t n)
+{
+	for(; n >= 8; p += 8, n -= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c = __crc32cd(c, v);
+	}
+	for(; n > 0; p++, n--) c = __crc32cb(c, *p);
+	return c;
+}
+#endif
+
+using crc32c_fn = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+
+inline crc32c_fn select_crc32c()
+{
+#if defined(PACKALL_CRC32C_X64)
+	return cpu_has_sse42() ? &crc32c_sse42 : &crc32c_table;
+#elif defined(PACKALL_CRC32C_ARM)
+	return &crc32c_arm;
+#else
+	return &crc32c_table;
+#endif
+}
+
+inline const crc32c_fn crc32c_update = select_crc32c();
+
+// Continues crc over n more bytes, a new checksum starts from 0
+inline uint32_t crc32c(uint32_t crc, const void *p, size_t n)
+{
+	return ~crc32c_update(~crc, static_cast<const uint8_t *>(p), n);
+}
+
+// Running checksum of an options::checksum converter, everything before sealed is folded into crc
+template<bool Enabled>
+struct checksum_state
+{
+};
+
+template<>
+struct checksum_state<true>
+{
+	uint32_t crc = 0;
+	size_t sealed = 0;
+	// backwards_compatible structs being written, their size is only filled in once they end
+	size_t open = 0;
+};
+
+// Unchecked is only set when the output buffer is known to be large enough for anything written to it
+// InstrumentNested reports every struct to the instrumentation hook
+// Trusted decodes structs without checking their member counts, see options::trusted
+// Checksum keeps a CRC32C of the bytes written or read, which must all stay in memory
+template<bool VariableEncoding, bool Unchecked = false, bool InstrumentNested = false, bool Trusted = false,
+    bool Checksum = false>
 struct bytes_converter
 {
+	static constexpr bool variable_encoding = VariableEncoding;
+	static constexpr bool unchecked = Unchecked;
+	static constexpr bool instrument_nested = InstrumentNested;
+	static constexpr bool trusted = Trusted;
+	static constexpr bool checksum = Checksum;
+
 	bytes_converter(bytebuffer& wrap) : wrap(wrap) {}
 
+	void put_u8(uint8_t v)
+	{
+		if constexpr(Unchecked) {
+			*wrap.p++ = v;
+		} else {
+			wrap.write_u8(v);
+		}
+	}
+	void put_bytes(const void *v, size_t sz)
+	{
+		if constexpr(Unchecked) {
+			memcpy(wrap.p, v, sz);
+			wrap.p += sz;
+		} else {
+			wrap.write_bytes(v, sz);
+		}
+	}
+
 	void write(int8_t v)
 	{
-		wrap.write_u8(std::bit_cast<uint8_t>(v));
+		put_u8(std::bit_cast<uint8_t>(v));
 	}
 
 	void write(int16_t v)
@@ -314,7 +568,7 @@ struct bytes_converter
 			// proto encoding
 			write(zigzag_encode(std::bit_cast<uint16_t>(v)));
 		} else {
-			wrap.write_bytes(&v, sizeof(v));
+			put_bytes(&v, sizeof(v));
 		}
 	}
 
@@ -324,7 +578,7 @@ struct bytes_converter
 			// proto encoding
 			write(zigzag_encode(std::bit_cast<uint32_t>(v)));
 		} else {
-			wrap.write_bytes(&v, sizeof(v));
+			put_bytes(&v, sizeof(v));
 		}
 	}
 
@@ -334,55 +588,46 @@ struct bytes_converter
 			// proto encoding
 			write(zigzag_encode(std::bit_cast<uint64_t>(v)));
 		} else {
-			wrap.write_bytes(&v, sizeof(v));
+			put_bytes(&v, sizeof(v));
 		}
 	}
 
 	void write(uint8_t v)
 	{
-		wrap.write_u8(v);
+		put_u8(v);
 	}
 
 	void write(uint16_t v)
 	{
 		if constexpr(VariableEncoding) {
-			do {
-				wrap.write_u8((uint8_t)v | ((v > 127) ? 0x80 : 0));
-				v >>= 7;
-			} while(v);
+			write_varint<3>(v);
 		} else {
-			wrap.write_bytes(&v, sizeof(v));
+			put_bytes(&v, sizeof(v));
 		}
 	}
 
 	void write(uint32_t v)
 	{
 		if constexpr(VariableEncoding) {
-			do {
-				wrap.write_u8((uint8_t)v | ((v > 127) ? 0x80 : 0));
-				v >>= 7;
-			} while(v);
+			write_varint<5>(v);
 		} else {
-			wrap.write_bytes(&v, sizeof(v));
+			put_bytes(&v, sizeof(v));
 		}
 	}
 
 	void write(uint64_t v)
 	{
 		if constexpr(VariableEncoding) {
-			do {
-				wrap.write_u8((uint8_t)v | ((v > 127) ? 0x80 : 0));
-				v >>= 7;
-			} while(v);
+			write_varint<10>(v);
 		} else {
-			wrap.write_bytes(&v, sizeof(v));
+			put_bytes(&v, sizeof(v));
 		}
 	}
 
 	template<std::floating_point U>
 	void write(U v)
 	{
-		wrap.write_bytes(&v, sizeof(v));
+		put_bytes(&v, sizeof(v));
 	}
 
 	void write(bool v)
@@ -392,20 +637,63 @@ struct bytes_converter
 
 	void write_sz(size_t v)
 	{
-		do {
-			wrap.write_u8((uint8_t)(v | ((v > 0x7F) ? 0x80 : 0)));
-			v >>= 7;
-		} while(v);
+		write_varint<10>(v);
+	}
+	// Struct and tuple predecode headers, encoded the same as a size
+	void write_prefix(size_t v)
+	{
+		write_sz(v);
 	}
 	size_t read_sz()
 	{
-		size_t v = 0;
-		uint8_t ofs = 0;
-		for(int i = 0; i < 10; i++, ofs += 7) {
-			uint8_t b = wrap.read_u8();
-			v |= (uint64_t)(b & 0x7F) << ofs;
-			if(!(b & 0x80))
-				break;
+		return (size_t)read_varint<10>();
+	}
+
+	// Base-128 varints of at most N bytes. If N bytes are available the whole value is handled straight from the
+	// buffer pointer with a single bounds check, only near the end of the buffer does it go a byte at a time.
+	template<int N, typename U>
+	void write_varint(U v)
+	{
+		if(Unchecked || wrap.e - wrap.p >= N) [[likely]] {
+			uint8_t *p = wrap.p;
+			while(v > 0x7F) {
+				*p++ = (uint8_t)v | 0x80;
+				v >>= 7;
+			}
+			*p++ = (uint8_t)v;
+			wrap.p = p;
+		} else {
+			do {
+				wrap.write_u8((uint8_t)v | ((v > 0x7F) ? 0x80 : 0));
+				v >>= 7;
+			} while(v);
+		}
+	}
+	// Bits past the width of the destination are dropped by the caller, as are any past 64
+	template<int N>
+	uint64_t read_varint()
+	{
+		uint64_t v = 0;
+		if(wrap.e - wrap.p >= N) [[likely]] {
+			const uint8_t *p = wrap.p;
+			int i = 0;
+			while(i < N) {
+				uint8_t b = p[i];
+				v |= (uint64_t)(b & 0x7F) << (7 * i);
+				i++;
+				if(!(b & 0x80))
+					break;
+			}
+			wrap.p += i;
+			if(wrap.p == wrap.e) [[unlikely]]
+				wrap.more_data(0);
+		} else {
+			for(int i = 0; i < N; i++) {
+				uint8_t b = wrap.read_u8();
+				v |= (uint64_t)(b & 0x7F) << (7 * i);
+				if(!(b & 0x80))
+					break;
+			}
 		}
 		return v;
 	}
@@ -456,14 +744,7 @@ struct bytes_converter
 	void read(uint16_t& v)
 	{
 		if constexpr(VariableEncoding) {
-			v = 0;
-			uint8_t ofs = 0;
-			for(int i = 0; i < 3; i++, ofs += 7) {
-				uint8_t b = wrap.read_u8();
-				v |= (uint16_t)(b & 0x7F) << ofs;
-				if(!(b & 0x80))
-					break;
-			}
+			v = (uint16_t)read_varint<3>();
 		} else {
 			wrap.read_bytes(&v, sizeof(v));
 		}
@@ -472,14 +753,7 @@ struct bytes_converter
 	void read(uint32_t& v)
 	{
 		if constexpr(VariableEncoding) {
-			v = 0;
-			uint8_t ofs = 0;
-			for(int i = 0; i < 5; i++, ofs += 7) {
-				uint8_t b = wrap.read_u8();
-				v |= (uint32_t)(b & 0x7F) << ofs;
-				if(!(b & 0x80))
-					break;
-			}
+			v = (uint32_t)read_varint<5>();
 		} else {
 			wrap.read_bytes(&v, sizeof(v));
 		}
@@ -488,14 +762,7 @@ struct bytes_converter
 	void read(uint64_t& v)
 	{
 		if constexpr(VariableEncoding) {
-			v = 0;
-			uint8_t ofs = 0;
-			for(int i = 0; i < 10; i++, ofs += 7) {
-				uint8_t b = wrap.read_u8();
-				v |= (uint64_t)(b & 0x7F) << ofs;
-				if(!(b & 0x80))
-					break;
-			}
+			v = (uint64_t)read_varint<10>();
 		} else {
 			wrap.read_bytes(&v, sizeof(v));
 		}
@@ -520,7 +787,7 @@ struct bytes_converter
 	}
 	void writebuf(const void *buf, size_t sz)
 	{
-		wrap.write_bytes(buf, sz);
+		put_bytes(buf, sz);
 	}
 
 	uint8_t peek_u8()
@@ -540,15 +807,24 @@ struct bytes_converter
 	{
 		return wrap.end();
 	}
+	// Bytes that can be read or written without calling back into the buffer
+	size_t available() const
+	{
+		return wrap.e - wrap.p;
+	}
 
 	// Backwards compatibility
 	size_t push()
 	{
+		if constexpr(Checksum)
+			sums.open++;
 		return wrap.push();
 	}
 	void pop(size_t at)
 	{
 		wrap.pop(at);
+		if constexpr(Checksum)
+			sums.open--;
 	}
 
 	size_t enter()
@@ -565,7 +841,119 @@ struct bytes_converter
 		return wrap;
 	}
 
+	// Absolute byte offset in the output or input
+	size_t position() const
+	{
+		return wrap.offset + (wrap.p - wrap.s);
+	}
+
+	// Called between values, folds what has been written or read so far once there is a block of it. Output inside a
+	// backwards_compatible struct waits for its size to be filled in.
+	void fold_checksum()
+	{
+		size_t at = wrap.p - wrap.s;
+		if(at - sums.sealed >= kChecksumBlock && sums.open == 0)
+			seal(at);
+	}
+	uint32_t seal(size_t at)
+	{
+		sums.crc = crc32c(sums.crc, wrap.s + sums.sealed, at - sums.sealed);
+		sums.sealed = at;
+		return sums.crc;
+	}
+	void write_checksum()
+	{
+		uint32_t crc = seal(wrap.p - wrap.s);
+		put_bytes(&crc, kChecksumSize);
+	}
+	// The trailer sits at wrap.e, past the end of the value
+	bool checksum_matches()
+	{
+		size_t end = wrap.e - wrap.s;
+		uint32_t crc;
+		memcpy(&crc, wrap.e, kChecksumSize);
+		return sums.sealed <= end && seal(end) == crc;
+	}
+
 	bytebuffer& wrap;
+	[[no_unique_address]] checksum_state<Checksum> sums;
+};
+
+// Drops everything written since at, only for output to a vector-like container
+template<typename Container>
+void rewind(Container& out, size_t at)
+{
+	out.get_custom_buffer().seek_to(at);
+}
+
+inline std::atomic<instrumentation *> instrumentation_hook{nullptr};
+
+inline uint64_t read_cycles()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+	uint64_t v;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+	return v;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+#endif
+}
+
+template<typename Container>
+concept instruments_nested = requires { requires Container::instrument_nested; };
+
+// Encoders that want to know which struct member is being written, see size_report
+template<typename Container>
+concept tracks_members = requires { requires Container::track_members; };
+
+template<typename Container>
+concept decodes_trusted = requires { requires Container::trusted; };
+
+template<typename Container>
+concept checksums = requires { requires Container::checksum; };
+
+// Measures one pack/unpack, compiles to nothing when not Enabled
+template<bool Enabled>
+struct instrument_probe
+{
+	template<typename Container>
+	instrument_probe(const Container&)
+	{
+	}
+	template<typename T, typename Container>
+	void report(instrument_op, bool, const Container&)
+	{
+	}
+};
+
+template<>
+struct instrument_probe<true>
+{
+	template<typename Container>
+	instrument_probe(const Container& c) : hook(instrumentation_hook.load(std::memory_order_relaxed))
+	{
+		if(hook) [[unlikely]] {
+			start = c.position();
+			cycles = read_cycles();
+		}
+	}
+	template<typename T, typename Container>
+	void report(instrument_op op, bool nested, const Container& c)
+	{
+		if(hook) [[unlikely]] {
+			uint64_t elapsed = read_cycles() - cycles;
+			hook->record({op, nested, get_type_name<T>(), c.position() - start, elapsed});
+		}
+	}
+
+	instrumentation *hook;
+	size_t start = 0;
+	uint64_t cycles = 0;
 };
 
 template<typename T>
@@ -602,17 +990,28 @@ consteval auto func_name()
 #endif
 }
 
-template<size_t N, class T>
-constexpr auto get_member_ptr(T&& t) noexcept
-{
-	auto& p = decompose<aggregate_arity_calc<T>::Arity>::get<N>(t);
-	return &p;
-}
-
 // I hate this but it works
 template<typename T>
 extern const T external;
 
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wundefined-var-template"
+#endif
+// Every member address of external<T>, bound once per type rather than once per member
+template<typename T>
+inline constexpr auto member_addresses =
+    decompose<aggregate_arity_calc<T>::Arity>::apply(external<T>, tie_members{});
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+template<size_t N, class T>
+constexpr auto get_member_ptr() noexcept
+{
+	return &pick_member<N>(member_addresses<T>);
+}
+
 template<size_t N, typename T>
 struct compact_member_name
 {
@@ -620,12 +1019,11 @@ struct compact_member_name
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wundefined-var-template"
 #endif
-	static constexpr size_t S = func_name<get_member_ptr<N>(external<T>)>().size() + 1;
-	static inline constinit std::array<char, S> name = []() {
-		std::array<char, S> arr{};
-		auto s = func_name<get_member_ptr<N>(external<T>)>();
-		for(size_t i = 0; i < s.size(); i++) arr[i] = s[i];
-		arr[S - 1] = '\0';
+	// Evaluated once; the array copy keeps the full signature out of the binary
+	static constexpr std::string_view full = func_name<get_member_ptr<N, T>()>();
+	static inline constinit std::array<char, full.size() + 1> name = []() {
+		std::array<char, full.size() + 1> arr{};
+		std::copy(full.begin(), full.end(), arr.begin());
 		return arr;
 	}();
 #ifdef __clang__
@@ -640,32 +1038,142 @@ consteval std::string_view get_member_name()
 	return std::string_view(e.begin(), e.end() - 1);
 }
 
+// All member names of T in declaration order
 template<typename T>
-struct get_member_index_helper
+struct member_names
 {
-	template<size_t Index>
-	static constexpr bool helper2(uint32_t& out, std::string_view name)
+	static constexpr auto names = []<size_t... Index>(std::index_sequence<Index...>) {
+		return std::array<std::string_view, sizeof...(Index)>{get_member_name<T, Index>()...};
+	}(std::make_index_sequence<typeinfo<T>::Arity>());
+};
+
+constexpr uint64_t name_hash(std::string_view name)
+{
+	uint64_t h = 14695981039346656037ull;
+	for(char c : name) h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+	return h;
+}
+
+constexpr uint32_t displace_hash(uint64_t h, uint32_t d)
+{
+	h ^= d * 0x9e3779b97f4a7c15ull;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ull;
+	return static_cast<uint32_t>(h >> 32);
+}
+
+// Perfect hash from member name to index (hash and displace): the name hash picks a bucket, the bucket's displacement
+// places each of its names in a distinct slot. A lookup is one pass over the key and one compare. Names whose hashes
+// collide can't be placed, the table then falls back to comparing every name.
+template<size_t N>
+struct member_hash_table
+{
+	static constexpr size_t kBuckets = std::bit_ceil(N / 4 + 1);
+	static constexpr size_t kSlots = std::bit_ceil(N + N / 2 + 1);
+	static constexpr uint32_t kMaxDisplace = 4096;
+
+	std::array<uint32_t, kBuckets> displace{};
+	// Member index + 1, 0 is empty
+	std::array<uint8_t, kSlots> slots{};
+	bool linear = false;
+
+	consteval member_hash_table(const std::array<uint64_t, N>& hashes)
+	{
+		// Group names by bucket
+		std::array<size_t, kBuckets + 1> start{};
+		for(size_t i = 0; i < N; i++) start[(hashes[i] & (kBuckets - 1)) + 1]++;
+		for(size_t b = 0; b < kBuckets; b++) start[b + 1] += start[b];
+		std::array<size_t, N> members{};
+		std::array<size_t, kBuckets> fill{};
+		for(size_t i = 0; i < N; i++) {
+			size_t b = hashes[i] & (kBuckets - 1);
+			members[start[b] + fill[b]++] = i;
+		}
+
+		// Place the fullest buckets first while the table is emptiest
+		std::array<size_t, kBuckets> order{};
+		for(size_t b = 0; b < kBuckets; b++) order[b] = b;
+		std::sort(order.begin(), order.end(), [&](size_t l, size_t r) { return fill[l] > fill[r]; });
+		std::array<uint32_t, N> placed{};
+		for(size_t b : order) {
+			if(fill[b] == 0)
+				break;
+			for(uint32_t d = 1;; d++) {
+				if(d == kMaxDisplace) {
+					linear = true;
+					return;
+				}
+				bool ok = true;
+				for(size_t j = 0; j < fill[b] && ok; j++) {
+					placed[j] = displace_hash(hashes[members[start[b] + j]], d) & (kSlots - 1);
+					ok = !slots[placed[j]];
+					for(size_t k = 0; k < j && ok; k++) ok = placed[k] != placed[j];
+				}
+				if(ok) {
+					displace[b] = d;
+					for(size_t j = 0; j < fill[b]; j++) slots[placed[j]] = static_cast<uint8_t>(members[start[b] + j] + 1);
+					break;
+				}
+			}
+		}
+	}
+
+	constexpr uint32_t find(std::string_view name, const std::array<std::string_view, N>& names) const
 	{
-		if(name == get_member_name<T, Index>()) {
-			out = Index;
-			return true;
+		if(linear) [[unlikely]] {
+			for(uint32_t i = 0; i < N; i++)
+				if(names[i] == name)
+					return i;
+			return ~0u;
 		}
-		return false;
+		uint64_t h = name_hash(name);
+		uint8_t i = slots[displace_hash(h, displace[h & (kBuckets - 1)]) & (kSlots - 1)];
+		if(i && names[i - 1] == name)
+			return i - 1;
+		return ~0u;
 	}
+};
 
-	template<size_t... Index>
-	static constexpr uint32_t helper(std::string_view name, std::index_sequence<Index...>)
+template<typename T>
+struct member_lookup
+{
+	// The runtime name copies are not readable at compile time, hash the names they were made from
+	template<size_t Index>
+	static consteval std::string_view constant_name()
+	{
+		if constexpr(has_member_names<T>)
+			return T::kMembers[Index];
+		else
+			return compact_member_name<Index, T>::full;
+	}
+
+	static consteval bool distinct_names()
 	{
-		uint32_t o = ~0u;
-		(helper2<Index>(o, name) || ...);
-		return o;
+		return []<size_t... Index>(std::index_sequence<Index...>) {
+			std::array<std::string_view, sizeof...(Index)> names{constant_name<Index>()...};
+			for(size_t i = 0; i < names.size(); i++)
+				for(size_t j = 0; j < i; j++)
+					if(names[i] == names[j])
+						return false;
+			return true;
+		}(std::make_index_sequence<typeinfo<T>::Arity>());
 	}
+	static_assert(distinct_names(), "two members share a name, check kMembers for duplicates");
+
+	static constexpr member_hash_table<typeinfo<T>::Arity> table = []<size_t... Index>(std::index_sequence<Index...>) {
+		return member_hash_table<sizeof...(Index)>({name_hash(constant_name<Index>())...});
+	}(std::make_index_sequence<typeinfo<T>::Arity>());
 };
 
+// Index of the member called name, or ~0u. Parsers pass the member after the last one they saw as expected, keys in
+// declaration order are then matched with a single compare.
 template<typename T>
-constexpr uint32_t get_member_index(std::string_view name)
+constexpr uint32_t get_member_index(std::string_view name, uint32_t expected = ~0u)
 {
-	return get_member_index_helper<T>::helper(name, std::make_index_sequence<typeinfo<T>::Arity>());
+	const auto& names = member_names<T>::names;
+	if(expected < names.size() && names[expected] == name) [[likely]]
+		return expected;
+	return member_lookup<T>::table.find(name, names);
 }
 
 template<typename T>
@@ -853,26 +1361,126 @@ struct emit_element<omit<T>>
 	static constexpr uint8_t value = 0;
 };
 
-template<typename T, size_t Arity, size_t... Index>
-static consteval uint8_t calculate_predecode(std::index_sequence<Index...>)
+// Types whose encoding is exactly their in-memory representation, these can be copied as a single block.
+// bool is excluded as decoding arbitrary bytes into it is not safe.
+template<typename T, bool VariableEncoding>
+struct is_memcpy_encodable : std::false_type
 {
-	return (
-	    emit_element<std::remove_cvref_t<decltype(decompose<Arity>::template get<Index>(std::declval<T>()))>>::value +
-	    ... + 0);
-}
-
-template<typename T>
-concept has_postdecode_check = requires(T t) { t.post_decode(); };
+};
 
-template<typename T>
-constexpr void maybe_postdecode(T& v)
+template<std::integral T, bool VariableEncoding>
+struct is_memcpy_encodable<T, VariableEncoding>
+    : std::bool_constant<!std::is_same_v<T, bool> && (sizeof(T) == 1 || !VariableEncoding)>
 {
-}
+};
 
-template<has_postdecode_check T>
-void maybe_postdecode(T& v)
+template<std::floating_point T, bool VariableEncoding>
+struct is_memcpy_encodable<T, VariableEncoding> : std::true_type
 {
-	v.post_decode();
+};
+
+template<typename T, bool VariableEncoding>
+    requires(std::is_enum_v<T>)
+struct is_memcpy_encodable<T, VariableEncoding> : is_memcpy_encodable<std::underlying_type_t<T>, VariableEncoding>
+{
+};
+
+template<typename T, bool VariableEncoding>
+    requires(is_aggregate_struct<T> && requires { typeinfo<T>::template is_memcpy_encodable<VariableEncoding>; })
+struct is_memcpy_encodable<T, VariableEncoding>
+    : std::bool_constant<typeinfo<T>::template is_memcpy_encodable<VariableEncoding>>
+{
+};
+
+// Container here is the encoder, ie bytes_converter
+template<typename T, typename Container>
+concept use_memcpy = requires { Container::variable_encoding; } &&
+                     is_memcpy_encodable<T, Container::variable_encoding>::value;
+
+template<typename T>
+concept is_contiguous_container = requires(T t) {
+	t.data();
+	requires std::contiguous_iterator<decltype(t.begin())>;
+};
+
+template<typename T, size_t Arity, size_t... Index>
+static consteval uint8_t calculate_predecode(std::index_sequence<Index...>)
+{
+	return (
+	    emit_element<std::remove_cvref_t<decltype(decompose<Arity>::template get<Index>(std::declval<T>()))>>::value +
+	    ... + 0);
+}
+
+template<typename T, size_t Arity, bool VariableEncoding, size_t... Index>
+static consteval bool calculate_memcpy(std::index_sequence<Index...>)
+{
+	return (is_memcpy_encodable<std::remove_cvref_t<decltype(decompose<Arity>::template get<Index>(std::declval<T>()))>,
+	            VariableEncoding>::value &&
+	           ...) &&
+	       (sizeof(std::remove_cvref_t<decltype(decompose<Arity>::template get<Index>(std::declval<T>()))>) + ... + 0) ==
+	           sizeof(T);
+}
+
+template<typename T>
+concept has_postdecode_check = requires(T t) { t.post_decode(); };
+
+// Presence bitmap of a sparse struct, bit i is set when the i-th encoded member follows
+struct presence_bitmap
+{
+	static constexpr size_t kMaxBits = 256;
+	uint8_t bits[kMaxBits / 8] = {};
+
+	bool test(size_t i) const
+	{
+		return (bits[i >> 3] >> (i & 7)) & 1;
+	}
+	void set(size_t i)
+	{
+		bits[i >> 3] |= uint8_t(1 << (i & 7));
+	}
+	// Whether any of bits [from, n) is set
+	bool any(size_t from, size_t n) const
+	{
+		for(size_t i = from; i < n; i++)
+			if(test(i))
+				return true;
+		return false;
+	}
+};
+
+template<typename T>
+struct is_deprecated : std::false_type
+{
+};
+template<typename T>
+struct is_deprecated<deprecated<T>> : std::true_type
+{
+};
+
+// A sparse struct leaves out members equal to the same member of a default constructed struct. Floating point values
+// compare by bits so that -0.0 survives, anything that can't be compared is always written.
+template<typename M>
+bool is_default_member(const M& m, const M& d)
+{
+	if constexpr(is_deprecated<M>::value)
+		return true;
+	else if constexpr(std::is_floating_point_v<M>)
+		return memcmp(&m, &d, sizeof(M)) == 0;
+	else if constexpr(std::equality_comparable<M>)
+		return m == d;
+	else
+		return false;
+}
+
+template<typename T>
+constexpr void maybe_postdecode(T& v)
+{
+}
+
+template<has_postdecode_check T>
+void maybe_postdecode(T& v)
+{
+	v.post_decode();
 }
 
 // struct / class
@@ -882,26 +1490,47 @@ struct typeinfo<T>
 	using type = T;
 	static constexpr uint8_t type_id = static_cast<uint8_t>(type_id::struct_);
 	static constexpr size_t Arity = aggregate_arity_calc<T>::Arity;
-	static_assert(Arity < 250);
+	static_assert(Arity <= 250);
 
 	static constexpr bool is_backwards_compatible = struct_traits<T>::Traits & traits::backwards_compatible;
-	static constexpr size_t predecode_info =
-	    (Arity > 0 ? calculate_predecode<T, Arity>(std::make_index_sequence<Arity>()) : 0) * 4 + 2 +
-	    (is_backwards_compatible ? 1 : 0);
+	static constexpr bool is_sparse = struct_traits<T>::Traits & traits::sparse;
+	static constexpr size_t emitted = Arity > 0 ? calculate_predecode<T, Arity>(std::make_index_sequence<Arity>()) : 0;
+	// Dense prefixes always have bit 1 set, a sparse prefix counts the bits of the presence bitmap that follows
+	static constexpr size_t predecode_info = emitted * 4 + (is_sparse ? 0 : 2) + (is_backwards_compatible ? 1 : 0);
+	static constexpr size_t bitmap_size = (emitted + 7) / 8;
 	static constexpr bool use_predecode = !(struct_traits<T>::Traits & traits::immutable);
+	static_assert(!is_sparse || use_predecode, "an immutable struct has no prefix to mark it sparse");
+
+	// Position of member I in the presence bitmap
+	template<size_t I>
+	static constexpr size_t slot = calculate_predecode<T, Arity>(std::make_index_sequence<I>());
+
+	// An immutable struct without padding made only of memcpy-able members is encoded exactly as it is laid out in memory
+	template<bool VariableEncoding>
+	static constexpr bool is_memcpy_encodable =
+	    !use_predecode && Arity > 0 && std::is_trivially_copyable_v<T> &&
+	    calculate_memcpy<T, Arity, VariableEncoding>(std::make_index_sequence<Arity>());
 
 	template<typename Container>
 	static void pack(T& obj, Container& out)
 	{
-		if constexpr(use_predecode)
-			out.write_sz(predecode_info);
-		pack_predecoded(obj, out);
+		if constexpr(use_memcpy<T, Container>) {
+			instrument_probe<instruments_nested<Container>> probe(out);
+			out.writebuf(&obj, sizeof(T));
+			probe.template report<T>(instrument_op::pack, true, out);
+		} else {
+			if constexpr(use_predecode)
+				out.write_prefix(predecode_info);
+			pack_predecoded(obj, out);
+		}
 	}
 
 	template<typename Container>
 	static void pack_predecoded(T& obj, Container& out)
 	{
+		instrument_probe<instruments_nested<Container>> probe(out);
 		pack_helper(obj, out, std::make_index_sequence<Arity>());
+		probe.template report<T>(instrument_op::pack, true, out);
 	}
 
 	template<typename Container, size_t... Index>
@@ -912,18 +1541,85 @@ struct typeinfo<T>
 			if constexpr(is_backwards_compatible) {
 				at = out.push();
 			}
-			(typeinfo<std::remove_cvref_t<decltype(decompose<Arity>::template get<Index>(std::declval<T>()))>>::pack(
-			     decompose<Arity>::template get<Index>(obj), out),
-			    ...);
+			if constexpr(is_sparse) {
+				presence_bitmap present = presence(obj);
+				out.writebuf(present.bits, bitmap_size);
+				((present.test(slot<Index>) ? pack_member<Index>(obj, out) : void()), ...);
+			} else {
+				(pack_member<Index>(obj, out), ...);
+			}
 			if constexpr(is_backwards_compatible) {
 				out.pop(at);
 			}
+			if constexpr(checksums<Container>)
+				out.fold_checksum();
+		}
+	}
+
+	static const T& default_image()
+	{
+		static const T image{};
+		return image;
+	}
+
+	static presence_bitmap presence(const T& obj)
+	{
+		presence_bitmap present;
+		[&]<size_t... Index>(std::index_sequence<Index...>) {
+			(mark_present<Index>(obj, default_image(), present), ...);
+		}(std::make_index_sequence<Arity>());
+		return present;
+	}
+
+	// An absent member holds its default value
+	template<size_t I>
+	static void reset_absent(T& obj)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		auto& m = decompose<Arity>::template get<I>(obj);
+		if constexpr(std::is_copy_assignable_v<M>)
+			m = decompose<Arity>::template get<I>(const_cast<T&>(default_image()));
+		else
+			m = M{};
+	}
+
+	template<size_t I>
+	static void mark_present(const T& obj, const T& image, presence_bitmap& present)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(emit_element<M>::value) {
+			auto& m = decompose<Arity>::template get<I>(const_cast<T&>(obj));
+			if(!is_default_member<M>(m, decompose<Arity>::template get<I>(const_cast<T&>(image))))
+				present.set(slot<I>);
+		}
+	}
+
+	template<size_t I, typename Container>
+	static void pack_member(T& obj, Container& out)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(tracks_members<Container>) {
+			auto token = out.template enter_member<M>(get_member_name<T, I>());
+			typeinfo<M>::pack(decompose<Arity>::template get<I>(obj), out);
+			out.leave_member(token);
+		} else {
+			typeinfo<M>::pack(decompose<Arity>::template get<I>(obj), out);
 		}
 	}
 
 	template<typename Container>
 	static void unpack(T& obj, Container& in)
 	{
+		if constexpr(use_memcpy<T, Container>) {
+			// A truncated buffer may still stop on a member boundary, leave that to the regular path
+			if(in.available() >= sizeof(T)) [[likely]] {
+				instrument_probe<instruments_nested<Container>> probe(in);
+				in.readbuf(&obj, sizeof(T));
+				maybe_postdecode(obj);
+				probe.template report<T>(instrument_op::unpack, true, in);
+				return;
+			}
+		}
 		size_t n = predecode_info;
 		if constexpr(use_predecode)
 			n = in.read_sz();
@@ -942,19 +1638,34 @@ struct typeinfo<T>
 		// If no elements were written, this is either an empty struct, or a deprecated<T>, in any case no size was written
 		if(n == 0)
 			return;
+		instrument_probe<instruments_nested<Container>> probe(in);
+		if constexpr(decodes_trusted<Container>) {
+			unpack_trusted(obj, in, std::index_sequence<Index...>());
+			probe.template report<T>(instrument_op::unpack, true, in);
+			return;
+		}
 		bool bc = n & 1;
+		bool sparse = !(n & 2);
 		n >>= 2;
 
 		size_t at = 0;
 		if(bc) {
 			at = in.enter();
-		} else if(n > Arity) [[unlikely]] {
+		} else if(n > Arity && !sparse) [[unlikely]] {
 			throw status::incompatible;
 		}
-		(maybe_unpack<Index>(obj, n, in) && ...);
+		if(sparse) {
+			presence_bitmap present = read_presence(n, bc, in);
+			(maybe_unpack_present<Index>(obj, present, n, in) && ...);
+		} else {
+			(maybe_unpack<Index>(obj, n, in) && ...);
+		}
 		if(bc)
 			in.leave(at);
+		if constexpr(checksums<Container>)
+			in.fold_checksum();
 		maybe_postdecode(obj);
+		probe.template report<T>(instrument_op::unpack, true, in);
 	}
 
 	template<size_t I, typename Container>
@@ -971,6 +1682,78 @@ struct typeinfo<T>
 		return true;
 	}
 
+	// The prefix is known to be predecode_info, so every member is there and in order
+	template<typename Container, size_t... Index>
+	static void unpack_trusted(T& obj, Container& in, std::index_sequence<Index...>)
+	{
+		size_t at = 0;
+		if constexpr(is_backwards_compatible)
+			at = in.enter();
+		if constexpr(is_sparse) {
+			presence_bitmap present;
+			in.readbuf(present.bits, bitmap_size);
+			(unpack_trusted_present<Index>(obj, present, in), ...);
+		} else {
+			(unpack_trusted_member<Index>(obj, in), ...);
+		}
+		if constexpr(is_backwards_compatible)
+			in.leave(at);
+		if constexpr(checksums<Container>)
+			in.fold_checksum();
+		maybe_postdecode(obj);
+	}
+
+	template<size_t I, typename Container>
+	static void unpack_trusted_member(T& obj, Container& in)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(emit_element<M>::value)
+			typeinfo<M>::unpack(decompose<Arity>::template get<I>(obj), in);
+	}
+
+	template<size_t I, typename Container>
+	static void unpack_trusted_present(T& obj, const presence_bitmap& present, Container& in)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(emit_element<M>::value) {
+			if(present.test(slot<I>))
+				typeinfo<M>::unpack(decompose<Arity>::template get<I>(obj), in);
+			else
+				reset_absent<I>(obj);
+		}
+	}
+
+	// Members this struct doesn't know may only be absent, unless they can be skipped over
+	template<typename Container>
+	static presence_bitmap read_presence(size_t n, bool bc, Container& in)
+	{
+		if(n > presence_bitmap::kMaxBits) [[unlikely]]
+			throw status::incompatible;
+		presence_bitmap present;
+		in.readbuf(present.bits, (n + 7) / 8);
+		if(!bc && present.any(emitted, n)) [[unlikely]]
+			throw status::incompatible;
+		return present;
+	}
+
+	template<size_t I, typename Container>
+	static bool maybe_unpack_present(T& obj, const presence_bitmap& present, size_t n, Container& in)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(!emit_element<M>::value)
+			return true;
+		if(slot<I> >= n)
+			return false;
+		if(!present.test(slot<I>)) {
+			reset_absent<I>(obj);
+			return true;
+		}
+		if(in.done())
+			return false;
+		typeinfo<M>::unpack(decompose<Arity>::template get<I>(obj), in);
+		return true;
+	}
+
 	static constexpr void get_types(type_list& t)
 	{
 		t.types.push_back(type_id);
@@ -1017,8 +1800,12 @@ struct typeinfo<T>
 	static void pack(std::array<type, N>& obj, Container& out)
 	{
 		out.write_sz(N + 1);
-		for(size_t i = 0; i < N; i++) {
-			typeinfo<type>::pack(obj[i], out);
+		if constexpr(use_memcpy<type, Container>) {
+			out.writebuf(obj.data(), N * sizeof(type));
+		} else {
+			for(size_t i = 0; i < N; i++) {
+				typeinfo<type>::pack(obj[i], out);
+			}
 		}
 	}
 
@@ -1031,6 +1818,12 @@ struct typeinfo<T>
 		n--;
 		if(n > N)
 			throw status::incompatible;
+		if constexpr(use_memcpy<type, Container>) {
+			if(in.available() >= n * sizeof(type)) [[likely]] {
+				in.readbuf(obj.data(), n * sizeof(type));
+				return;
+			}
+		}
 		for(size_t i = 0; i < n; i++) {
 			typeinfo<type>::unpack(obj[i], in);
 		}
@@ -1071,8 +1864,12 @@ struct typeinfo<T>
 	static void pack(T& obj, Container& out)
 	{
 		out.write_sz(N + 1);
-		for(size_t i = 0; i < N; i++) {
-			typeinfo<type>::pack(obj[i], out);
+		if constexpr(use_memcpy<type, Container>) {
+			out.writebuf(&obj[0], N * sizeof(type));
+		} else {
+			for(size_t i = 0; i < N; i++) {
+				typeinfo<type>::pack(obj[i], out);
+			}
 		}
 	}
 
@@ -1085,6 +1882,12 @@ struct typeinfo<T>
 		n--;
 		if(n > N)
 			throw status::incompatible;
+		if constexpr(use_memcpy<type, Container>) {
+			if(in.available() >= n * sizeof(type)) [[likely]] {
+				in.readbuf(&obj[0], n * sizeof(type));
+				return;
+			}
+		}
 		for(size_t i = 0; i < n; i++) {
 			typeinfo<type>::unpack(obj[i], in);
 		}
@@ -1522,12 +2325,16 @@ struct typeinfo<T>
 	static void pack(type& obj, Container& out)
 	{
 		out.write_sz(obj.size() + 1);
-		if constexpr(has_predecode_info<V>::value) {
-			out.write_sz(typeinfo<V>::predecode_info);
+		if constexpr(is_contiguous_container<T> && use_memcpy<V, Container>) {
+			out.writebuf(obj.data(), obj.size() * sizeof(V));
+		} else if constexpr(has_predecode_info<V>::value) {
+			out.write_prefix(typeinfo<V>::predecode_info);
 			for(auto it = obj.begin(); it != obj.end(); ++it) typeinfo<V>::pack_predecoded(*it, out);
 		} else {
 			for(auto it = obj.begin(); it != obj.end(); ++it) typeinfo<V>::pack(*it, out);
 		}
+		if constexpr(checksums<Container>)
+			out.fold_checksum();
 	}
 
 	template<typename Container>
@@ -1540,12 +2347,22 @@ struct typeinfo<T>
 		if(sz > kMaximumVectorSize) [[unlikely]]
 			throw status::out_of_memory;
 		obj.resize(sz);
+		if constexpr(is_contiguous_container<T> && use_memcpy<V, Container>) {
+			if(in.available() >= sz * sizeof(V)) [[likely]] {
+				in.readbuf(obj.data(), sz * sizeof(V));
+				if constexpr(checksums<Container>)
+					in.fold_checksum();
+				return;
+			}
+		}
 		if constexpr(has_predecode_info<V>::value) {
 			size_t pd = in.read_sz();
 			for(auto it = obj.begin(); it != obj.end(); ++it) typeinfo<V>::unpack_predecoded(*it, in, pd);
 		} else {
 			for(auto it = obj.begin(); it != obj.end(); ++it) typeinfo<V>::unpack(*it, in);
 		}
+		if constexpr(checksums<Container>)
+			in.fold_checksum();
 	}
 
 	static constexpr void get_types(type_list& t)
@@ -1947,7 +2764,7 @@ struct typeinfo<std::tuple<V...>>
 	template<typename Container>
 	static void pack(const type& obj, Container& out)
 	{
-		out.write_sz(predecode_info);
+		out.write_prefix(predecode_info);
 		pack_helper(obj, out, std::make_index_sequence<sizeof...(V)>());
 	}
 
@@ -2009,7 +2826,128 @@ struct typeinfo<std::tuple<V...>>
 	}
 };
 
-consteval unsigned int ct_crc32(const uint8_t *bytes, size_t n)
+// Upper bound on the encoded size of a type, if one exists
+static constexpr size_t kUnboundedSize = ~(size_t)0;
+
+constexpr size_t varint_size(size_t v)
+{
+	size_t n = 1;
+	while(v > 0x7F) {
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+constexpr size_t add_size(size_t a, size_t b)
+{
+	return (a == kUnboundedSize || b == kUnboundedSize) ? kUnboundedSize : a + b;
+}
+
+constexpr size_t mul_size(size_t a, size_t n)
+{
+	return (a == kUnboundedSize) ? kUnboundedSize : a * n;
+}
+
+// Anything containing a container, string or pointer has no bound
+template<typename T, bool VariableEncoding>
+struct max_size
+{
+	static constexpr size_t value = kUnboundedSize;
+};
+
+template<std::integral T, bool VariableEncoding>
+struct max_size<T, VariableEncoding>
+{
+	static constexpr size_t value = (sizeof(T) == 1 || !VariableEncoding) ? sizeof(T) : (sizeof(T) * 8 + 6) / 7;
+};
+
+template<std::floating_point T, bool VariableEncoding>
+struct max_size<T, VariableEncoding>
+{
+	static constexpr size_t value = sizeof(T);
+};
+
+template<typename T, bool VariableEncoding>
+    requires(std::is_enum_v<T>)
+struct max_size<T, VariableEncoding> : max_size<std::underlying_type_t<T>, VariableEncoding>
+{
+};
+
+template<typename T, bool VariableEncoding>
+struct max_size<omit<T>, VariableEncoding>
+{
+	static constexpr size_t value = 0;
+};
+
+template<typename T, bool VariableEncoding>
+struct max_size<deprecated<T>, VariableEncoding>
+{
+	static constexpr size_t value = 1;
+};
+
+template<typename T, bool VariableEncoding>
+struct max_size<std::optional<T>, VariableEncoding>
+{
+	static constexpr size_t value = add_size(1, max_size<T, VariableEncoding>::value);
+};
+
+template<typename T, size_t N, bool VariableEncoding>
+struct max_size<std::array<T, N>, VariableEncoding>
+{
+	static constexpr size_t value = add_size(varint_size(N + 1), mul_size(max_size<T, VariableEncoding>::value, N));
+};
+
+template<typename T, size_t N, bool VariableEncoding>
+struct max_size<T[N], VariableEncoding> : max_size<std::array<T, N>, VariableEncoding>
+{
+};
+
+template<typename T, typename U, bool VariableEncoding>
+struct max_size<std::pair<T, U>, VariableEncoding>
+{
+	static constexpr size_t value = add_size(max_size<T, VariableEncoding>::value, max_size<U, VariableEncoding>::value);
+};
+
+template<typename... V, bool VariableEncoding>
+struct max_size<std::variant<V...>, VariableEncoding>
+{
+	static constexpr size_t value =
+	    add_size(varint_size(sizeof...(V)), std::max({(size_t)0, max_size<V, VariableEncoding>::value...}));
+};
+
+template<typename... V, bool VariableEncoding>
+struct max_size<std::tuple<V...>, VariableEncoding>
+{
+	static constexpr size_t value = []() {
+		size_t n = varint_size(typeinfo<std::tuple<V...>>::predecode_info);
+		((n = add_size(n, max_size<V, VariableEncoding>::value)), ...);
+		return n;
+	}();
+};
+
+template<typename T, size_t Arity, bool VariableEncoding, size_t... Index>
+consteval size_t calculate_max_size(std::index_sequence<Index...>)
+{
+	size_t n = 0;
+	((n = add_size(
+	      n, max_size<std::remove_cvref_t<decltype(decompose<Arity>::template get<Index>(std::declval<T>()))>,
+	             VariableEncoding>::value)),
+	    ...);
+	return n;
+}
+
+template<is_aggregate_struct T, bool VariableEncoding>
+struct max_size<T, VariableEncoding>
+{
+	using info = typeinfo<T>;
+	static constexpr size_t value =
+	    add_size((info::use_predecode ? varint_size(info::predecode_info) : 0) + (info::is_backwards_compatible ? 4 : 0) +
+	                 (info::is_sparse ? info::bitmap_size : 0),
+	        calculate_max_size<T, info::Arity, VariableEncoding>(std::make_index_sequence<info::Arity>()));
+};
+
+constexpr unsigned int ct_crc32(const uint8_t *bytes, size_t n)
 {
 	uint32_t crc = 0xFFFFFFFF;
 	for(size_t i = 0; i < n; i++) {
@@ -2039,27 +2977,81 @@ constexpr std::string_view get_type_name()
 	return detail::get_t_name<T>();
 }
 
+template<typename T, options o = options::none>
+concept has_bounded_size =
+    detail::max_size<std::remove_cv_t<T>, o & options::variable_length_encoding>::value != detail::kUnboundedSize;
+
+// The largest number of bytes T can ever encode to
+template<has_bounded_size T, options o = options::none>
+inline constexpr size_t max_packed_size_v = detail::max_size<std::remove_cv_t<T>, o & options::variable_length_encoding>::value +
+                                            ((o & options::checksum) ? detail::kChecksumSize : 0);
+
+namespace detail {
+// A buffer that declares a fixed capacity and can hold any value of T needs no capacity checks
+template<typename T, options o, typename Container>
+concept fits_fixed_buffer = requires { bytebuffer_impl<Container>::kCapacity; } && has_bounded_size<T, o> &&
+                            (max_packed_size_v<T, o> <= bytebuffer_impl<Container>::kCapacity);
+}
+
 template<options o, typename T, typename Container>
 inline void pack(const T& obj, Container& out)
 {
+	constexpr options opts = o | kDefaultInstrumentation;
+	static_assert(!(o & options::checksum) || !requires { bytebuffer_impl<Container>::kStreamed; },
+	    "checksummed output has to stay in memory");
 	bytebuffer_impl<Container> wrap(out, true);
-	detail::bytes_converter<o & options::variable_length_encoding> bc(wrap);
+	detail::bytes_converter<o & options::variable_length_encoding, detail::fits_fixed_buffer<T, o, Container>,
+	    opts & options::instrument_nested, false, o & options::checksum>
+	    bc(wrap);
+	detail::instrument_probe<opts & options::instrument> probe(bc);
 	detail::typeinfo<T>::pack(const_cast<T&>(obj), bc);
+	if constexpr(o & options::checksum)
+		bc.write_checksum();
+	probe.template report<T>(instrument_op::pack, false, bc);
 }
 
 template<options o, typename T, typename Container>
 [[nodiscard]] inline status unpack(T& obj, Container& in)
 {
+	constexpr options opts = o | kDefaultInstrumentation;
 	try {
 		bytebuffer_impl<Container> wrap(in, false);
-		detail::bytes_converter<o & options::variable_length_encoding> bc(wrap);
-		detail::typeinfo<T>::unpack(obj, bc);
-		return wrap.ok() ? status::ok : status::data_underrun;
+		detail::bytes_converter<o & options::variable_length_encoding, false, opts & options::instrument_nested,
+		    o & options::trusted, o & options::checksum>
+		    bc(wrap);
+		detail::instrument_probe<opts & options::instrument> probe(bc);
+		if constexpr(o & options::checksum) {
+			// The value ends where the trailer starts
+			if(wrap.e - wrap.p < (ptrdiff_t)detail::kChecksumSize)
+				return status::data_underrun;
+			wrap.e -= detail::kChecksumSize;
+			// Damage shows up as whatever the decoder trips over first, the checksum tells the two apart
+			try {
+				detail::typeinfo<T>::unpack(obj, bc);
+			} catch(status s) {
+				if(!bc.checksum_matches())
+					return status::checksum_mismatch;
+				throw;
+			}
+			if(!bc.checksum_matches())
+				return status::checksum_mismatch;
+		} else {
+			detail::typeinfo<T>::unpack(obj, bc);
+		}
+		if(!wrap.ok())
+			return status::data_underrun;
+		probe.template report<T>(instrument_op::unpack, false, bc);
+		return status::ok;
 	} catch(status s) {
 		return s;
 	}
 }
 
+inline instrumentation *set_instrumentation(instrumentation *hook)
+{
+	return detail::instrumentation_hook.exchange(hook);
+}
+
 template<typename T, typename Foreach>
 inline void foreach_member(T& obj, Foreach& c)
 {
@@ -2102,15 +3094,15 @@ struct bytebuffer_impl<T> : public bytebuffer
 	}
 	void more_buffer(size_t n) override
 	{
+		size_t used = p - s;
 		o.resize(o.size() + n + 256);
-		ptrdiff_t delta = o.data() - s;
-		s += delta;
-		p += delta;
-		e += delta;
+		s = o.data();
+		p = s + used;
+		e = s + o.size();
 	}
 	void seek_to(size_t at) override
 	{
-		if(at >= o.size())
+		if(at > o.size())
 			throw status::data_underrun;
 		p = s + at;
 	}
@@ -2124,6 +3116,65 @@ struct bytebuffer_impl<T> : public bytebuffer
 	bool write;
 };
 
+// Inline storage for encoding without any allocation
+template<size_t N>
+struct fixed_buffer
+{
+	std::array<uint8_t, N> bytes;
+	size_t size = 0;
+
+	uint8_t *data()
+	{
+		return bytes.data();
+	}
+	std::span<uint8_t> span()
+	{
+		return std::span<uint8_t>(bytes.data(), size);
+	}
+};
+
+template<size_t N>
+struct bytebuffer_impl<fixed_buffer<N>> : public bytebuffer
+{
+	static constexpr size_t kCapacity = N;
+
+	bytebuffer_impl(fixed_buffer<N>& o, bool write) : o(o), write(write)
+	{
+		s = p = o.bytes.data();
+		e = s + (write ? N : o.size);
+	}
+
+	~bytebuffer_impl()
+	{
+		if(write)
+			o.size = p - s;
+	}
+
+	void more_data(size_t n) override
+	{
+		if(n > 0)
+			throw status::data_underrun;
+	}
+	void more_buffer(size_t n) override
+	{
+		throw status::out_of_memory;
+	}
+	void seek_to(size_t at) override
+	{
+		if(at > size_t(e - s))
+			throw status::data_underrun;
+		p = s + at;
+	}
+	void fix_offset(size_t at, uint32_t n) override
+	{
+		memcpy(o.bytes.data() + at, &n, 4);
+	}
+	void flush_all() override {}
+
+	fixed_buffer<N>& o;
+	bool write;
+};
+
 template<>
 struct bytebuffer_impl<std::span<uint8_t>> : public bytebuffer
 {
@@ -2145,7 +3196,7 @@ struct bytebuffer_impl<std::span<uint8_t>> : public bytebuffer
 	void more_buffer(size_t n) override {}
 	void seek_to(size_t at) override
 	{
-		if(at >= o.size())
+		if(at > o.size())
 			throw status::data_underrun;
 		p = s + at;
 	}
@@ -2158,6 +3209,9 @@ struct bytebuffer_impl<std::span<uint8_t>> : public bytebuffer
 template<typename C, typename T>
 struct bytebuffer_impl<std::basic_ostream<C, T>> : public bytebuffer
 {
+	// Written out a chunk at a time
+	static constexpr bool kStreamed = true;
+
 	bytebuffer_impl(std::basic_ostream<C, T>& o, bool write) : o(o)
 	{
 		if(!write)
@@ -2207,6 +3261,979 @@ struct bytebuffer_impl<std::basic_istream<C, T>>
 template<options opts = options::none>
 using serializer_t = detail::bytes_converter<opts & options::variable_length_encoding>;
 
+namespace detail {
+// Storage that is only ever grown, size is the number of bytes in use
+struct retained_buffer
+{
+	std::vector<uint8_t> storage;
+	size_t size = 0;
+};
+} // namespace detail
+
+template<>
+struct bytebuffer_impl<detail::retained_buffer> : public bytebuffer
+{
+	bytebuffer_impl(detail::retained_buffer& o, bool write) : o(o)
+	{
+		if(!write)
+			throw status::read_disallowed;
+		if(o.storage.empty())
+			o.storage.resize(256);
+		s = p = o.storage.data();
+		e = s + o.storage.size();
+	}
+
+	~bytebuffer_impl()
+	{
+		o.size = p - s;
+	}
+
+	void more_data(size_t n) override {}
+	void more_buffer(size_t n) override
+	{
+		size_t used = p - s;
+		o.storage.resize(std::max(o.storage.size() * 2, used + n));
+		s = o.storage.data();
+		p = s + used;
+		e = s + o.storage.size();
+	}
+	void seek_to(size_t at) override {}
+	void fix_offset(size_t at, uint32_t n) override
+	{
+		memcpy(o.storage.data() + at, &n, 4);
+	}
+	void flush_all() override {}
+
+	detail::retained_buffer& o;
+};
+
+// Encodes many objects in turn, reusing the same output storage.
+// Each call to pack invalidates the view returned by the previous one.
+template<options o = options::none>
+class packer
+{
+public:
+	template<typename T>
+	std::span<const uint8_t> pack(const T& obj)
+	{
+		::packall::pack<o>(obj, buf);
+		return view();
+	}
+
+	std::span<const uint8_t> view() const
+	{
+		return std::span<const uint8_t>(buf.storage.data(), buf.size);
+	}
+
+	size_t capacity() const
+	{
+		return buf.storage.size();
+	}
+
+	// Release all retained memory
+	void reset()
+	{
+		buf = detail::retained_buffer();
+	}
+
+private:
+	detail::retained_buffer buf;
+};
+
+// A packer per thread, for callers that cannot conveniently keep one around
+template<options o = options::none>
+packer<o>& thread_packer()
+{
+	thread_local packer<o> p;
+	return p;
+}
+
+namespace detail {
+
+// Output is discarded, only the position is needed
+struct counting_buffer : public bytebuffer
+{
+	counting_buffer()
+	{
+		more_buffer(0);
+	}
+
+	void more_data(size_t n) override
+	{
+		throw status::read_disallowed;
+	}
+	void more_buffer(size_t n) override
+	{
+		offset += p - s;
+		if(storage.size() < std::max<size_t>(n, 4096))
+			storage.resize(std::max<size_t>(n, 4096));
+		s = p = storage.data();
+		e = s + storage.size();
+	}
+	void seek_to(size_t at) override
+	{
+		throw status::read_disallowed;
+	}
+	void fix_offset(size_t at, uint32_t n) override
+	{
+		if(sizes)
+			sizes->emplace_back(at, n);
+	}
+	void flush_all() override {}
+
+	std::vector<uint8_t> storage;
+	// If set, collects the position and size of every backwards_compatible struct, innermost first
+	std::vector<std::pair<size_t, uint32_t>> *sizes = nullptr;
+};
+
+// Everything received and not yet consumed by a decoder. offset is the stream position of s.
+struct pending_buffer : public bytebuffer
+{
+	void more_data(size_t n) override
+	{
+		if(n > 0) {
+			wanted = received() + n;
+			throw status::data_underrun;
+		}
+	}
+	void more_buffer(size_t n) override
+	{
+		throw status::write_disallowed;
+	}
+	void seek_to(size_t at) override
+	{
+		if(at > received()) {
+			wanted = at;
+			throw status::data_underrun;
+		}
+		p = s + (at - offset);
+	}
+	void fix_offset(size_t at, uint32_t n) override {}
+	void flush_all() override {}
+
+	size_t position() const
+	{
+		return offset + (p - s);
+	}
+	size_t received() const
+	{
+		return offset + (e - s);
+	}
+
+	void append(std::span<const uint8_t> bytes)
+	{
+		size_t at = p - s;
+		storage.insert(storage.end(), bytes.begin(), bytes.end());
+		reset_pointers(at);
+	}
+	// Drop consumed bytes once they make up at least half of the storage
+	void compact()
+	{
+		size_t used = mark - offset;
+		if(used == 0 || used < storage.size() / 2)
+			return;
+		size_t at = (p - s) - used;
+		storage.erase(storage.begin(), storage.begin() + used);
+		offset += used;
+		reset_pointers(at);
+	}
+	void reset_pointers(size_t at)
+	{
+		s = storage.data();
+		p = s + at;
+		e = s + storage.size();
+	}
+
+	// Decoding restarts from the last mark when it runs out of input
+	void set_mark()
+	{
+		mark = position();
+		if(mark >= limit) [[unlikely]]
+			throw status::need_more;
+	}
+	void rewind()
+	{
+		p = s + (mark - offset);
+	}
+
+	std::vector<uint8_t> storage;
+	size_t mark = 0;
+	// Decoding again from the mark stops at the same read until this much has been received
+	size_t wanted = 0;
+	// Stop at the first mark past this position
+	size_t limit = kUnboundedSize;
+};
+
+template<bool VariableEncoding>
+struct resumable_converter : public bytes_converter<VariableEncoding>
+{
+	resumable_converter(pending_buffer& pending) : bytes_converter<VariableEncoding>(pending), pending(pending) {}
+
+	// Running out of input only ends a struct early once it is known that no more is coming
+	bool done() const
+	{
+		return finished && this->wrap.end();
+	}
+
+	pending_buffer& pending;
+	bool finished = false;
+};
+
+template<typename T>
+struct is_vector_bool : std::false_type
+{
+};
+template<typename A>
+struct is_vector_bool<std::vector<bool, A>> : std::true_type
+{
+};
+template<typename T>
+struct is_basic_string : std::false_type
+{
+};
+template<typename T, typename Traits, typename Alloc>
+struct is_basic_string<std::basic_string<T, Traits, Alloc>> : std::true_type
+{
+};
+
+// Values that can stop part way and resume, anything else is decoded again from its start once more bytes arrive
+template<typename T>
+concept is_resumable = (is_aggregate_struct<T> && typeinfo<T>::Arity > 0) ||
+                       (is_listlike<T> && !is_vector_bool<T>::value) || is_maplike<T>;
+
+template<typename Container>
+struct resume_frame;
+
+template<typename Container>
+using resume_stack = std::vector<std::unique_ptr<resume_frame<Container>>>;
+
+template<typename Container>
+struct resume_frame
+{
+	virtual ~resume_frame() = default;
+	// Returns true once the value is complete, or false after pushing a frame for a value that did not fit in
+	// the input so far. Running out of input throws, progress up to the last mark is kept.
+	virtual bool resume(Container& in, resume_stack<Container>& stack) = 0;
+};
+
+template<typename T, typename Container>
+std::unique_ptr<resume_frame<Container>> make_resume_frame(T& obj, size_t predecoded = 0);
+
+// Decodes v from the current position. If it is cut off and can resume, rewinds and pushes a frame for it instead.
+// With a work cap anything resumable gets a frame up front so that it can pause part way.
+template<typename T, typename Container, typename... Predecoded>
+bool unpack_or_resume(T& v, Container& in, resume_stack<Container>& stack, Predecoded... n)
+{
+	if constexpr(is_resumable<T>) {
+		if(in.pending.limit != kUnboundedSize) {
+			stack.push_back(make_resume_frame<T, Container>(v, n...));
+			return false;
+		}
+	}
+	try {
+		if constexpr(sizeof...(Predecoded) > 0) {
+			typeinfo<T>::unpack_predecoded(v, in, n...);
+		} else {
+			typeinfo<T>::unpack(v, in);
+		}
+	} catch(status s) {
+		if constexpr(is_resumable<T>) {
+			if(s == status::data_underrun && !in.finished) {
+				in.pending.rewind();
+				in.pending.wanted = 0;
+				stack.push_back(make_resume_frame<T, Container>(v, n...));
+				return false;
+			}
+		}
+		throw;
+	}
+	return true;
+}
+
+// Mirrors typeinfo<T>::unpack for structs, one member at a time
+template<typename T, typename Container>
+struct struct_frame : public resume_frame<Container>
+{
+	using info = typeinfo<T>;
+	static constexpr size_t Arity = info::Arity;
+	using member_fn = bool (*)(struct_frame&, Container&, resume_stack<Container>&);
+
+	struct_frame(T& obj, size_t predecoded) : obj(obj), n(predecoded), have_prefix(predecoded != 0) {}
+
+	bool resume(Container& in, resume_stack<Container>& stack) override
+	{
+		static constexpr auto members = make_members(std::make_index_sequence<Arity>());
+		if(!have_prefix) {
+			if constexpr(info::use_predecode)
+				n = in.read_sz();
+			else
+				n = info::predecode_info;
+			have_prefix = true;
+			in.pending.set_mark();
+		}
+		if(!started) {
+			if(n == 0)
+				return true;
+			sparse = !(n & 2);
+			if(n & 1) {
+				at = in.enter();
+				bc = true;
+			} else if((n >> 2) > Arity && !sparse) [[unlikely]] {
+				throw status::incompatible;
+			}
+			n >>= 2;
+			started = true;
+			in.pending.set_mark();
+		}
+		if(sparse && !have_presence) {
+			present = info::read_presence(n, bc, in);
+			have_presence = true;
+			in.pending.set_mark();
+		}
+		while(next < Arity && !stopped) {
+			if(!members[next](*this, in, stack))
+				return false;
+		}
+		if(bc)
+			in.leave(at);
+		maybe_postdecode(obj);
+		return true;
+	}
+
+	template<size_t... Index>
+	static constexpr std::array<member_fn, Arity> make_members(std::index_sequence<Index...>)
+	{
+		return {&member<Index>...};
+	}
+
+	template<size_t I>
+	static bool member(struct_frame& f, Container& in, resume_stack<Container>& stack)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(!emit_element<M>::value) {
+			f.next++;
+			return true;
+		} else {
+			if(f.sparse) {
+				if(info::template slot<I> >= f.n) {
+					f.stopped = true;
+					return true;
+				}
+				if(!f.present.test(info::template slot<I>)) {
+					info::template reset_absent<I>(f.obj);
+					f.next++;
+					return true;
+				}
+				if(in.done()) {
+					f.stopped = true;
+					return true;
+				}
+			} else if(f.n == 0 || in.done()) {
+				f.stopped = true;
+				return true;
+			}
+			bool complete = unpack_or_resume<M>(decompose<Arity>::template get<I>(f.obj), in, stack);
+			if(!f.sparse)
+				f.n--;
+			f.next++;
+			if(complete)
+				in.pending.set_mark();
+			return complete;
+		}
+	}
+
+	T& obj;
+	size_t n;
+	size_t at = 0;
+	size_t next = 0;
+	presence_bitmap present;
+	bool have_prefix;
+	bool started = false;
+	bool stopped = false;
+	bool bc = false;
+	bool sparse = false;
+	bool have_presence = false;
+};
+
+// Mirrors typeinfo<T>::unpack for list-like containers and strings, one element at a time. Bulk-copied elements are
+// taken as they arrive.
+template<typename T, typename Container>
+struct list_frame : public resume_frame<Container>
+{
+	using V = typename T::value_type;
+	static constexpr bool raw = is_basic_string<T>::value || (is_contiguous_container<T> && use_memcpy<V, Container>);
+
+	list_frame(T& obj) : obj(obj) {}
+
+	bool resume(Container& in, resume_stack<Container>& stack) override
+	{
+		if(!sized) {
+			size_t sz = in.read_sz();
+			if(sz == 0)
+				return true;
+			sz--;
+			if(sz > kMaximumVectorSize) [[unlikely]]
+				throw status::out_of_memory;
+			obj.resize(sz);
+			it = obj.begin();
+			sized = true;
+			in.pending.set_mark();
+		}
+		if constexpr(raw) {
+			size_t at = it - obj.begin();
+			size_t n = std::min<size_t>(obj.size() - at, in.available() / sizeof(V));
+			in.readbuf(obj.data() + at, n * sizeof(V));
+			it += n;
+			in.pending.set_mark();
+			if(it != obj.end())
+				throw status::data_underrun;
+		} else {
+			if constexpr(has_predecode_info<V>::value) {
+				if(!have_prefix) {
+					pd = in.read_sz();
+					have_prefix = true;
+					in.pending.set_mark();
+				}
+			}
+			while(it != obj.end()) {
+				bool complete;
+				if constexpr(has_predecode_info<V>::value) {
+					complete = unpack_or_resume<V>(*it, in, stack, pd);
+				} else {
+					complete = unpack_or_resume<V>(*it, in, stack);
+				}
+				++it;
+				if(!complete)
+					return false;
+				in.pending.set_mark();
+			}
+		}
+		return true;
+	}
+
+	T& obj;
+	typename T::iterator it{};
+	size_t pd = 0;
+	bool sized = false;
+	bool have_prefix = false;
+};
+
+// Mirrors typeinfo<T>::unpack for maps. Each key is decoded whole, a value that can resume gets a frame of its own and
+// its entry is added once that frame completes.
+template<typename T, typename Container>
+struct map_frame : public resume_frame<Container>
+{
+	using K = typename T::key_type;
+	using V = typename T::mapped_type;
+
+	map_frame(T& obj) : obj(obj) {}
+
+	bool resume(Container& in, resume_stack<Container>& stack) override
+	{
+		if(!sized) {
+			n = in.read_sz();
+			if(n == 0)
+				return true;
+			n--;
+			sized = true;
+			in.pending.set_mark();
+		}
+		if(in_value)
+			add_entry(in);
+		while(n > 0) {
+			if(!have_key) {
+				typeinfo<K>::unpack(key, in);
+				have_key = true;
+				in.pending.set_mark();
+			}
+			value = V{};
+			if(!unpack_or_resume<V>(value, in, stack)) {
+				in_value = true;
+				return false;
+			}
+			add_entry(in);
+		}
+		return true;
+	}
+
+	void add_entry(Container& in)
+	{
+		obj.emplace(std::move(key), std::move(value));
+		key = K{};
+		have_key = in_value = false;
+		n--;
+		in.pending.set_mark();
+	}
+
+	T& obj;
+	K key{};
+	V value{};
+	size_t n = 0;
+	bool sized = false;
+	bool have_key = false;
+	bool in_value = false;
+};
+
+template<typename T, typename Container>
+std::unique_ptr<resume_frame<Container>> make_resume_frame(T& obj, size_t predecoded)
+{
+	if constexpr(is_aggregate_struct<T>) {
+		return std::make_unique<struct_frame<T, Container>>(obj, predecoded);
+	} else if constexpr(is_maplike<T>) {
+		return std::make_unique<map_frame<T, Container>>(obj);
+	} else {
+		return std::make_unique<list_frame<T, Container>>(obj);
+	}
+}
+
+} // namespace detail
+
+// Decodes a value incrementally as its bytes arrive, eg from a non-blocking socket.
+// T is a struct, list-like container or map, these pick up where they stopped. Any other value inside them is decoded
+// again from its start when it is cut off, but not before the read that stopped it can complete.
+// T must stay alive until decoding is complete.
+template<typename T, options o = options::none>
+class decoder
+{
+	static_assert(!(o & options::checksum), "checksums are only kept by pack and unpack");
+	static_assert(detail::is_resumable<T>, "decoder needs a struct, list-like container or map, unpack anything else");
+
+public:
+	explicit decoder(T& obj) : obj(obj), in(wrap) {}
+
+	// Add received bytes and decode as far as they allow. If max_bytes is non-zero decoding pauses at the first
+	// point past that many bytes, continue with resume().
+	// Returns ok once the value is complete, need_more until then, or the error that stopped decoding.
+	status feed(std::span<const uint8_t> bytes, size_t max_bytes = 0)
+	{
+		if(result != status::need_more)
+			return result;
+		wrap.append(bytes);
+		return resume(max_bytes);
+	}
+
+	// Continue decoding what has already been fed
+	status resume(size_t max_bytes = 0)
+	{
+		if(result != status::need_more)
+			return result;
+		if(!in.finished && wrap.received() < wrap.wanted)
+			return status::need_more;
+		wrap.wanted = 0;
+		wrap.limit = max_bytes ? wrap.position() + max_bytes : detail::kUnboundedSize;
+		try {
+			if(!started) {
+				stack.push_back(detail::make_resume_frame<T, converter>(obj));
+				started = true;
+			}
+			while(!stack.empty()) {
+				if(stack.back()->resume(in, stack)) {
+					stack.pop_back();
+					if(!stack.empty())
+						wrap.set_mark();
+				}
+			}
+			wrap.mark = wrap.position();
+			result = status::ok;
+		} catch(status s) {
+			if(s == status::need_more || (s == status::data_underrun && !in.finished)) {
+				wrap.rewind();
+				wrap.compact();
+				return status::need_more;
+			}
+			result = s;
+		}
+		return result;
+	}
+
+	// No more bytes will arrive. As with unpack, a value cut off on a struct member boundary is complete.
+	status finish()
+	{
+		in.finished = true;
+		return resume();
+	}
+
+	// Bytes fed after the end of the value
+	std::span<const uint8_t> remaining() const
+	{
+		if(result != status::ok)
+			return {};
+		return std::span<const uint8_t>(wrap.p, wrap.e);
+	}
+
+private:
+	using converter = detail::resumable_converter<o & options::variable_length_encoding>;
+
+	T& obj;
+	detail::pending_buffer wrap;
+	converter in;
+	detail::resume_stack<converter> stack;
+	bool started = false;
+	status result = status::need_more;
+};
+
+namespace detail {
+
+// Writes straight into the buffer given to encoder::pull, anything that does not fit is held until the next pull.
+// offset is the stream position of s.
+struct pull_buffer : public bytebuffer
+{
+	void more_data(size_t n) override
+	{
+		throw status::read_disallowed;
+	}
+	void more_buffer(size_t n) override
+	{
+		size_t used = p - s;
+		if(!spilled) {
+			offset += used;
+			spill_base = offset;
+			spilled = true;
+			used = 0;
+		}
+		if(spill.size() < used + n + 256)
+			spill.resize(used + n + 256);
+		s = spill.data();
+		p = s + used;
+		e = s + spill.size();
+	}
+	void seek_to(size_t at) override
+	{
+		throw status::read_disallowed;
+	}
+	// Only values started in the current pull are patched, the field may straddle the caller's buffer and the spill
+	void fix_offset(size_t at, uint32_t n) override
+	{
+		uint8_t bytes[4];
+		memcpy(bytes, &n, 4);
+		for(size_t i = 0; i < 4; i++, at++) {
+			if(spilled && at >= spill_base)
+				spill[at - spill_base] = bytes[i];
+			else
+				out[at - out_start] = bytes[i];
+		}
+	}
+	void flush_all() override {}
+
+	// Copy bytes held back by the previous pull, returns how many
+	size_t drain(std::span<uint8_t> buf)
+	{
+		size_t n = std::min(buf.size(), held - drained);
+		if(n)
+			memcpy(buf.data(), spill.data() + drained, n);
+		drained += n;
+		if(drained == held)
+			held = drained = 0;
+		return n;
+	}
+	void begin(std::span<uint8_t> buf)
+	{
+		out = buf.data();
+		out_start = offset;
+		s = p = buf.data();
+		e = s + buf.size();
+		spilled = false;
+	}
+	// Returns how much of the caller's buffer was written
+	size_t end()
+	{
+		size_t n;
+		if(spilled) {
+			n = spill_base - out_start;
+			held = p - s;
+			drained = 0;
+			offset = spill_base + held;
+		} else {
+			n = p - s;
+			offset += n;
+		}
+		s = p = e = nullptr;
+		return n;
+	}
+
+	std::vector<uint8_t> spill;
+	size_t held = 0;
+	size_t drained = 0;
+	size_t spill_base = 0;
+	bool spilled = false;
+	uint8_t *out = nullptr;
+	size_t out_start = 0;
+};
+
+template<typename T, bool VariableEncoding>
+concept is_streamable = max_size<T, VariableEncoding>::value == kUnboundedSize &&
+                        ((is_aggregate_struct<T> && typeinfo<T>::Arity > 0) ||
+                            (is_listlike<T> && !is_vector_bool<T>::value) || is_maplike<T>);
+
+template<typename Container>
+struct emit_frame;
+
+template<typename Container>
+struct emit_stack : public std::vector<std::unique_ptr<emit_frame<Container>>>
+{
+	// Sizes of the backwards_compatible structs inside the last one measured, by stream position. Each subtree is
+	// measured once when its outermost struct starts.
+	std::vector<std::pair<size_t, uint32_t>> sizes;
+	size_t next_size = 0;
+
+	bool measured(size_t at, uint32_t& sz)
+	{
+		while(next_size < sizes.size() && sizes[next_size].first < at) next_size++;
+		if(next_size == sizes.size() || sizes[next_size].first != at)
+			return false;
+		sz = sizes[next_size++].second;
+		return true;
+	}
+};
+
+template<typename Container>
+struct emit_frame
+{
+	virtual ~emit_frame() = default;
+	// Writes the next part of the value, possibly by pushing a frame for a member. Returns true once all of it is written.
+	virtual bool resume(Container& out, emit_stack<Container>& stack) = 0;
+};
+
+template<typename T, typename Container>
+std::unique_ptr<emit_frame<Container>> make_emitter(T& obj, bool predecoded);
+
+// Small values are written whole, anything unbounded that can be split gets its own frame
+template<typename T, typename Container>
+void pack_or_stream(T& v, Container& out, emit_stack<Container>& stack, bool predecoded)
+{
+	if constexpr(is_streamable<T, Container::variable_encoding>) {
+		stack.push_back(make_emitter<T, Container>(v, predecoded));
+	} else if constexpr(has_predecode_info<T>::value) {
+		if(predecoded)
+			typeinfo<T>::pack_predecoded(v, out);
+		else
+			typeinfo<T>::pack(v, out);
+	} else {
+		typeinfo<T>::pack(v, out);
+	}
+}
+
+template<typename T, typename Container>
+struct whole_emitter : public emit_frame<Container>
+{
+	whole_emitter(T& obj) : obj(obj) {}
+
+	bool resume(Container& out, emit_stack<Container>& stack) override
+	{
+		typeinfo<T>::pack(obj, out);
+		return true;
+	}
+
+	T& obj;
+};
+
+// Mirrors typeinfo<T>::pack for structs, one member at a time
+template<typename T, typename Container>
+struct struct_emitter : public emit_frame<Container>
+{
+	using info = typeinfo<T>;
+	static constexpr size_t Arity = info::Arity;
+	using member_fn = void (*)(struct_emitter&, Container&, emit_stack<Container>&);
+
+	struct_emitter(T& obj, bool predecoded) : obj(obj), predecoded(predecoded) {}
+
+	bool resume(Container& out, emit_stack<Container>& stack) override
+	{
+		static constexpr auto members = make_members(std::make_index_sequence<Arity>());
+		if(!started) {
+			if constexpr(info::use_predecode) {
+				if(!predecoded)
+					out.write_prefix(info::predecode_info);
+			}
+			if constexpr(info::is_backwards_compatible) {
+				// pack patches this in once the struct is written, here those bytes are long gone so measure first
+				size_t at = out.position();
+				uint32_t sz;
+				if(!stack.measured(at, sz)) {
+					stack.sizes.clear();
+					counting_buffer wrap;
+					wrap.sizes = &stack.sizes;
+					bytes_converter<Container::variable_encoding> counter(wrap);
+					info::pack_predecoded(obj, counter);
+					for(auto& [pos, n] : stack.sizes) pos += at;
+					std::sort(stack.sizes.begin(), stack.sizes.end());
+					stack.next_size = 0;
+					stack.measured(at, sz);
+				}
+				out.writebuf(&sz, 4);
+			}
+			if constexpr(info::is_sparse) {
+				present = info::presence(obj);
+				out.writebuf(present.bits, info::bitmap_size);
+			}
+			started = true;
+			return false;
+		}
+		if(next == Arity)
+			return true;
+		members[next++](*this, out, stack);
+		return false;
+	}
+
+	template<size_t... Index>
+	static constexpr std::array<member_fn, Arity> make_members(std::index_sequence<Index...>)
+	{
+		return {&member<Index>...};
+	}
+
+	template<size_t I>
+	static void member(struct_emitter& f, Container& out, emit_stack<Container>& stack)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(emit_element<M>::value) {
+			if(info::is_sparse && !f.present.test(info::template slot<I>))
+				return;
+			pack_or_stream<M>(decompose<Arity>::template get<I>(f.obj), out, stack, false);
+		}
+	}
+
+	T& obj;
+	size_t next = 0;
+	presence_bitmap present;
+	bool predecoded;
+	bool started = false;
+};
+
+// Mirrors typeinfo<T>::pack for list-like containers and strings. Bulk-copied contents go out as fast as the
+// caller takes them.
+template<typename T, typename Container>
+struct list_emitter : public emit_frame<Container>
+{
+	using V = typename T::value_type;
+	static constexpr bool raw = is_basic_string<T>::value || (is_contiguous_container<T> && use_memcpy<V, Container>);
+
+	list_emitter(T& obj) : obj(obj) {}
+
+	bool resume(Container& out, emit_stack<Container>& stack) override
+	{
+		if(!started) {
+			out.write_sz(obj.size() + 1);
+			if constexpr(!raw && has_predecode_info<V>::value)
+				out.write_prefix(typeinfo<V>::predecode_info);
+			it = obj.begin();
+			started = true;
+			return false;
+		}
+		if constexpr(raw) {
+			size_t total = obj.size() * sizeof(V);
+			size_t n = std::min(total - sent, out.available());
+			out.writebuf((const uint8_t *)obj.data() + sent, n);
+			sent += n;
+			return sent == total;
+		} else {
+			if(it == obj.end())
+				return true;
+			pack_or_stream<V>(*it, out, stack, has_predecode_info<V>::value);
+			++it;
+			return false;
+		}
+	}
+
+	T& obj;
+	typename T::iterator it{};
+	size_t sent = 0;
+	bool started = false;
+};
+
+// Mirrors typeinfo<T>::pack for maps, one entry at a time
+template<typename T, typename Container>
+struct map_emitter : public emit_frame<Container>
+{
+	using K = typename T::key_type;
+	using V = typename T::mapped_type;
+
+	map_emitter(T& obj) : obj(obj) {}
+
+	bool resume(Container& out, emit_stack<Container>& stack) override
+	{
+		if(!started) {
+			out.write_sz(obj.size() + 1);
+			it = obj.begin();
+			started = true;
+			return false;
+		}
+		if(it == obj.end())
+			return true;
+		auto& [k, v] = *it++;
+		typeinfo<K>::pack(k, out);
+		pack_or_stream<V>(v, out, stack, false);
+		return false;
+	}
+
+	T& obj;
+	typename T::iterator it{};
+	bool started = false;
+};
+
+template<typename T, typename Container>
+std::unique_ptr<emit_frame<Container>> make_emitter(T& obj, bool predecoded)
+{
+	if constexpr(is_aggregate_struct<T>) {
+		return std::make_unique<struct_emitter<T, Container>>(obj, predecoded);
+	} else if constexpr(is_maplike<T>) {
+		return std::make_unique<map_emitter<T, Container>>(obj);
+	} else {
+		return std::make_unique<list_emitter<T, Container>>(obj);
+	}
+}
+
+} // namespace detail
+
+// Encodes a value in pieces, each pull continues where the last one stopped, eg to write only as much as a
+// non-blocking socket accepts. Structs, list-like containers, strings and maps are walked incrementally, other values
+// are written whole and any part that does not fit is held for the next pull. backwards_compatible structs are
+// measured up front since their offsets cannot be patched afterwards.
+// obj must not be modified or destroyed until the encoding is done.
+template<typename T, options o = options::none>
+class encoder
+{
+	static_assert(!(o & options::checksum), "checksums are only kept by pack and unpack");
+
+public:
+	explicit encoder(const T& obj) : out(wrap)
+	{
+		T& v = const_cast<T&>(obj);
+		if constexpr(detail::is_streamable<T, converter::variable_encoding>) {
+			stack.push_back(detail::make_emitter<T, converter>(v, false));
+		} else {
+			stack.push_back(std::make_unique<detail::whole_emitter<T, converter>>(v));
+		}
+	}
+
+	// Write the next bytes into buf and return how many, this is less than buf.size() only at the end
+	size_t pull(std::span<uint8_t> buf)
+	{
+		size_t n = wrap.drain(buf);
+		if(n == buf.size() || stack.empty())
+			return n;
+		wrap.begin(buf.subspan(n));
+		while(!stack.empty() && !wrap.spilled && wrap.p != wrap.e) {
+			if(stack.back()->resume(out, stack))
+				stack.pop_back();
+		}
+		n += wrap.end();
+		// A write that did not fit went to the spill as a whole, fill the rest of buf from there
+		return n + wrap.drain(buf.subspan(n));
+	}
+
+	bool done() const
+	{
+		return stack.empty() && wrap.held == 0;
+	}
+
+private:
+	using converter = detail::bytes_converter<o & options::variable_length_encoding>;
+
+	detail::pull_buffer wrap;
+	converter out;
+	detail::emit_stack<converter> stack;
+};
+
 } // namespace packall
 
 #endif
@@ -0,0 +1,328 @@
+#ifndef PACKALL_DIFF_H_
+#define PACKALL_DIFF_H_
+
+#include <algorithm>
+#include <optional>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+#include "packall.h"
+
+namespace packall {
+
+namespace detail {
+
+// Values that can be compared with == member by member. Anything else is compared by its encoding.
+template<typename T>
+struct value_equality : std::bool_constant<std::is_arithmetic_v<T> || std::is_enum_v<T>>
+{
+};
+template<typename C, typename Traits, typename Alloc>
+struct value_equality<std::basic_string<C, Traits, Alloc>> : std::true_type
+{
+};
+template<typename T, size_t N>
+struct value_equality<std::array<T, N>> : value_equality<T>
+{
+};
+template<typename T>
+struct value_equality<std::optional<T>> : value_equality<T>
+{
+};
+template<typename T, typename U>
+struct value_equality<std::pair<T, U>> : std::conjunction<value_equality<std::remove_const_t<T>>, value_equality<U>>
+{
+};
+template<typename... V>
+struct value_equality<std::tuple<V...>> : std::conjunction<value_equality<V>...>
+{
+};
+template<typename... V>
+struct value_equality<std::variant<V...>> : std::conjunction<value_equality<V>...>
+{
+};
+template<is_container T>
+    requires(!is_stringlike<T> && !is_custom_serialized<T>)
+struct value_equality<T> : value_equality<typename T::value_type>
+{
+};
+template<typename T>
+    requires(is_aggregate_struct<T> || is_custom_serialized<T>)
+struct value_equality<T> : std::bool_constant<std::equality_comparable<T>>
+{
+};
+
+template<typename T>
+bool same_value(const T& l, const T& r)
+{
+	if constexpr(std::is_floating_point_v<T>) {
+		return memcmp(&l, &r, sizeof(T)) == 0;
+	} else if constexpr(value_equality<T>::value) {
+		return l == r;
+	} else {
+		std::vector<uint8_t> lb, rb;
+		pack(l, lb);
+		pack(r, rb);
+		return lb == rb;
+	}
+}
+
+template<typename T>
+concept is_indexed_list = is_listlike<T> && !is_stringlike<T> &&
+                          !std::is_same_v<typename T::value_type, bool> && requires(T t, size_t i) { t[i]; };
+template<typename T>
+concept is_indexed = is_indexed_list<T> || is_array_type<T>::value || std::is_array_v<T>;
+template<typename T>
+concept is_keyed_map = is_maplike<T> && requires(T t, typename T::key_type k) { t.at(k); };
+
+// A patch mirrors typeinfo<T>, each node is only written if something below it changed. Everything without a more
+// specific patcher is replaced whole.
+template<typename T>
+struct patcher
+{
+	template<typename Container>
+	static bool diff(const T& old, const T& now, Container& out)
+	{
+		if(same_value(old, now))
+			return false;
+		typeinfo<T>::pack(const_cast<T&>(now), out);
+		return true;
+	}
+
+	template<typename Container>
+	static void apply(T& obj, Container& in)
+	{
+		T v{};
+		typeinfo<T>::unpack(v, in);
+		obj = std::move(v);
+	}
+};
+
+// Structs: (member index + 1, member patch)... 0
+template<is_aggregate_struct T>
+struct patcher<T>
+{
+	static constexpr size_t Arity = typeinfo<T>::Arity;
+
+	template<typename Container>
+	static bool diff(const T& old, const T& now, Container& out)
+	{
+		// Bind every member once rather than once per get
+		auto l = decompose<Arity>::apply(const_cast<T&>(old), tie_members{});
+		auto r = decompose<Arity>::apply(const_cast<T&>(now), tie_members{});
+		bool changed = false;
+		[&]<size_t... Index>(std::index_sequence<Index...>) {
+			((changed |= diff_member<Index>(pick_member<Index>(l), pick_member<Index>(r), out)), ...);
+		}(std::make_index_sequence<Arity>());
+		if(changed)
+			out.write_sz(0);
+		return changed;
+	}
+
+	template<size_t I, typename M, typename Container>
+	static bool diff_member(const M& old, const M& now, Container& out)
+	{
+		if constexpr(!emit_element<M>::value || is_deprecated<M>::value) {
+			return false;
+		} else {
+			size_t at = out.position();
+			out.write_sz(I + 1);
+			if(patcher<M>::diff(old, now, out))
+				return true;
+			rewind(out, at);
+			return false;
+		}
+	}
+
+	template<typename Container>
+	static void apply(T& obj, Container& in)
+	{
+		static constexpr auto members = make_members<Container>(std::make_index_sequence<Arity>());
+		for(size_t i = in.read_sz(); i != 0; i = in.read_sz()) {
+			if(i > Arity) [[unlikely]]
+				throw status::incompatible;
+			members[i - 1](obj, in);
+		}
+		maybe_postdecode(obj);
+	}
+
+	template<typename Container, size_t... Index>
+	static constexpr std::array<void (*)(T&, Container&), Arity> make_members(std::index_sequence<Index...>)
+	{
+		return {&apply_member<Index, Container>...};
+	}
+
+	template<size_t I, typename Container>
+	static void apply_member(T& obj, Container& in)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(!emit_element<M>::value || is_deprecated<M>::value)
+			throw status::incompatible;
+		else
+			patcher<M>::apply(decompose<Arity>::template get<I>(obj), in);
+	}
+};
+
+// Vectors, deques and arrays: [new size] (index + 1, element patch)... 0 [appended elements]
+template<is_indexed T>
+struct patcher<T>
+{
+	using V = std::remove_cvref_t<decltype(std::declval<T&>()[0])>;
+	static constexpr bool resizable = is_indexed_list<T>;
+
+	template<typename Container>
+	static bool diff(const T& old, const T& now, Container& out)
+	{
+		size_t at = out.position();
+		size_t common = std::min(std::size(old), std::size(now));
+		bool changed = std::size(old) != std::size(now);
+		if constexpr(resizable)
+			out.write_sz(std::size(now));
+		for(size_t i = 0; i < common; i++) {
+			size_t here = out.position();
+			out.write_sz(i + 1);
+			if(patcher<V>::diff(old[i], now[i], out))
+				changed = true;
+			else
+				rewind(out, here);
+		}
+		if(!changed) {
+			rewind(out, at);
+			return false;
+		}
+		out.write_sz(0);
+		for(size_t i = common; i < std::size(now); i++) typeinfo<V>::pack(const_cast<V&>(now[i]), out);
+		return true;
+	}
+
+	template<typename Container>
+	static void apply(T& obj, Container& in)
+	{
+		size_t old = std::size(obj), n = old;
+		if constexpr(resizable) {
+			n = in.read_sz();
+			if(n > kMaximumVectorSize) [[unlikely]]
+				throw status::out_of_memory;
+		}
+		size_t common = std::min(old, n);
+		for(size_t i = in.read_sz(); i != 0; i = in.read_sz()) {
+			if(i > common) [[unlikely]]
+				throw status::incompatible;
+			patcher<V>::apply(obj[i - 1], in);
+		}
+		if constexpr(resizable) {
+			obj.resize(n);
+			for(size_t i = old; i < n; i++) typeinfo<V>::unpack(obj[i], in);
+		}
+	}
+};
+
+// Maps: [removed count] [removed keys] (op, key, value or value patch)... 0
+template<is_keyed_map T>
+struct patcher<T>
+{
+	using K = typename T::key_type;
+	using V = typename T::mapped_type;
+	static constexpr uint8_t kInsert = 1;
+	static constexpr uint8_t kPatch = 2;
+
+	template<typename Container>
+	static bool diff(const T& old, const T& now, Container& out)
+	{
+		size_t at = out.position();
+		size_t removed = 0;
+		for(auto& [k, v] : old)
+			if(now.find(k) == now.end())
+				removed++;
+		out.write_sz(removed);
+		if(removed) {
+			for(auto& [k, v] : old)
+				if(now.find(k) == now.end())
+					typeinfo<K>::pack(const_cast<K&>(k), out);
+		}
+		bool changed = removed > 0;
+		for(auto& [k, v] : now) {
+			auto it = old.find(k);
+			size_t here = out.position();
+			out.write_u8(it == old.end() ? kInsert : kPatch);
+			typeinfo<K>::pack(const_cast<K&>(k), out);
+			if(it == old.end()) {
+				typeinfo<V>::pack(const_cast<V&>(v), out);
+				changed = true;
+			} else if(patcher<V>::diff(it->second, v, out)) {
+				changed = true;
+			} else {
+				rewind(out, here);
+			}
+		}
+		if(!changed) {
+			rewind(out, at);
+			return false;
+		}
+		out.write_u8(0);
+		return true;
+	}
+
+	template<typename Container>
+	static void apply(T& obj, Container& in)
+	{
+		for(size_t n = in.read_sz(); n > 0; n--) {
+			K k{};
+			typeinfo<K>::unpack(k, in);
+			obj.erase(k);
+		}
+		for(uint8_t op = in.read_u8(); op != 0; op = in.read_u8()) {
+			K k{};
+			typeinfo<K>::unpack(k, in);
+			if(op == kInsert) {
+				V v{};
+				typeinfo<V>::unpack(v, in);
+				obj.insert_or_assign(std::move(k), std::move(v));
+			} else if(op == kPatch) {
+				auto it = obj.find(k);
+				if(it == obj.end()) [[unlikely]]
+					throw status::incompatible;
+				patcher<V>::apply(it->second, in);
+			} else [[unlikely]] {
+				throw status::incompatible;
+			}
+		}
+	}
+};
+
+} // namespace detail
+
+// Writes a patch that turns old into now to patch, replacing its contents, and returns whether anything changed. An
+// unchanged value leaves the patch empty. Patches address struct members by index, containers by index and maps by
+// key, so they only apply to a copy of old.
+template<options o = options::none, typename T, typename Container>
+bool diff(const T& old, const T& now, Container& patch)
+{
+	static_assert(is_vectorlike_container<Container>, "patches are written to a vector-like container");
+	bytebuffer_impl<Container> wrap(patch, true);
+	detail::bytes_converter<o & options::variable_length_encoding> bc(wrap);
+	return detail::patcher<T>::diff(old, now, bc);
+}
+
+// Applies a patch from diff with the same options. On failure obj may be partly patched.
+template<options o = options::none, typename T, typename Container>
+[[nodiscard]] status apply(T& obj, Container& patch)
+{
+	if(patch.size() == 0)
+		return status::ok;
+	try {
+		bytebuffer_impl<Container> wrap(patch, false);
+		detail::bytes_converter<o & options::variable_length_encoding> bc(wrap);
+		detail::patcher<T>::apply(obj, bc);
+		if(!wrap.ok())
+			return status::data_underrun;
+		return status::ok;
+	} catch(status s) {
+		return s;
+	}
+}
+
+} // namespace packall
+
+#endif
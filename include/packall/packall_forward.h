@@ -16,6 +16,15 @@ enum class options : uint8_t
 {
 	none = 0,
 	variable_length_encoding = 1,
+	// Report every top-level pack/unpack to the installed instrumentation hook
+	instrument = 2,
+	// Additionally report every struct encoded or decoded below the top level
+	instrument_nested = 4,
+	// Decode a buffer known to be written by exactly this type, eg after comparing schemas, without checking each
+	// struct's member count or stopping at the end of input between members
+	trusted = 8,
+	// pack appends a CRC32C of the encoding and unpack checks it, see kChecksumSize
+	checksum = 16,
 };
 constexpr options operator|(options l, options r)
 {
@@ -26,6 +35,15 @@ constexpr bool operator&(options l, options r)
 	return !!(static_cast<uint8_t>(l) & static_cast<uint8_t>(r));
 }
 
+// Instrumentation may also be switched on for every call at build time
+#if defined(PACKALL_INSTRUMENT_NESTED)
+static constexpr options kDefaultInstrumentation = options::instrument | options::instrument_nested;
+#elif defined(PACKALL_INSTRUMENT)
+static constexpr options kDefaultInstrumentation = options::instrument;
+#else
+static constexpr options kDefaultInstrumentation = options::none;
+#endif
+
 enum class status
 {
 	ok,
@@ -45,6 +63,10 @@ enum class status
 	write_disallowed,
 	read_disallowed,
 	read_disjoint_into_span,
+	// The incremental decoder needs more bytes to finish the value.
+	need_more,
+	// The buffer doesn't match its options::checksum trailer.
+	checksum_mismatch,
 };
 
 enum class traits : uint8_t
@@ -52,6 +74,8 @@ enum class traits : uint8_t
 	none,
 	backwards_compatible = 1,
 	immutable = 2,
+	// Write a presence bitmap and then only the members that differ from a default constructed struct
+	sparse = 4,
 };
 constexpr traits operator|(traits l, traits r)
 {
@@ -0,0 +1,311 @@
+#ifndef PACKALL_INSTRUMENT_H_
+#define PACKALL_INSTRUMENT_H_
+
+#include <array>
+#include <bit>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <stdio.h>
+
+#include "packall.h"
+
+namespace packall {
+
+class size_profile;
+namespace detail {
+template<bool VariableEncoding>
+struct size_profiler;
+}
+
+// Aggregates instrumentation events per type and direction.
+// packall::instrument_collector stats;
+// packall::set_instrumentation(&stats);
+// ...
+// stats.dump(std::cerr);
+class instrument_collector : public instrumentation
+{
+public:
+	// Bucket i counts values v with std::bit_width(v) == i, ie [2^(i-1), 2^i)
+	struct histogram
+	{
+		std::array<uint64_t, 65> buckets{};
+
+		void add(uint64_t v)
+		{
+			buckets[std::bit_width(v)]++;
+		}
+		// Upper bound of the bucket holding the given fraction (0-1) of samples
+		uint64_t percentile(double p) const
+		{
+			uint64_t total = 0;
+			for(auto n : buckets)
+				total += n;
+			uint64_t want = (uint64_t)(p * total), seen = 0;
+			for(size_t i = 0; i < buckets.size(); i++) {
+				seen += buckets[i];
+				if(seen > want || seen == total)
+					return i == 0 ? 0 : i >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << i) - 1;
+			}
+			return 0;
+		}
+	};
+
+	struct entry
+	{
+		// Names come from get_type_name and are never freed
+		std::string_view type;
+		instrument_op op;
+		bool nested;
+		uint64_t count = 0;
+		uint64_t bytes = 0;
+		uint64_t cycles = 0;
+		histogram byte_hist;
+		histogram cycle_hist;
+	};
+
+	void record(const instrument_event& ev) override
+	{
+		std::lock_guard<std::mutex> l(lock);
+		auto& e = entries[{ev.type, ev.op, ev.nested}];
+		if(e.count == 0) {
+			e.type = ev.type;
+			e.op = ev.op;
+			e.nested = ev.nested;
+		}
+		e.count++;
+		e.bytes += ev.bytes;
+		e.cycles += ev.cycles;
+		e.byte_hist.add(ev.bytes);
+		e.cycle_hist.add(ev.cycles);
+	}
+
+	// Most expensive first
+	std::vector<entry> snapshot() const
+	{
+		std::vector<entry> ret;
+		{
+			std::lock_guard<std::mutex> l(lock);
+			for(auto& [k, v] : entries)
+				ret.push_back(v);
+		}
+		std::sort(ret.begin(), ret.end(), [](const entry& l, const entry& r) { return l.cycles > r.cycles; });
+		return ret;
+	}
+
+	void reset()
+	{
+		std::lock_guard<std::mutex> l(lock);
+		entries.clear();
+	}
+
+	// Writes a summary line and the non-empty cycle histogram buckets for each entry to an ostream-like
+	template<typename Stream>
+	void dump(Stream& os) const
+	{
+		char line[256];
+		for(auto& e : snapshot()) {
+			snprintf(line, sizeof(line),
+			    "%.*s %s%s: count=%llu bytes=%llu (p50<=%llu p99<=%llu) cycles=%llu (mean=%llu p50<=%llu p99<=%llu)\n",
+			    (int)e.type.size(), e.type.data(), e.op == instrument_op::pack ? "pack" : "unpack",
+			    e.nested ? " nested" : "", (unsigned long long)e.count, (unsigned long long)e.bytes,
+			    (unsigned long long)e.byte_hist.percentile(0.5), (unsigned long long)e.byte_hist.percentile(0.99),
+			    (unsigned long long)e.cycles, (unsigned long long)(e.cycles / e.count),
+			    (unsigned long long)e.cycle_hist.percentile(0.5), (unsigned long long)e.cycle_hist.percentile(0.99));
+			os << line;
+			for(size_t i = 0; i < e.cycle_hist.buckets.size(); i++) {
+				if(!e.cycle_hist.buckets[i])
+					continue;
+				snprintf(line, sizeof(line), "  cycles < 2^%zu: %llu\n", i,
+				    (unsigned long long)e.cycle_hist.buckets[i]);
+				os << line;
+			}
+		}
+	}
+
+private:
+	mutable std::mutex lock;
+	std::map<std::tuple<std::string_view, instrument_op, bool>, entry> entries;
+};
+
+// Encoded size broken down by field path, accumulated over any number of samples.
+// Paths start with the type name, struct members are appended as .name and [*] stands for the elements of a
+// container, optional or variant, eg Config.parameters[*].value
+class size_profile
+{
+public:
+	struct field
+	{
+		std::string path;
+		// Occurrences, a member inside a container is counted once per element
+		uint64_t count = 0;
+		// Total encoded bytes, including everything below this path
+		uint64_t bytes = 0;
+		// Overhead written directly at this path: struct/tuple headers, container lengths and variant indices,
+		// backwards_compatible offsets
+		uint64_t prefix_bytes = 0;
+		uint64_t length_bytes = 0;
+		uint64_t offset_bytes = 0;
+		// Encoded size of each occurrence, bucketed so memory stays fixed however many samples are added
+		instrument_collector::histogram sizes;
+		uint64_t max_size = 0;
+
+		// Upper bound of the size bucket holding the given fraction (0-1) of occurrences
+		uint64_t percentile(double p) const
+		{
+			return sizes.percentile(p);
+		}
+	};
+
+	template<options o = options::none, typename T>
+	void add(const T& obj);
+
+	uint64_t samples() const
+	{
+		return sample_count;
+	}
+	uint64_t total_bytes() const
+	{
+		return byte_count;
+	}
+
+	// Ordered by path so members follow their parents
+	std::vector<field> fields() const
+	{
+		std::vector<field> ret;
+		for(auto& [k, v] : paths)
+			ret.push_back(v);
+		return ret;
+	}
+
+	// Writes one line per path to an ostream-like
+	template<typename Stream>
+	void dump(Stream& os) const
+	{
+		char line[512];
+		for(auto& [k, f] : paths) {
+			snprintf(line, sizeof(line),
+			    "%s: count=%llu bytes=%llu (%.1f%%) p50<=%llu p90<=%llu p99<=%llu max=%llu prefix=%llu length=%llu "
+			    "offset=%llu\n",
+			    f.path.c_str(), (unsigned long long)f.count, (unsigned long long)f.bytes,
+			    byte_count ? 100.0 * f.bytes / byte_count : 0.0, (unsigned long long)f.percentile(0.5),
+			    (unsigned long long)f.percentile(0.9), (unsigned long long)f.percentile(0.99),
+			    (unsigned long long)f.max_size, (unsigned long long)f.prefix_bytes,
+			    (unsigned long long)f.length_bytes, (unsigned long long)f.offset_bytes);
+			os << line;
+		}
+	}
+
+private:
+	template<bool VariableEncoding>
+	friend struct detail::size_profiler;
+
+	uint64_t sample_count = 0;
+	uint64_t byte_count = 0;
+	std::map<std::string, field, std::less<>> paths;
+};
+
+namespace detail {
+
+// The real encoder, with each struct member and each header attributed to the current field path
+template<bool VariableEncoding>
+struct size_profiler : public bytes_converter<VariableEncoding>
+{
+	using base = bytes_converter<VariableEncoding>;
+	static constexpr bool track_members = true;
+
+	struct frame
+	{
+		size_profile::field *f;
+		size_t start;
+		bool is_struct;
+	};
+
+	size_profiler(bytebuffer& wrap, size_profile& profile) : base(wrap), profile(profile) {}
+
+	template<typename M>
+	size_t enter_member(std::string_view name)
+	{
+		auto& parent = *stack.back().f;
+		std::string path = parent.path;
+		if(!stack.back().is_struct)
+			path += "[*]";
+		path += '.';
+		path += name;
+		enter(path, is_aggregate_struct<M>);
+		return stack.size() - 1;
+	}
+	void leave_member(size_t token)
+	{
+		auto& top = stack[token];
+		size_t n = this->position() - top.start;
+		top.f->count++;
+		top.f->bytes += n;
+		top.f->sizes.add(n);
+		top.f->max_size = std::max<uint64_t>(top.f->max_size, n);
+		stack.pop_back();
+	}
+
+	void enter(std::string_view path, bool is_struct)
+	{
+		auto it = profile.paths.find(path);
+		if(it == profile.paths.end()) {
+			it = profile.paths.emplace(std::string(path), size_profile::field{}).first;
+			it->second.path = path;
+		}
+		stack.push_back({&it->second, this->position(), is_struct});
+	}
+
+	void write_sz(size_t v)
+	{
+		size_t at = this->position();
+		base::write_sz(v);
+		stack.back().f->length_bytes += this->position() - at;
+	}
+	void write_prefix(size_t v)
+	{
+		size_t at = this->position();
+		base::write_sz(v);
+		stack.back().f->prefix_bytes += this->position() - at;
+	}
+	size_t push()
+	{
+		size_t at = this->position();
+		size_t ret = base::push();
+		stack.back().f->offset_bytes += this->position() - at;
+		return ret;
+	}
+
+	size_profile& profile;
+	std::vector<frame> stack;
+};
+
+} // namespace detail
+
+template<options o, typename T>
+void size_profile::add(const T& obj)
+{
+	detail::counting_buffer wrap;
+	detail::size_profiler<o & options::variable_length_encoding> bc(wrap, *this);
+	bc.enter(get_type_name<T>(), detail::is_aggregate_struct<T>);
+	detail::typeinfo<T>::pack(const_cast<T&>(obj), bc);
+	bc.leave_member(0);
+	sample_count++;
+	byte_count += bc.position();
+}
+
+// Encoded size breakdown of a single value, call size_profile::add directly to accumulate many
+template<options o = options::none, typename T>
+size_profile size_report(const T& obj)
+{
+	size_profile ret;
+	ret.add<o>(obj);
+	return ret;
+}
+
+} // namespace packall
+
+#endif
@@ -0,0 +1,1050 @@
+#ifndef PACKALL_SCHEMA_H_
+#define PACKALL_SCHEMA_H_
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+#include "packall.h"
+
+namespace packall {
+
+// A runtime description of a type, walked the same way as get_type_id so tools can handle buffers without the C++
+// types. nodes[0] is the described type, each struct and user type has a single node that others refer to by index.
+struct schema
+{
+	struct member
+	{
+		std::string name;
+		uint32_t node;
+		// Encoded as a single zero byte, see deprecated<T>
+		bool deprecated = false;
+	};
+
+	struct node
+	{
+		detail::type_id kind;
+		// Structs only
+		traits flags = traits::none;
+		// Array length
+		size_t count = 0;
+		// Structs and user types
+		std::string name;
+		// Element, key and value, or alternative types in order
+		std::vector<uint32_t> children;
+		// Struct members in declaration order, omitted members are left out
+		std::vector<member> members;
+	};
+
+	std::vector<node> nodes;
+
+	// The hash get_type_id gives for the described type
+	uint32_t type_id() const;
+	// C++-like spelling of a node, e.g. map<string, list<point>>
+	std::string type_name(uint32_t i = 0) const;
+	// The root type on the first line, then every struct with its members
+	std::string to_string() const;
+
+	// A compact encoding to send ahead of a stream, see schema_reader
+	template<typename Container>
+	void to_blob(Container& out) const;
+	// Reads a schema written by to_blob, leaving it empty on failure
+	template<typename Container>
+	[[nodiscard]] status from_blob(Container& in);
+};
+
+namespace detail {
+
+inline uint32_t add_node(schema& s, type_id kind)
+{
+	schema::node n;
+	n.kind = kind;
+	s.nodes.push_back(std::move(n));
+	return static_cast<uint32_t>(s.nodes.size() - 1);
+}
+
+template<typename... T>
+uint32_t add_node_of(schema& s, type_id kind);
+
+// Mirrors typeinfo<T>, add returns the node describing T
+template<typename T>
+struct describe
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node(s, static_cast<type_id>(typeinfo<T>::type_id));
+	}
+};
+
+template<typename T>
+    requires(std::is_enum_v<T>)
+struct describe<T>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<std::underlying_type_t<T>>(s, type_id::enum_class);
+	}
+};
+
+template<typename T, typename Traits, typename Alloc>
+struct describe<std::basic_string<T, Traits, Alloc>>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<T>(s, type_id::string);
+	}
+};
+
+template<is_spanlike T>
+struct describe<T>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<std::remove_cv_t<typename T::value_type>>(s, type_id::string);
+	}
+};
+
+template<is_listlike T>
+struct describe<T>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<typename T::value_type>(s, type_id::listlike);
+	}
+};
+
+template<is_setlike T>
+struct describe<T>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<typename T::key_type>(s, type_id::setlike);
+	}
+};
+
+template<is_maplike T>
+struct describe<T>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<typename T::key_type, typename T::mapped_type>(s, type_id::maplike);
+	}
+};
+
+template<typename T>
+    requires(std::is_aggregate_v<T> && (is_array_type<T>::value || std::is_array_v<T>))
+struct describe<T>
+{
+	static uint32_t add(schema& s)
+	{
+		using E = std::remove_cvref_t<decltype(std::declval<T&>()[0])>;
+		uint32_t i = add_node_of<E>(s, type_id::array);
+		s.nodes[i].count = sizeof(T) / sizeof(E);
+		return i;
+	}
+};
+
+template<typename T>
+struct describe<std::optional<T>>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<T>(s, type_id::optional);
+	}
+};
+
+template<typename T, typename D>
+struct describe<std::unique_ptr<T, D>>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<T>(s, type_id::unique_ptr);
+	}
+};
+
+template<typename T, typename U>
+struct describe<std::pair<T, U>>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<std::remove_const_t<T>, U>(s, type_id::pair);
+	}
+};
+
+template<typename... V>
+struct describe<std::tuple<V...>>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<V...>(s, type_id::tuple);
+	}
+};
+
+template<typename... V>
+struct describe<std::variant<V...>>
+{
+	static uint32_t add(schema& s)
+	{
+		return add_node_of<V...>(s, type_id::variant);
+	}
+};
+
+template<typename T>
+struct describe<deprecated<T>> : describe<T>
+{
+};
+
+// Structs and user types are described once, by name like type_list does
+inline std::optional<uint32_t> find_named(const schema& s, type_id kind, std::string_view name)
+{
+	for(uint32_t i = 0; i < s.nodes.size(); i++)
+		if(s.nodes[i].kind == kind && s.nodes[i].name == name)
+			return i;
+	return std::nullopt;
+}
+
+template<is_custom_serialized T>
+struct describe<T>
+{
+	static uint32_t add(schema& s)
+	{
+		std::string_view name = get_t_name<std::remove_cv_t<T>>();
+		if(auto i = find_named(s, type_id::user_type, name))
+			return *i;
+		uint32_t i = add_node(s, type_id::user_type);
+		s.nodes[i].name = name;
+		return i;
+	}
+};
+
+template<is_aggregate_struct T>
+struct describe<T>
+{
+	static constexpr size_t Arity = typeinfo<T>::Arity;
+
+	static uint32_t add(schema& s)
+	{
+		std::string_view name = get_t_name<std::remove_cv_t<T>>();
+		if(auto i = find_named(s, type_id::struct_, name))
+			return *i;
+		uint32_t i = add_node(s, type_id::struct_);
+		s.nodes[i].name = name;
+		s.nodes[i].flags = struct_traits<T>::Traits;
+		[&]<size_t... Index>(std::index_sequence<Index...>) {
+			(add_member<Index>(s, i), ...);
+		}(std::make_index_sequence<Arity>());
+		return i;
+	}
+
+	template<size_t I>
+	static void add_member(schema& s, uint32_t i)
+	{
+		using M = std::remove_cvref_t<decltype(decompose<Arity>::template get<I>(std::declval<T>()))>;
+		if constexpr(emit_element<M>::value) {
+			uint32_t node = describe<M>::add(s);
+			s.nodes[i].members.push_back({std::string(get_member_name<T, I>()), node, is_deprecated<M>::value});
+		}
+	}
+};
+
+template<typename... T>
+uint32_t add_node_of(schema& s, type_id kind)
+{
+	uint32_t i = add_node(s, kind);
+	// Children may grow nodes, so only index it once each child is added
+	([&] {
+		uint32_t child = describe<T>::add(s);
+		s.nodes[i].children.push_back(child);
+	}(), ...);
+	return i;
+}
+
+// Rebuilds the stream typeinfo<T>::get_types writes
+inline void schema_types(const schema& s, uint32_t i, std::vector<uint8_t>& out, std::vector<std::string_view>& seen)
+{
+	const schema::node& n = s.nodes[i];
+	switch(n.kind) {
+	case type_id::struct_:
+	case type_id::user_type: {
+		out.push_back(static_cast<uint8_t>(type_id::struct_));
+		auto it = std::find(seen.begin(), seen.end(), n.name);
+		out.push_back(static_cast<uint8_t>(it - seen.begin()));
+		if(it == seen.end()) {
+			seen.push_back(n.name);
+			for(auto& m : n.members) schema_types(s, m.node, out, seen);
+		}
+		return;
+	}
+	case type_id::enum_class:
+		out.push_back(static_cast<uint8_t>(n.kind));
+		return;
+	case type_id::array:
+		out.push_back(static_cast<uint8_t>(n.kind));
+		for(size_t v = n.count; v > 0; v >>= 8) out.push_back(static_cast<uint8_t>(v));
+		break;
+	default:
+		out.push_back(static_cast<uint8_t>(n.kind));
+		break;
+	}
+	for(uint32_t c : n.children) schema_types(s, c, out, seen);
+}
+
+// Every index in range and every kind with the children it needs, so that a schema from a peer is safe to walk
+inline bool valid_schema(const schema& s)
+{
+	if(s.nodes.empty())
+		return false;
+	for(auto& n : s.nodes) {
+		size_t children = 0;
+		switch(n.kind) {
+		case type_id::enum_class:
+		case type_id::string:
+		case type_id::array:
+		case type_id::listlike:
+		case type_id::setlike:
+		case type_id::optional:
+		case type_id::unique_ptr:
+			children = 1;
+			break;
+		case type_id::maplike:
+		case type_id::pair:
+			children = 2;
+			break;
+		case type_id::tuple:
+		case type_id::variant:
+			children = n.children.size();
+			break;
+		default:
+			if(n.kind > type_id::user_type)
+				return false;
+			break;
+		}
+		if(n.children.size() != children || (!n.members.empty() && n.kind != type_id::struct_))
+			return false;
+		for(uint32_t c : n.children)
+			if(c >= s.nodes.size())
+				return false;
+		for(auto& m : n.members)
+			if(m.node >= s.nodes.size())
+				return false;
+	}
+	return true;
+}
+
+} // namespace detail
+
+inline uint32_t schema::type_id() const
+{
+	std::vector<uint8_t> types;
+	std::vector<std::string_view> seen;
+	detail::schema_types(*this, 0, types, seen);
+	return detail::ct_crc32(types.data(), types.size());
+}
+
+inline std::string schema::type_name(uint32_t i) const
+{
+	static constexpr std::string_view kScalars[] = {
+	    "uint8", "uint16", "bool", "uint32", "char", "int8", "int16", "uint64", "int32", "float", "double", "", "int64"};
+	const node& n = nodes[i];
+	auto args = [&](std::string_view tmpl) {
+		std::string r(tmpl);
+		r.push_back('<');
+		for(size_t c = 0; c < n.children.size(); c++) {
+			if(c)
+				r.append(", ");
+			r.append(type_name(n.children[c]));
+		}
+		if(n.kind == detail::type_id::array)
+			r.append(", ").append(std::to_string(n.count));
+		r.push_back('>');
+		return r;
+	};
+	switch(n.kind) {
+	case detail::type_id::enum_class:
+		return args("enum");
+	case detail::type_id::string:
+		return "string";
+	case detail::type_id::array:
+		return args("array");
+	case detail::type_id::listlike:
+		return args("list");
+	case detail::type_id::maplike:
+		return args("map");
+	case detail::type_id::setlike:
+		return args("set");
+	case detail::type_id::optional:
+		return args("optional");
+	case detail::type_id::pair:
+		return args("pair");
+	case detail::type_id::tuple:
+		return args("tuple");
+	case detail::type_id::variant:
+		return args("variant");
+	case detail::type_id::unique_ptr:
+		return args("unique_ptr");
+	case detail::type_id::struct_:
+	case detail::type_id::user_type:
+		return std::string(n.name);
+	default:
+		return std::string(kScalars[static_cast<uint8_t>(n.kind)]);
+	}
+}
+
+inline std::string schema::to_string() const
+{
+	std::string r = type_name(0);
+	r.push_back('\n');
+	for(auto& n : nodes) {
+		if(n.kind != detail::type_id::struct_)
+			continue;
+		r.append("struct ").append(n.name);
+		if(n.flags & traits::backwards_compatible)
+			r.append(" backwards_compatible");
+		if(n.flags & traits::immutable)
+			r.append(" immutable");
+		if(n.flags & traits::sparse)
+			r.append(" sparse");
+		r.append(" {\n");
+		for(auto& m : n.members) {
+			r.push_back('\t');
+			if(m.deprecated)
+				r.append("deprecated<").append(type_name(m.node)).append(">");
+			else
+				r.append(type_name(m.node));
+			r.push_back(' ');
+			r.append(m.name).append(";\n");
+		}
+		r.append("};\n");
+	}
+	return r;
+}
+
+// Describes T at runtime
+template<typename T>
+schema get_schema()
+{
+	schema s;
+	detail::describe<T>::add(s);
+	return s;
+}
+
+template<typename Container>
+void schema::to_blob(Container& out) const
+{
+	pack<options::variable_length_encoding>(*this, out);
+}
+
+template<typename Container>
+status schema::from_blob(Container& in)
+{
+	nodes.clear();
+	status r = unpack<options::variable_length_encoding>(*this, in);
+	if(r == status::ok && !detail::valid_schema(*this))
+		r = status::incompatible;
+	if(r != status::ok)
+		nodes.clear();
+	return r;
+}
+
+// get_schema<T>() as a blob, built once
+template<typename T>
+const std::vector<uint8_t>& get_schema_blob()
+{
+	static const std::vector<uint8_t> blob = [] {
+		std::vector<uint8_t> b;
+		get_schema<T>().to_blob(b);
+		return b;
+	}();
+	return blob;
+}
+
+namespace detail {
+
+// How each node of a peer's schema is decoded into the local type
+struct remap_link
+{
+	static constexpr uint32_t kNone = ~0u;
+	// The local node this peer node is decoded into
+	uint32_t local = kNone;
+	// Encoded exactly as the local node, decoded directly by typeinfo
+	bool same = false;
+	// Structs: the local member for each peer member, kNone to skip its value
+	std::vector<uint32_t> members;
+};
+
+struct remap_plan
+{
+	schema peer;
+	// One per peer node
+	std::vector<remap_link> links;
+};
+
+using node_pairs = std::vector<std::pair<uint32_t, uint32_t>>;
+
+// Whether peer node pi encodes exactly as local node li. Struct names may differ, member names may not.
+inline bool same_layout(const schema& peer, uint32_t pi, const schema& local, uint32_t li, node_pairs& assumed)
+{
+	const schema::node& a = peer.nodes[pi];
+	const schema::node& b = local.nodes[li];
+	if(a.kind != b.kind || a.flags != b.flags || a.count != b.count || a.children.size() != b.children.size() ||
+	    a.members.size() != b.members.size())
+		return false;
+	if(a.kind == type_id::user_type)
+		return a.name == b.name;
+	if(a.kind == type_id::struct_) {
+		// Recursive structs are taken to match while they are being compared
+		if(std::find(assumed.begin(), assumed.end(), std::make_pair(pi, li)) != assumed.end())
+			return true;
+		assumed.emplace_back(pi, li);
+	}
+	for(size_t i = 0; i < a.children.size(); i++)
+		if(!same_layout(peer, a.children[i], local, b.children[i], assumed))
+			return false;
+	for(size_t i = 0; i < a.members.size(); i++) {
+		const schema::member& m = a.members[i];
+		const schema::member& n = b.members[i];
+		if(m.name != n.name || m.deprecated != n.deprecated || !same_layout(peer, m.node, local, n.node, assumed))
+			return false;
+	}
+	return true;
+}
+
+// Whether a value of peer node i can be skipped knowing only its schema
+inline bool skippable(const schema& peer, uint32_t i, std::vector<uint32_t>& seen)
+{
+	const schema::node& n = peer.nodes[i];
+	if(n.kind == type_id::user_type)
+		return false;
+	if(std::find(seen.begin(), seen.end(), i) != seen.end())
+		return true;
+	seen.push_back(i);
+	for(uint32_t c : n.children)
+		if(!skippable(peer, c, seen))
+			return false;
+	for(auto& m : n.members)
+		if(!skippable(peer, m.node, seen))
+			return false;
+	return true;
+}
+
+// Structs are matched member by member, lists, optionals, pointers and map values by their element. Anything else
+// has to encode exactly as the local type.
+inline bool link_nodes(remap_plan& plan, const schema& local, uint32_t pi, uint32_t li)
+{
+	if(plan.links[pi].local != remap_link::kNone)
+		return plan.links[pi].local == li;
+	plan.links[pi].local = li;
+	node_pairs assumed;
+	if(same_layout(plan.peer, pi, local, li, assumed)) {
+		plan.links[pi].same = true;
+		return true;
+	}
+	const schema::node& a = plan.peer.nodes[pi];
+	const schema::node& b = local.nodes[li];
+	if(a.kind != b.kind)
+		return false;
+	switch(a.kind) {
+	case type_id::struct_:
+		for(auto& m : a.members) {
+			uint32_t slot = remap_link::kNone;
+			for(uint32_t j = 0; j < b.members.size() && !m.deprecated; j++) {
+				if(!b.members[j].deprecated && b.members[j].name == m.name) {
+					slot = j;
+					break;
+				}
+			}
+			plan.links[pi].members.push_back(slot);
+			std::vector<uint32_t> seen;
+			if(slot == remap_link::kNone ? !skippable(plan.peer, m.node, seen)
+			                             : !link_nodes(plan, local, m.node, b.members[slot].node))
+				return false;
+		}
+		return true;
+	case type_id::listlike:
+	case type_id::optional:
+	case type_id::unique_ptr:
+		return link_nodes(plan, local, a.children[0], b.children[0]);
+	case type_id::maplike:
+		assumed.clear();
+		return same_layout(plan.peer, a.children[0], local, b.children[0], assumed) &&
+		       link_nodes(plan, local, a.children[1], b.children[1]);
+	default:
+		return false;
+	}
+}
+
+// The prefix typeinfo<T>::pack writes for a struct, immutable structs leave it out
+inline size_t struct_prefix(const schema::node& n)
+{
+	return n.members.size() * 4 + ((n.flags & traits::sparse) ? 0 : 2) +
+	       ((n.flags & traits::backwards_compatible) ? 1 : 0);
+}
+
+// Lists hoist the prefix of structs and tuples out in front of their elements
+inline bool hoists_prefix(const schema::node& n)
+{
+	return (n.kind == type_id::struct_ && !(n.flags & traits::immutable)) || n.kind == type_id::tuple;
+}
+
+inline bool is_container_kind(const schema::node& n)
+{
+	return n.kind == type_id::string || n.kind == type_id::listlike || n.kind == type_id::setlike ||
+	       n.kind == type_id::maplike;
+}
+
+static constexpr uint32_t kMaxSkipDepth = 256;
+
+template<typename Container>
+void skip_bytes(Container& in, size_t n)
+{
+	uint8_t scratch[256];
+	while(n > 0) {
+		size_t k = std::min(n, sizeof(scratch));
+		in.readbuf(scratch, k);
+		n -= k;
+	}
+}
+
+template<typename V, typename Container>
+void skip_scalar(Container& in)
+{
+	V v;
+	in.read(v);
+}
+
+template<typename Container>
+void skip_value(const schema& s, uint32_t i, Container& in, uint32_t depth);
+
+// n is the struct's prefix, read or predecoded
+template<typename Container>
+void skip_struct(const schema& s, uint32_t i, Container& in, size_t n, uint32_t depth)
+{
+	if(n == 0)
+		return;
+	const schema::node& node = s.nodes[i];
+	bool bc = n & 1;
+	bool sparse = !(n & 2);
+	n >>= 2;
+	if(bc) {
+		in.leave(in.enter());
+		return;
+	}
+	if(n > node.members.size()) [[unlikely]]
+		throw status::incompatible;
+	presence_bitmap present;
+	if(sparse)
+		in.readbuf(present.bits, (n + 7) / 8);
+	for(size_t m = 0; m < n; m++) {
+		if(sparse && !present.test(m))
+			continue;
+		if(in.done())
+			return;
+		if(node.members[m].deprecated && !in.peek_u8())
+			in.read_u8();
+		else
+			skip_value(s, node.members[m].node, in, depth + 1);
+	}
+}
+
+// n is the tuple's prefix, read or predecoded
+template<typename Container>
+void skip_tuple(const schema& s, uint32_t i, Container& in, size_t n, uint32_t depth)
+{
+	if(n == 0)
+		return;
+	n--;
+	if(n > s.nodes[i].children.size()) [[unlikely]]
+		throw status::incompatible;
+	for(size_t c = 0; c < n; c++) skip_value(s, s.nodes[i].children[c], in, depth + 1);
+}
+
+template<typename Container>
+void skip_elements(const schema& s, uint32_t e, Container& in, size_t n, size_t pd, uint32_t depth)
+{
+	for(size_t k = 0; k < n; k++) {
+		if(!hoists_prefix(s.nodes[e]))
+			skip_value(s, e, in, depth + 1);
+		else if(s.nodes[e].kind == type_id::struct_)
+			skip_struct(s, e, in, pd, depth + 1);
+		else
+			skip_tuple(s, e, in, pd, depth + 1);
+	}
+}
+
+// Reads past a value the local type has no place for, following typeinfo<T>::pack for the peer's type
+template<typename Container>
+void skip_value(const schema& s, uint32_t i, Container& in, uint32_t depth)
+{
+	if(depth > kMaxSkipDepth) [[unlikely]]
+		throw status::stack_overflow;
+	const schema::node& n = s.nodes[i];
+	switch(n.kind) {
+	case type_id::uint8:
+	case type_id::bool_:
+	case type_id::char_:
+	case type_id::int8:
+		in.read_u8();
+		return;
+	case type_id::uint16:
+	case type_id::int16:
+		return skip_scalar<uint16_t>(in);
+	case type_id::uint32:
+	case type_id::int32:
+		return skip_scalar<uint32_t>(in);
+	case type_id::uint64:
+	case type_id::int64:
+		return skip_scalar<uint64_t>(in);
+	case type_id::float32:
+		return skip_scalar<float>(in);
+	case type_id::float64:
+		return skip_scalar<double>(in);
+	case type_id::enum_class:
+		return skip_value(s, n.children[0], in, depth + 1);
+	case type_id::string: {
+		static constexpr uint8_t kWidth[] = {1, 2, 1, 4, 1, 1, 2, 8, 4, 4, 8, 0, 8};
+		uint8_t e = static_cast<uint8_t>(s.nodes[n.children[0]].kind);
+		size_t sz = in.read_sz();
+		if(sz <= 1)
+			return;
+		if(e >= sizeof(kWidth) || !kWidth[e] || sz - 1 > kMaximumVectorSize) [[unlikely]]
+			throw status::incompatible;
+		return skip_bytes(in, (sz - 1) * kWidth[e]);
+	}
+	case type_id::array: {
+		size_t sz = in.read_sz();
+		for(size_t k = 1; k < sz; k++) skip_value(s, n.children[0], in, depth + 1);
+		return;
+	}
+	case type_id::listlike: {
+		size_t sz = in.read_sz();
+		if(sz == 0)
+			return;
+		size_t pd = hoists_prefix(s.nodes[n.children[0]]) ? in.read_sz() : 0;
+		return skip_elements(s, n.children[0], in, sz - 1, pd, depth);
+	}
+	case type_id::setlike: {
+		size_t sz = in.read_sz();
+		if(sz == 0)
+			return;
+		uint64_t pd = 0;
+		if(hoists_prefix(s.nodes[n.children[0]]))
+			in.read(pd);
+		return skip_elements(s, n.children[0], in, sz - 1, pd, depth);
+	}
+	case type_id::maplike: {
+		size_t sz = in.read_sz();
+		for(size_t k = 1; k < sz; k++) {
+			skip_value(s, n.children[0], in, depth + 1);
+			skip_value(s, n.children[1], in, depth + 1);
+		}
+		return;
+	}
+	case type_id::optional:
+		// Containers stand in for their own flag
+		if(is_container_kind(s.nodes[n.children[0]]) ? in.peek_u8() != 0 : in.read_u8() != 0)
+			return skip_value(s, n.children[0], in, depth + 1);
+		if(is_container_kind(s.nodes[n.children[0]]))
+			in.read_u8();
+		return;
+	case type_id::unique_ptr:
+		if(in.peek_u8())
+			return skip_value(s, n.children[0], in, depth + 1);
+		in.read_u8();
+		return;
+	case type_id::pair:
+		skip_value(s, n.children[0], in, depth + 1);
+		return skip_value(s, n.children[1], in, depth + 1);
+	case type_id::tuple:
+		return skip_tuple(s, i, in, in.read_sz(), depth);
+	case type_id::variant: {
+		size_t v = in.read_sz();
+		if(v == 0)
+			return;
+		if(v > n.children.size()) [[unlikely]]
+			throw status::incompatible;
+		return skip_value(s, n.children[v - 1], in, depth + 1);
+	}
+	case type_id::struct_:
+		return skip_struct(s, i, in, (n.flags & traits::immutable) ? struct_prefix(n) : in.read_sz(), depth);
+	default:
+		throw status::incompatible;
+	}
+}
+
+// Decodes T from the peer's encoding of node peer. Only the kinds link_nodes matches member by member get a
+// specialization, everything else is linked only when it is the same.
+template<typename T>
+struct remapper
+{
+	template<typename Container>
+	static void unpack(T& obj, Container& in, const remap_plan& plan, uint32_t peer)
+	{
+		throw status::incompatible;
+	}
+};
+
+template<typename T, typename Container>
+void remap(T& obj, Container& in, const remap_plan& plan, uint32_t peer)
+{
+	if(plan.links[peer].same)
+		typeinfo<T>::unpack(obj, in);
+	else
+		remapper<T>::unpack(obj, in, plan, peer);
+}
+
+template<is_aggregate_struct T>
+    requires(!is_deprecated<T>::value)
+struct remapper<T>
+{
+	using info = typeinfo<T>;
+	static constexpr size_t Arity = info::Arity;
+	template<typename Container>
+	using member_fn = void (*)(T&, Container&, const remap_plan&, uint32_t);
+
+	template<typename Container>
+	static void unpack(T& obj, Container& in, const remap_plan& plan, uint32_t peer)
+	{
+		const schema::node& n = plan.peer.nodes[peer];
+		unpack_predecoded(obj, in, plan, peer, (n.flags & traits::immutable) ? struct_prefix(n) : in.read_sz());
+	}
+
+	// Follows typeinfo<T>::unpack_helper over the peer's members
+	template<typename Container>
+	static void unpack_predecoded(T& obj, Container& in, const remap_plan& plan, uint32_t peer, size_t n)
+	{
+		static constexpr auto members = make_members<Container>(std::make_index_sequence<Arity>());
+		static constexpr auto resets = make_resets(std::make_index_sequence<Arity>());
+		if(n == 0)
+			return;
+		const schema::node& node = plan.peer.nodes[peer];
+		const remap_link& link = plan.links[peer];
+		bool bc = n & 1;
+		bool sparse = !(n & 2);
+		n >>= 2;
+
+		size_t at = 0;
+		if(bc)
+			at = in.enter();
+		else if(n > node.members.size()) [[unlikely]]
+			throw status::incompatible;
+		presence_bitmap present;
+		if(sparse) {
+			if(n > presence_bitmap::kMaxBits) [[unlikely]]
+				throw status::incompatible;
+			in.readbuf(present.bits, (n + 7) / 8);
+		}
+		n = std::min(n, node.members.size());
+		for(size_t i = 0; i < n; i++) {
+			uint32_t slot = link.members[i];
+			if(sparse && !present.test(i)) {
+				if(slot != remap_link::kNone)
+					resets[slot](obj);
+				continue;
+			}
+			if(in.done())
+				break;
+			if(slot != remap_link::kNone)
+				members[slot](obj, in, plan, node.members[i].node);
+			else if(node.members[i].deprecated && !in.peek_u8())
+				in.read_u8();
+			else
+				skip_value(plan.peer, node.members[i].node, in, 0);
+		}
+		if(bc)
+			in.leave(at);
+		maybe_postdecode(obj);
+	}
+
+	template<size_t I>
+	using member_t = std::remove_cvref_t<decltype(decompose<info::Arity>::template get<I>(std::declval<T>()))>;
+
+	// Indexed by position among the encoded members, the same as the local schema's members
+	template<typename Container, size_t... Index>
+	static constexpr std::array<member_fn<Container>, info::emitted> make_members(std::index_sequence<Index...>)
+	{
+		std::array<member_fn<Container>, info::emitted> r{};
+		([&] {
+			if constexpr(emit_element<member_t<Index>>::value)
+				r[info::template slot<Index>] = &remap_member<Index, Container>;
+		}(), ...);
+		return r;
+	}
+
+	template<size_t... Index>
+	static constexpr std::array<void (*)(T&), info::emitted> make_resets(std::index_sequence<Index...>)
+	{
+		std::array<void (*)(T&), info::emitted> r{};
+		([&] {
+			if constexpr(emit_element<member_t<Index>>::value)
+				r[info::template slot<Index>] = &info::template reset_absent<Index>;
+		}(), ...);
+		return r;
+	}
+
+	template<size_t I, typename Container>
+	static void remap_member(T& obj, Container& in, const remap_plan& plan, uint32_t peer)
+	{
+		remap(decompose<Arity>::template get<I>(obj), in, plan, peer);
+	}
+};
+
+template<is_listlike T>
+    requires(!is_stringlike<T> && !std::is_same_v<typename T::value_type, bool>)
+struct remapper<T>
+{
+	using V = typename T::value_type;
+
+	template<typename Container>
+	static void unpack(T& obj, Container& in, const remap_plan& plan, uint32_t peer)
+	{
+		size_t sz = in.read_sz();
+		if(sz == 0)
+			return;
+		sz--;
+		if(sz > kMaximumVectorSize) [[unlikely]]
+			throw status::out_of_memory;
+		obj.resize(sz);
+		uint32_t e = plan.peer.nodes[peer].children[0];
+		if constexpr(is_aggregate_struct<V>) {
+			if(hoists_prefix(plan.peer.nodes[e])) {
+				size_t pd = in.read_sz();
+				for(auto& v : obj) remapper<V>::unpack_predecoded(v, in, plan, e, pd);
+				return;
+			}
+		}
+		for(auto& v : obj) remap(v, in, plan, e);
+	}
+};
+
+template<typename V>
+struct remapper<std::optional<V>>
+{
+	template<typename Container>
+	static void unpack(std::optional<V>& obj, Container& in, const remap_plan& plan, uint32_t peer)
+	{
+		// Containers stand in for their own flag
+		if constexpr(is_container<V>) {
+			if(!in.peek_u8()) {
+				in.read_u8();
+				return;
+			}
+		} else if(!in.read_u8()) {
+			return;
+		}
+		obj.emplace();
+		remap(*obj, in, plan, plan.peer.nodes[peer].children[0]);
+	}
+};
+
+template<typename V, typename D>
+    requires(is_container<V> || is_aggregate_struct<V>)
+struct remapper<std::unique_ptr<V, D>>
+{
+	template<typename Container>
+	static void unpack(std::unique_ptr<V, D>& obj, Container& in, const remap_plan& plan, uint32_t peer)
+	{
+		if(!in.peek_u8()) {
+			in.read_u8();
+			return;
+		}
+		obj = std::make_unique<V>();
+		remap(*obj, in, plan, plan.peer.nodes[peer].children[0]);
+	}
+};
+
+template<is_maplike T>
+struct remapper<T>
+{
+	using K = typename T::key_type;
+	using V = typename T::mapped_type;
+
+	template<typename Container>
+	static void unpack(T& obj, Container& in, const remap_plan& plan, uint32_t peer)
+	{
+		uint32_t e = plan.peer.nodes[peer].children[1];
+		size_t n = in.read_sz();
+		for(size_t i = 1; i < n; i++) {
+			K k{};
+			V v{};
+			typeinfo<K>::unpack(k, in);
+			remap(v, in, plan, e);
+			obj.emplace(std::move(k), std::move(v));
+		}
+	}
+};
+
+} // namespace detail
+
+// Decodes values written by a peer whose schema came ahead of the stream, eg as its get_schema_blob<T>(). A schema
+// matching T is decoded with options::trusted. Otherwise struct members are matched by name once, here, and the plan
+// is reused for every value: members only the peer has are skipped, members only T has are left alone.
+template<typename T, options o = options::none>
+class schema_reader
+{
+public:
+	explicit schema_reader(schema peer)
+	{
+		static const schema local = get_schema<T>();
+		plan.peer = std::move(peer);
+		plan.links.resize(plan.peer.nodes.size());
+		if(!detail::valid_schema(plan.peer) || !detail::link_nodes(plan, local, 0, 0)) {
+			plan.links.clear();
+			return;
+		}
+		trusted_ = plan.links[0].same;
+	}
+
+	// False when a peer value has no place in T and can't be skipped, every unpack then fails with incompatible
+	bool compatible() const
+	{
+		return !plan.links.empty();
+	}
+	// The peer writes exactly T
+	bool trusted() const
+	{
+		return trusted_;
+	}
+
+	template<typename Container>
+	[[nodiscard]] status unpack(T& obj, Container& in) const
+	{
+		if(!compatible())
+			return status::incompatible;
+		if(trusted_)
+			return packall::unpack<o | options::trusted>(obj, in);
+		try {
+			bytebuffer_impl<Container> wrap(in, false);
+			// Nodes the plan decodes with typeinfo are the same on both sides
+			detail::bytes_converter<o & options::variable_length_encoding, false, false, true, o & options::checksum>
+			    bc(wrap);
+			if constexpr(o & options::checksum) {
+				if(wrap.e - wrap.p < (ptrdiff_t)detail::kChecksumSize)
+					return status::data_underrun;
+				wrap.e -= detail::kChecksumSize;
+			}
+			detail::remap(obj, bc, plan, 0);
+			if constexpr(o & options::checksum) {
+				if(!bc.checksum_matches())
+					return status::checksum_mismatch;
+			}
+			if(!wrap.ok())
+				return status::data_underrun;
+			return status::ok;
+		} catch(status s) {
+			return s;
+		}
+	}
+
+private:
+	detail::remap_plan plan;
+	bool trusted_ = false;
+};
+
+} // namespace packall
+
+#endif
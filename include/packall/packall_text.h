@@ -6,6 +6,862 @@
 #include "packall.h"
 
 #include <charconv>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+// The text scanners use SSE2 on x64, the JSON structural index switches to AVX2 at runtime when available
+#if !defined(PACKALL_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define PACKALL_SIMD_X64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define PACKALL_TARGET_AVX2 __attribute__((target("avx2,bmi,popcnt")))
+#else
+#define PACKALL_TARGET_AVX2
+#endif
+#endif
+
+namespace packall {
+// What a split parse did with the pieces it started on other threads. A piece is parsed again, in order on the
+// calling thread, when it started from a wrong guess at an element boundary.
+struct split_stats
+{
+	size_t pieces = 0;
+	size_t reparsed = 0;
+};
+} // namespace packall
+
+namespace packall::detail {
+// Lexical classes of a text value. Each parser declares the classes it accepts in `tokens`, variants take the first
+// alternative accepting the class of the next value rather than trying each one in turn.
+struct token
+{
+	static constexpr uint8_t integer = 1;
+	static constexpr uint8_t real = 2;
+	static constexpr uint8_t string = 4;
+	// Keyed table / JSON object
+	static constexpr uint8_t object = 8;
+	// Positional table / JSON array
+	static constexpr uint8_t array = 16;
+	static constexpr uint8_t boolean = 32;
+};
+
+// Length of the 0x/0X prefix at s, 0 for a decimal number
+inline size_t hex_prefix(const char *s, const char *e)
+{
+	return (e - s > 1 && s[0] == '0' && (s[1] | 0x20) == 'x') ? 2 : 0;
+}
+
+inline bool is_hex_digit(char c)
+{
+	return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+inline uint8_t classify_number(const char *s, const char *e)
+{
+	if(s < e && *s == '-')
+		s++;
+	if(size_t n = hex_prefix(s, e)) {
+		// Hex floats mark themselves with a fraction or a binary exponent
+		for(s += n; s < e; s++) {
+			if(*s == '.' || *s == 'p' || *s == 'P')
+				return token::real;
+			if(!is_hex_digit(*s))
+				break;
+		}
+		return token::integer;
+	}
+	for(; s < e; s++) {
+		if(*s == '.' || *s == 'e' || *s == 'E')
+			return token::real;
+		if(*s < '0' || *s > '9')
+			break;
+	}
+	return token::integer;
+}
+
+// from_chars over the number syntax classify_number accepts: an optional '-', then decimal or 0x/0X hex
+template<typename T>
+std::from_chars_result number_from_chars(const char *s, const char *e, T& v)
+{
+	const char *p = s + (s < e && *s == '-');
+	size_t n = hex_prefix(p, e);
+	if(!n)
+		return std::from_chars(s, e, v);
+	// from_chars takes neither the prefix nor a sign after it
+	if(p + n < e && p[n] == '-')
+		return {s, std::errc::invalid_argument};
+	bool neg = p != s;
+	if constexpr(std::floating_point<T>) {
+		auto r = std::from_chars(p + n, e, v, std::chars_format::hex);
+		if(neg)
+			v = -v;
+		return r;
+	} else {
+		using U = std::make_unsigned_t<T>;
+		U u;
+		auto r = std::from_chars(p + n, e, u, 16);
+		if(r.ec != std::errc{})
+			return r;
+		U limit = std::numeric_limits<T>::max();
+		if(neg)
+			limit = std::is_signed_v<T> ? U(limit + 1) : 0;
+		if(u > limit)
+			return {r.ptr, std::errc::result_out_of_range};
+		v = T(neg ? U(0 - u) : u);
+		return r;
+	}
+}
+
+// Whether the integer at s is representable in T, checked without consuming or throwing
+template<std::integral T>
+bool integer_fits(const char *s, const char *e)
+{
+	T v;
+	return number_from_chars(s, e, v).ec == std::errc{};
+}
+
+// Where streamed text goes, a chunk at a time
+struct chunk_sink
+{
+	void *ctx = nullptr;
+	void (*write)(void *ctx, std::string_view chunk) = nullptr;
+};
+
+inline void append_utf8(std::string& o, uint32_t cp)
+{
+	if(cp < 0x80) {
+		o.push_back(static_cast<char>(cp));
+	} else if(cp < 0x800) {
+		o.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+		o.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	} else if(cp < 0x10000) {
+		o.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+		o.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		o.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	} else {
+		o.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+		o.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+		o.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+		o.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+	}
+}
+
+// Rejects overlong forms, surrogates and anything past U+10FFFF. ASCII, the common case, is skipped 16 bytes at a time.
+inline bool valid_utf8(const char *p, const char *e)
+{
+	auto u = reinterpret_cast<const uint8_t *>(p);
+	auto end = reinterpret_cast<const uint8_t *>(e);
+	while(u < end) {
+#ifdef PACKALL_SIMD_X64
+		while(end - u >= 16 && !_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(u)))) u += 16;
+#else
+		for(uint64_t a, b; end - u >= 16; u += 16) {
+			memcpy(&a, u, 8);
+			memcpy(&b, u + 8, 8);
+			if((a | b) & 0x8080808080808080ULL)
+				break;
+		}
+#endif
+		if(u == end)
+			break;
+		uint8_t c = *u;
+		if(c < 0x80) {
+			u++;
+			continue;
+		}
+		int n;
+		uint8_t lo = 0x80, hi = 0xBF;
+		if(c >= 0xC2 && c <= 0xDF) {
+			n = 1;
+		} else if(c >= 0xE0 && c <= 0xEF) {
+			n = 2;
+			if(c == 0xE0)
+				lo = 0xA0;
+			else if(c == 0xED)
+				hi = 0x9F;
+		} else if(c >= 0xF0 && c <= 0xF4) {
+			n = 3;
+			if(c == 0xF0)
+				lo = 0x90;
+			else if(c == 0xF4)
+				hi = 0x8F;
+		} else {
+			return false;
+		}
+		if(end - u <= n || u[1] < lo || u[1] > hi)
+			return false;
+		for(int i = 2; i <= n; i++)
+			if((u[i] & 0xC0) != 0x80)
+				return false;
+		u += n + 1;
+	}
+	return true;
+}
+
+// Next byte at or after p that skip_value has to look at: brackets, quotes and the start of a comment
+template<bool Lua>
+inline const char *find_skip_stop(const char *p, const char *e)
+{
+	constexpr char comment = Lua ? '-' : '/';
+#ifdef PACKALL_SIMD_X64
+	for(; e - p >= 16; p += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i brackets = _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+		__m128i other = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8(comment)));
+		if constexpr(Lua)
+			other = _mm_or_si128(other, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+		if(int mask = _mm_movemask_epi8(_mm_or_si128(brackets, other)))
+			return p + std::countr_zero(static_cast<unsigned>(mask));
+	}
+#endif
+	for(; p < e; p++) {
+		char ch = *p | 0x20;
+		if(ch == '{' || ch == '}' || *p == '"' || *p == comment || (Lua && *p == '\''))
+			return p;
+	}
+	return e;
+}
+
+// p is just past an opening quote, returns just past the closing one
+inline const char *skip_quoted(const char *p, const char *e, char quote)
+{
+	for(const char *q = p;; q++) {
+		q = static_cast<const char *>(memchr(q, quote, e - q));
+		if(!q)
+			return nullptr;
+		// An odd run of backslashes escapes the quote
+		const char *b = q;
+		while(b > p && b[-1] == '\\') b--;
+		if(!((q - b) & 1))
+			return q + 1;
+	}
+}
+
+// p is at a '[', returns just past a Lua long string or comment body opened there, or p if this isn't a long bracket
+inline const char *skip_long_bracket(const char *p, const char *e)
+{
+	const char *q = p + 1;
+	while(q < e && *q == '=') q++;
+	if(q == e || *q != '[')
+		return p;
+	size_t level = q - p - 1;
+	for(q++;; q++) {
+		q = static_cast<const char *>(memchr(q, ']', e - q));
+		if(!q || size_t(e - q) < level + 2)
+			return nullptr;
+		if(q[level + 1] == ']' && std::all_of(q + 1, q + 1 + level, [](char c) { return c == '='; }))
+			return q + level + 2;
+	}
+}
+
+// Just past the value starting at p without building it, or null if it doesn't end. Strings and comments are stepped
+// over whole and brackets are only counted, so nesting depth costs nothing.
+template<bool Lua>
+inline const char *skip_value(const char *p, const char *e)
+{
+	if(p == e)
+		return nullptr;
+	if(*p == '"' || (Lua && *p == '\''))
+		return skip_quoted(p + 1, e, *p);
+	if(*p != '{' && *p != '[') {
+		// Numbers, keywords and identifiers
+		const char *start = p;
+		while(p < e && ((*p >= '0' && *p <= '9') || ((*p | 0x20) >= 'a' && (*p | 0x20) <= 'z') || *p == '_' ||
+		                   *p == '.' || *p == '+' || (*p == '-' && !(Lua && p + 1 < e && p[1] == '-'))))
+			p++;
+		return p == start ? nullptr : p;
+	}
+	if constexpr(Lua) {
+		if(const char *end = skip_long_bracket(p, e); end != p)
+			return end;
+	}
+	size_t depth = 0;
+	for(; (p = find_skip_stop<Lua>(p, e)) < e;) {
+		switch(*p) {
+		case '{':
+		case '[':
+			if(Lua && *p == '[') {
+				const char *end = skip_long_bracket(p, e);
+				if(!end)
+					return nullptr;
+				if(end != p) {
+					p = end;
+					break;
+				}
+			}
+			depth++;
+			p++;
+			break;
+		case '}':
+		case ']':
+			p++;
+			if(--depth == 0)
+				return p;
+			break;
+		case '"':
+		case '\'':
+			p = skip_quoted(p + 1, e, *p);
+			if(!p)
+				return nullptr;
+			break;
+		default:
+			// Comments run to the end of the line, or a Lua long comment to its closing bracket
+			if(p + 1 == e || p[1] != *p) {
+				p++;
+				break;
+			}
+			p += 2;
+			if(Lua && p < e && *p == '[') {
+				if(const char *end = skip_long_bracket(p, e); end != p) {
+					if(!end)
+						return nullptr;
+					p = end;
+					break;
+				}
+			}
+			p = static_cast<const char *>(memchr(p, '\n', e - p));
+			if(!p)
+				return nullptr;
+			break;
+		}
+	}
+	return nullptr;
+}
+
+// Returns a value to its default state so it can be parsed into again. Members take their initializers from a value
+// initialized image, containers that start empty are cleared so they keep their capacity.
+template<typename T>
+void reset_value(T& v, const T& image)
+{
+	if constexpr(is_aggregate_struct<T>) {
+		constexpr size_t Arity = typeinfo<T>::Arity;
+		[&]<size_t... Index>(std::index_sequence<Index...>) {
+			(reset_value(decompose<Arity>::template get<Index>(v),
+			             decompose<Arity>::template get<Index>(const_cast<T&>(image))),
+			 ...);
+		}(std::make_index_sequence<Arity>());
+	} else if constexpr(requires { v.clear(); }) {
+		if(image.empty())
+			v.clear();
+		else
+			v = image;
+	} else if constexpr(is_array_type<T>::value) {
+		for(size_t i = 0; i < std::size(v); i++)
+			reset_value(v[i], image[i]);
+	} else if constexpr(std::is_copy_assignable_v<T>) {
+		v = image;
+	} else {
+		v = T{};
+	}
+}
+
+template<typename T>
+void reset_value(T& v)
+{
+	if constexpr(is_aggregate_struct<T>) {
+		reset_value(v, typeinfo<T>::default_image());
+	} else {
+		static const T image{};
+		reset_value(v, image);
+	}
+}
+
+template<typename T>
+struct split_part
+{
+	T out;
+	// Separator the part started after and the one it stopped on, null if it ran to the closing bracket
+	const char *from = nullptr, *to = nullptr;
+	bool ok = false;
+};
+
+// Parses the elements of a top level list in `parts` pieces at once. Each piece after the first starts after the first
+// separator in its share of the text that an element parses from, and stops on the first separator past its share.
+// That start is a guess, a piece is only kept if the one before it stopped on the same separator, otherwise its share
+// is parsed again in order. The result and any error are those of a serial parse.
+// splits, if set, are separators known to be at the top level, each piece then starts exactly after one of them.
+// run(out, from, stop, end) parses elements starting at from and returns the first separator at or past stop, or null
+// at the closing bracket with end set to where parsing finished. stats, if set, counts the pieces kept and reparsed.
+template<typename T, typename Run>
+status parse_split(T& obj, const char *first, const char *e, size_t parts, std::string_view separators,
+    const std::vector<const char *> *splits, split_stats *stats, Run run)
+{
+	if(splits)
+		parts = splits->size() + 1;
+	std::vector<const char *> share(parts + 1);
+	for(size_t i = 0; i < parts; i++)
+		share[i] = splits && i ? (*splits)[i - 1] : first + (e - first) * i / parts;
+	share[parts] = e;
+
+	std::vector<split_part<T>> part(parts);
+	auto guess = [&](size_t i) {
+		auto& p = part[i];
+		for(const char *c = share[i]; c < share[i + 1]; c++) {
+			if(separators.find(*c) == std::string_view::npos)
+				continue;
+			const char *end = nullptr;
+			try {
+				p.out = T{};
+				p.to = run(p.out, c + 1, share[i + 1], end);
+			} catch(...) {
+				// Only a first element failing suggests a bad start, past that the piece is lost anyway
+				if(splits || p.out.size() > 1)
+					return;
+				continue;
+			}
+			// A bracket that isn't the last one closes some nested list, skip past it
+			if(!p.to && end != e) {
+				c = end - 1;
+				continue;
+			}
+			p.from = c;
+			p.ok = true;
+			return;
+		}
+	};
+	// jthreads so that any way out of here waits for the pieces still using part
+	std::vector<std::jthread> workers;
+	status result = status::ok;
+	try {
+		for(size_t i = 1; i < parts; i++)
+			workers.emplace_back(guess, i);
+		const char *end;
+		const char *at = run(obj, first, share[1], end);
+		for(size_t i = 1; i < parts && at; i++) {
+			workers[i - 1].join();
+			auto& p = part[i];
+			bool kept = p.ok && p.from == at;
+			if(stats) {
+				stats->pieces++;
+				stats->reparsed += !kept;
+			}
+			if(kept) {
+				obj.insert(obj.end(), std::make_move_iterator(p.out.begin()), std::make_move_iterator(p.out.end()));
+				at = p.to;
+			} else {
+				at = run(obj, at + 1, share[i + 1], end);
+			}
+		}
+	} catch(status s) {
+		result = s;
+	} catch(...) {
+		// Out of memory, or of threads
+		result = status::out_of_memory;
+	}
+	for(auto& w : workers)
+		if(w.joinable())
+			w.join();
+	return result;
+}
+
+// Transcoding between the binary encoding and text without building the value. Fmt adapts one text format, see
+// lua::detail::text_format. Structs and lists are walked in place, every other value is decoded or parsed on its own.
+static constexpr size_t kNoPrefix = ~size_t(0);
+
+template<typename Fmt, typename T>
+bool decode_to_text(auto& in, typename Fmt::writer_state& s, size_t pd, bool omit)
+{
+	T v{};
+	if constexpr(has_predecode_info<T>::value) {
+		if(pd != kNoPrefix)
+			typeinfo<T>::unpack_predecoded(v, in, pd);
+		else
+			typeinfo<T>::unpack(v, in);
+	} else {
+		typeinfo<T>::unpack(v, in);
+	}
+	if(omit && Fmt::is_default(v))
+		return true;
+	Fmt::write(v, s);
+	return false;
+}
+
+// Writes the size v at `at`, where one byte was left for it ahead of everything written since
+template<typename Container>
+void insert_sz(Container& out, size_t at, size_t v)
+{
+	bytebuffer& b = out.get_custom_buffer();
+	size_t end = out.position();
+	if(size_t grow = varint_size(v) - 1) {
+		uint8_t pad[10] = {};
+		b.write_bytes(pad, grow);
+		memmove(b.s + at + 1 + grow, b.s + at + 1, end - at - 1);
+		end += grow;
+	}
+	rewind(out, at);
+	out.write_sz(v);
+	rewind(out, end);
+}
+
+template<typename Fmt, typename T>
+void parse_to_binary(typename Fmt::parse_state& s, auto& out, bool predecoded)
+{
+	T v{};
+	Fmt::parse(v, s);
+	if constexpr(has_predecode_info<T>::value) {
+		if(predecoded) {
+			typeinfo<T>::pack_predecoded(v, out);
+			return;
+		}
+	}
+	typeinfo<T>::pack(v, out);
+}
+
+template<typename Fmt, typename T>
+struct transcoder
+{
+	// Writes the value and returns whether it is a default the caller may drop. With omit a default value may write
+	// nothing, otherwise only a value that ended no element may be taken back.
+	template<typename Container>
+	static bool to_text(Container& in, typename Fmt::writer_state& s, size_t pd = kNoPrefix, bool omit = false)
+	{
+		return decode_to_text<Fmt, T>(in, s, pd, omit);
+	}
+
+	template<typename Container>
+	static void to_binary(typename Fmt::parse_state& s, Container& out, bool predecoded = false)
+	{
+		parse_to_binary<Fmt, T>(s, out, predecoded);
+	}
+};
+
+template<typename Fmt, is_aggregate_struct T>
+    requires(!Fmt::template custom_text<T> && !is_deprecated<T>::value)
+struct transcoder<Fmt, T>
+{
+	using info = typeinfo<T>;
+	using writer_state = typename Fmt::writer_state;
+	using parse_state = typename Fmt::parse_state;
+	static constexpr size_t Arity = info::Arity;
+
+	template<size_t I>
+	using member_t = std::remove_cvref_t<decltype(decompose<info::Arity>::template get<I>(std::declval<T>()))>;
+
+	// Members still to come from the binary, the rest are written from the default image
+	struct cursor
+	{
+		size_t n;
+		bool sparse;
+		bool stopped;
+		presence_bitmap present;
+	};
+
+	template<typename Container>
+	static bool to_text(Container& in, writer_state& s, size_t pd = kNoPrefix, bool = false)
+	{
+		size_t n = pd;
+		if(n == kNoPrefix)
+			n = info::use_predecode ? in.read_sz() : info::predecode_info;
+		bool bc = n & 1;
+		cursor c{n >> 2, !(n & 2), n == 0, {}};
+		size_t at = 0;
+		if(bc) {
+			at = in.enter();
+		} else if(n != 0 && !c.sparse && c.n > Arity) [[unlikely]] {
+			throw status::incompatible;
+		}
+		if(n != 0 && c.sparse)
+			c.present = info::read_presence(c.n, bc, in);
+
+		size_t start = s.o.size();
+		bool skip = s.opts.skip_initial_scope;
+		s.opts.skip_initial_scope = false;
+		if(!skip) [[likely]]
+			s.newscope();
+		uint32_t kept = 0;
+		if constexpr(Arity > 0) {
+			auto image = decompose<Arity>::apply(const_cast<T&>(info::default_image()), tie_members{});
+			[&]<size_t... Index>(std::index_sequence<Index...>) {
+				(member_to_text<Index>(pick_member<Index>(image), in, s, c, kept), ...);
+			}(std::make_index_sequence<Arity>());
+		}
+		if(!skip) [[likely]]
+			s.endscope();
+		if(bc)
+			in.leave(at);
+		if(kept == 0 && s.opts.omit_default)
+			s.o.resize(start);
+		return kept == 0;
+	}
+
+	template<size_t I, typename M, typename Container>
+	static void member_to_text(const M& image, Container& in, writer_state& s, cursor& c, uint32_t& kept)
+	{
+		bool encoded = false;
+		if constexpr(emit_element<M>::value) {
+			if(c.stopped) {
+			} else if(c.sparse) {
+				if(info::template slot<I> >= c.n)
+					c.stopped = true;
+				else if(c.present.test(info::template slot<I>))
+					encoded = !(c.stopped = in.done());
+			} else if(c.n == 0 || in.done()) {
+				c.stopped = true;
+			} else {
+				c.n--;
+				encoded = true;
+			}
+		}
+		if(!encoded && s.opts.omit_default && Fmt::is_default(image))
+			return;
+		size_t at = s.o.size();
+		s.prefix();
+		if(!s.opts.omit_names)
+			Fmt::write_name(get_member_name<T, I>(), s);
+		if(!encoded) {
+			Fmt::write(image, s);
+		} else if(transcoder<Fmt, M>::to_text(in, s, kNoPrefix, s.opts.omit_default) && s.opts.omit_default) {
+			s.o.resize(at);
+			return;
+		}
+		kept++;
+		s.next();
+	}
+
+	template<typename Container>
+	static void to_binary(parse_state& s, Container& out, bool predecoded = false)
+	{
+		if constexpr(info::is_sparse) {
+			// The presence bitmap comes first, so the whole struct is needed before anything can be written
+			parse_to_binary<Fmt, T>(s, out, predecoded);
+		} else {
+			static constexpr auto members = make_members<Container>(std::make_index_sequence<Arity>());
+			static constexpr auto defaults = make_defaults<Container>(std::make_index_sequence<Arity>());
+			if(s.depth++ > s.opts.max_depth) [[unlikely]] {
+				throw status::stack_overflow;
+			}
+			const char *start = s.s;
+			size_t written = out.position();
+			bool skip = s.opts.skip_initial_scope;
+			s.opts.skip_initial_scope = false;
+			if(!predecoded && info::use_predecode)
+				out.write_prefix(info::predecode_info);
+			size_t at = 0;
+			if constexpr(info::is_backwards_compatible)
+				at = out.push();
+			if(!skip) [[likely]]
+				Fmt::begin_table(s);
+			uint32_t next = 0;
+			std::string_view k;
+			int key;
+			while((key = Fmt::member_key(s, k)) > 0) {
+				uint32_t index = get_member_index<T>(k, next);
+				if(index >= Arity) [[unlikely]] {
+					if(!s.opts.allow_unknown_keys) [[unlikely]] {
+						throw status::unknown_key;
+					}
+					s.skip_element();
+				} else if(index < next) [[unlikely]] {
+					key = -1;
+					break;
+				} else {
+					for(; next < index; next++) defaults[next](out);
+					members[index](s, out);
+					next = index + 1;
+				}
+				if(!s.table_next()) {
+					if(!skip) [[likely]]
+						Fmt::end_table(s);
+					break;
+				}
+			}
+			if(key < 0) [[unlikely]] {
+				// Keys out of declaration order or a positional table, start again and parse the whole struct
+				s.s = start;
+				s.depth--;
+				s.opts.skip_initial_scope = skip;
+				rewind(out, written);
+				parse_to_binary<Fmt, T>(s, out, predecoded);
+				return;
+			}
+			for(; next < Arity; next++) defaults[next](out);
+			if constexpr(info::is_backwards_compatible)
+				out.pop(at);
+			s.depth--;
+		}
+	}
+
+	template<size_t I, typename Container>
+	static void member_to_binary(parse_state& s, Container& out)
+	{
+		if constexpr(emit_element<member_t<I>>::value)
+			transcoder<Fmt, member_t<I>>::to_binary(s, out);
+		else
+			s.skip_element();
+	}
+
+	// Members missing from the text keep their default
+	template<size_t I, typename Container>
+	static void pack_default(Container& out)
+	{
+		if constexpr(emit_element<member_t<I>>::value)
+			typeinfo<member_t<I>>::pack(decompose<Arity>::template get<I>(const_cast<T&>(info::default_image())), out);
+	}
+
+	template<typename Container, size_t... Index>
+	static constexpr std::array<void (*)(parse_state&, Container&), Arity> make_members(std::index_sequence<Index...>)
+	{
+		return {&member_to_binary<Index, Container>...};
+	}
+	template<typename Container, size_t... Index>
+	static constexpr std::array<void (*)(Container&), Arity> make_defaults(std::index_sequence<Index...>)
+	{
+		return {&pack_default<Index, Container>...};
+	}
+};
+
+template<typename Fmt, is_listlike T>
+    requires(!is_stringlike<T>)
+struct transcoder<Fmt, T>
+{
+	using V = typename T::value_type;
+
+	template<typename Container>
+	static bool to_text(Container& in, typename Fmt::writer_state& s, size_t = kNoPrefix, bool = false)
+	{
+		size_t n = in.read_sz();
+		if(n == 0) {
+			Fmt::open_list(s);
+			Fmt::close_list(s);
+			return true;
+		}
+		if(--n > kMaximumVectorSize) [[unlikely]]
+			throw status::out_of_memory;
+		size_t pd = kNoPrefix;
+		if constexpr(has_predecode_info<V>::value)
+			pd = in.read_sz();
+		Fmt::open_list(s);
+		for(size_t i = 0; i < n; i++) {
+			s.prefix();
+			transcoder<Fmt, V>::to_text(in, s, pd);
+			s.next();
+		}
+		Fmt::close_list(s);
+		return n == 0;
+	}
+
+	template<typename Container>
+	static void to_binary(typename Fmt::parse_state& s, Container& out, bool = false)
+	{
+		Fmt::begin_list(s);
+		// The count goes first but is only known at the end, leave a byte for it
+		size_t at = out.position();
+		out.write_u8(0);
+		if constexpr(has_predecode_info<V>::value)
+			out.write_prefix(typeinfo<V>::predecode_info);
+		size_t n = 0;
+		while(s.table_array_implicit_key()) {
+			transcoder<Fmt, V>::to_binary(s, out, has_predecode_info<V>::value);
+			n++;
+			if(!s.table_next()) {
+				Fmt::end_list(s);
+				break;
+			}
+		}
+		insert_sz(out, at, n + 1);
+	}
+};
+
+// Maps are parsed whole, so duplicate keys and the map's own ordering come out exactly as pack would write them
+template<typename Fmt, is_maplike T>
+struct transcoder<Fmt, T>
+{
+	using K = typename T::key_type;
+	using V = typename T::mapped_type;
+
+	template<typename Container>
+	static bool to_text(Container& in, typename Fmt::writer_state& s, size_t = kNoPrefix, bool = false)
+	{
+		size_t n = in.read_sz();
+		if(n > 0)
+			n--;
+		s.newscope();
+		for(size_t i = 0; i < n; i++) {
+			K k{};
+			typeinfo<K>::unpack(k, in);
+			s.prefix();
+			Fmt::write_key(k, s);
+			s.assign();
+			transcoder<Fmt, V>::to_text(in, s);
+			s.next();
+		}
+		s.endscope();
+		return n == 0;
+	}
+
+	template<typename Container>
+	static void to_binary(typename Fmt::parse_state& s, Container& out, bool = false)
+	{
+		parse_to_binary<Fmt, T>(s, out, false);
+	}
+};
+
+template<typename Fmt, typename T, options o, typename Container>
+status binary_to_text(Container& bytes, typename Fmt::writer_state& s)
+{
+	try {
+		bytebuffer_impl<Container> wrap(bytes, false);
+		bytes_converter<o & options::variable_length_encoding> in(wrap);
+		transcoder<Fmt, T>::to_text(in, s);
+		if(!wrap.ok())
+			return status::data_underrun;
+		return status::ok;
+	} catch(status e) {
+		return e;
+	}
+}
+
+template<typename Fmt, typename T, options o, typename Container>
+status text_to_binary(typename Fmt::parse_state& s, Container& bytes)
+{
+	static_assert(is_vectorlike_container<Container>, "transcoding may rewind its output, which must be vector-like");
+	try {
+		bytebuffer_impl<Container> wrap(bytes, true);
+		bytes_converter<o & options::variable_length_encoding> out(wrap);
+		s.skip_ws();
+		transcoder<Fmt, T>::to_binary(s, out);
+		return s.finish();
+	} catch(status e) {
+		return e;
+	}
+}
+} // namespace packall::detail
+
+namespace packall {
+// Sink for format that writes to a file descriptor, ok is cleared if a write fails
+struct fd_sink
+{
+	int fd;
+	bool ok = true;
+
+	void operator()(std::string_view chunk)
+	{
+		while(ok && !chunk.empty()) {
+#ifdef _WIN32
+			int n = _write(fd, chunk.data(), static_cast<unsigned>(std::min<size_t>(chunk.size(), 1u << 30)));
+#else
+			auto n = ::write(fd, chunk.data(), chunk.size());
+			if(n < 0 && errno == EINTR)
+				continue;
+#endif
+			if(n <= 0)
+				ok = false;
+			else
+				chunk.remove_prefix(n);
+		}
+	}
+};
+} // namespace packall
 
 namespace packall::lua {
 struct parse_options
@@ -22,6 +878,11 @@ struct parse_options
 	bool allow_extra_array_entries = true;
 
 	bool skip_initial_scope = false;
+	// A top level list is parsed on up to this many threads, each taking at least split_size bytes of the text
+	unsigned threads = 1;
+	size_t split_size = 1 << 20;
+	// Counts what a split parse did with its pieces
+	split_stats *stats = nullptr;
 };
 
 struct format_options
@@ -32,6 +893,10 @@ struct format_options
 	bool omit_names = false;
 
 	bool skip_initial_scope = false;
+	// Streaming format hands text to the sink once this much is pending
+	size_t chunk_size = 64 * 1024;
+	// Write indented output directly, as prettyprint would lay it out
+	bool pretty = false;
 };
 
 template<typename T>
@@ -95,7 +960,7 @@ struct parse_state
 	{
 		if(s + 2 < e && *s == '[') {
 			int n = 0;
-			auto p = s;
+			auto p = s + 1;
 			while(p < e && *p == '=') n++, p++;
 			if(e != p && *p == '[') {
 				s = p + 1;
@@ -144,7 +1009,11 @@ struct parse_state
 
 	void skip_element()
 	{
-		throw status::bad_data;
+		const char *end = skip_value<true>(s, e);
+		if(!end) [[unlikely]]
+			throw status::bad_format;
+		s = end;
+		skip_ws();
 	}
 
 	status finish()
@@ -159,23 +1028,22 @@ struct parse_state
 	{
 		char ch = *s;
 		const char *start = ++s;
-		while(s < e && *s != ch) s++;
-		if(s == e)
+		auto end = static_cast<const char *>(memchr(start, ch, e - start));
+		if(!end)
 			throw status::bad_format;
-		table_key = std::string_view(start, s);
-		s++;
+		s = end + 1;
 		skip_ws();
-		return std::string_view(start, s - 1);
+		return std::string_view(start, end);
 	}
-	static bool check_long_string_end(const char *at, int n)
+	// at points to a ']', check for the rest of a level n closing bracket
+	bool check_long_string_end(const char *at, int n) const
 	{
-		if(*at != ']')
+		if(e - at < n + 2)
 			return false;
-		at--;
-		for(int i = 0; i < n; i++)
-			if(*at != '=')
+		for(int i = 1; i <= n; i++)
+			if(at[i] != '=')
 				return false;
-		return *at == ']';
+		return at[n + 1] == ']';
 	}
 	std::string_view parse_long_string()
 	{
@@ -190,12 +1058,77 @@ struct parse_state
 	std::string_view parse_long_string_impl(int n)
 	{
 		const char *start = s;
-		while(s < e && !check_long_string_end(s, n)) s++;
+		for(const char *p = s;; p++) {
+			p = static_cast<const char *>(memchr(p, ']', e - p));
+			if(!p) [[unlikely]]
+				throw status::bad_format;
+			if(check_long_string_end(p, n)) {
+				s = p + n + 2;
+				skip_ws();
+				return std::string_view(start, p);
+			}
+		}
+	}
 
-		const char *end = s - 1 - n;
-		s++;
-		skip_ws();
-		return std::string_view(start, end);
+	// Class of the next value, does not consume anything
+	uint8_t classify() const
+	{
+		if(s == e)
+			return 0;
+		switch(*s) {
+		case '"':
+		case '\'':
+			return token::string;
+		case '[':
+			return (e - s > 1 && (s[1] == '[' || s[1] == '=')) ? token::string : 0;
+		case '{':
+			return classify_table();
+		case 't':
+		case 'f':
+			return token::boolean;
+		case '-':
+		case '.':
+			return classify_number(s, e);
+		default:
+			return (*s >= '0' && *s <= '9') ? classify_number(s, e) : 0;
+		}
+	}
+	// A table is keyed if the first entry is `name =` or `["name"] =`, an empty table could be either
+	uint8_t classify_table() const
+	{
+		auto ws = [&](const char *p) {
+			while(p < e && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+			return p;
+		};
+		const char *p = ws(s + 1);
+		if(p == e || *p == '}')
+			return token::object | token::array;
+		if(*p == '[') {
+			if(e - p > 1 && (p[1] == '[' || p[1] == '=')) {
+				// Bare long string, a key only if followed by =
+				int n = 0;
+				for(p++; p < e && *p == '='; p++) n++;
+				for(p++;; p++) {
+					p = static_cast<const char *>(memchr(p, ']', e - p));
+					if(!p)
+						return 0;
+					if(check_long_string_end(p, n))
+						break;
+				}
+				p = ws(p + n + 2);
+				return (p < e && *p == '=') ? token::object : token::array;
+			}
+			p = ws(p + 1);
+			return (p < e && (*p == '"' || *p == '\'' || *p == '[')) ? token::object : token::array;
+		}
+		if((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || *p == '_') {
+			while(p < e && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || *p == '_' || (*p >= '0' && *p <= '9')))
+				p++;
+			p = ws(p);
+			if(p < e && *p == '=' && (e - p < 2 || p[1] != '='))
+				return token::object;
+		}
+		return token::array;
 	}
 
 	void table_begin()
@@ -228,21 +1161,25 @@ struct parse_state
 			return true;
 		}
 		if(*s == '[') {
-			const char *o = s;
-			s++;
-			skip_ws();
-			if(*s == '"' || *s == '\'') {
-				// short string
-				table_key = parse_immediate_short_string();
+			const char *o = s++;
+			if(*s == '[' || *s == '=') {
+				// Bare long string, as the writer emits
+				table_key = parse_long_string();
+			} else {
+				skip_ws();
+				if(*s == '"' || *s == '\'') {
+					table_key = parse_immediate_short_string();
+				} else if(*s == '[') {
+					s++;
+					table_key = parse_long_string();
+				} else {
+					s = o;
+					return false;
+				}
 				expect(']');
-				return true;
 			}
-			table_key = parse_long_string();
-			skip_ws();
-			if(*s == '=') {
-				return true;
-			}
-			s = o;
+			expect('=');
+			return true;
 		}
 		return false;
 	}
@@ -259,10 +1196,11 @@ struct parse_state
 	template<typename T>
 	void parse_primitive(T& v)
 	{
-		auto r = std::from_chars(s, e, v);
+		auto r = number_from_chars(s, e, v);
 		if(r.ec == std::errc::invalid_argument || r.ec == std::errc::result_out_of_range)
 			throw status::bad_format;
 		s = r.ptr;
+		skip_ws();
 	}
 	void parse_primitive(bool& v)
 	{
@@ -275,29 +1213,30 @@ struct parse_state
 			throw status::bad_format;
 	}
 
-	std::string parse_string()
+	// Neither form has escapes here, so every string is a view into the input
+	std::string_view parse_string_view()
 	{
 		if(*s == '"' || *s == '\'') {
-			std::string str;
-			char ch = *s;
-			const char *start = ++s;
-			while(s < e && *s != ch) {
-				str.push_back(*s++);
-			}
-			if(s == e)
+			const char *start = s + 1;
+			auto end = static_cast<const char *>(memchr(start, *s, e - start));
+			if(!end) [[unlikely]]
 				throw status::bad_format;
-			s++;
+			s = end + 1;
 			skip_ws();
-			return str;
+			return std::string_view(start, end);
 		}
 
 		if(*s == '[') {
 			s++;
-			return std::string(parse_long_string());
+			return parse_long_string();
 		}
 
 		throw status::bad_format;
 	}
+	std::string parse_string()
+	{
+		return std::string(parse_string_view());
+	}
 };
 
 template<typename K>
@@ -315,16 +1254,22 @@ struct key_parser
 	}
 };
 
-template<>
-struct key_parser<std::string>
+template<typename K>
+    requires(std::is_same_v<K, std::string> || std::is_same_v<K, std::string_view>)
+struct key_parser<K>
 {
-	static bool parse_key(std::string& obj, parse_state& s, size_t& i)
+	static bool parse_key(K& obj, parse_state& s, size_t& i)
 	{
 		if(s.maybe('}'))
 			return false;
-		// Strings are the most diverse, allowing for unquoted, single quoted and double quoted
-		if(*s.s == '[' || *s.s == '"' || *s.s == '\'') {
-			obj = s.parse_string();
+		// Strings are the most diverse, allowing for unquoted, bracketed and quoted
+		if(s.classify() == token::string) {
+			parser<K>::parse(obj, s);
+		} else if(s.maybe('[')) {
+			parser<K>::parse(obj, s);
+			s.expect(']');
+		} else if(*s.s == '"' || *s.s == '\'') {
+			parser<K>::parse(obj, s);
 		} else {
 			obj = s.parse_ident();
 		}
@@ -387,23 +1332,6 @@ struct seqparser
 	}
 };
 
-struct nameparser
-{
-	parse_state& s;
-	uint32_t target;
-
-	constexpr void enter(std::string_view name) {}
-	constexpr void leave() {}
-
-	template<typename U>
-	void visit(uint32_t index, std::string_view name, U& obj)
-	{
-		if(index == target) {
-			parser<U>::parse(obj, s);
-		}
-	}
-};
-
 template<is_aggregate_struct T>
 struct parser<T>
 {
@@ -420,17 +1348,18 @@ struct parser<T>
 				return;
 		}
 		if(s.table_literal_key()) {
+			uint32_t next = 0;
 			do {
-				uint32_t index = get_member_index<T>(s.table_key);
-				if(index > typeinfo<T>::Arity) [[unlikely]] {
+				uint32_t index = get_member_index<T>(s.table_key, next);
+				if(index >= typeinfo<T>::Arity) [[unlikely]] {
 					if(!s.opts.allow_unknown_keys) [[unlikely]] {
 						throw status::unknown_key;
 					}
 					// Need to skip
 					s.skip_element();
 				} else {
-					nameparser p{s, index};
-					foreach_member(obj, p);
+					members[index](obj, s);
+					next = index + 1;
 				}
 				if(!s.table_next()) {
 					if(!skip) [[likely]]
@@ -447,11 +1376,23 @@ struct parser<T>
 		s.depth--;
 	}
 
-	// This checks if it's worth maybe trying to parse this
-	static bool precheck_parse(const char *s, const char *e)
+	// Keys jump straight to their member's parser
+	template<size_t I>
+	static void parse_member(T& obj, parse_state& s)
+	{
+		auto& m = decompose<typeinfo<T>::Arity>::template get<I>(obj);
+		parser<std::remove_cvref_t<decltype(m)>>::parse(m, s);
+	}
+
+	template<size_t... I>
+	static constexpr auto make_members(std::index_sequence<I...>)
 	{
-		return *s == '{';
+		return std::array<void (*)(T&, parse_state&), sizeof...(I)>{&parse_member<I>...};
 	}
+	static constexpr auto members = make_members(std::make_index_sequence<typeinfo<T>::Arity>());
+
+	// Lua structs may also be written positionally
+	static constexpr uint8_t tokens = token::object | token::array;
 };
 
 // T[N] & array<T, N>
@@ -497,10 +1438,7 @@ struct parser<T>
 			}
 		}
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '{';
-	}
+	static constexpr uint8_t tokens = token::array;
 };
 
 template<>
@@ -510,10 +1448,7 @@ struct parser<bool>
 	{
 		s.parse_primitive(obj);
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == 't' || *s == 'f';
-	}
+	static constexpr uint8_t tokens = token::boolean;
 };
 
 template<std::integral T>
@@ -521,21 +1456,13 @@ struct parser<T>
 {
 	static void parse(T& obj, parse_state& s)
 	{
-		int base = 10;
-		if(s.s[0] == '0' && s.s[1] == 'x') {
-			s.s += 2;
-			base = 16;
-		}
-		auto r = std::from_chars(s.s, s.e, obj, base);
+		auto r = number_from_chars(s.s, s.e, obj);
 		if(r.ec == std::errc::invalid_argument || r.ec == std::errc::result_out_of_range)
 			throw status::bad_format;
 		s.s = r.ptr;
+		s.skip_ws();
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		// Hex & octal start with 0
-		return *s == '-' || (*s >= '0' && *s <= '9');
-	}
+	static constexpr uint8_t tokens = token::integer;
 };
 
 template<std::floating_point T>
@@ -545,11 +1472,7 @@ struct parser<T>
 	{
 		s.parse_primitive(obj);
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		// Hex & octal start with 0
-		return *s == '-' || *s == '.' || (*s >= '0' && *s <= '9');
-	}
+	static constexpr uint8_t tokens = token::integer | token::real;
 };
 
 template<is_stringlike T>
@@ -557,12 +1480,13 @@ struct parser<T>
 {
 	static void parse(T& obj, parse_state& s)
 	{
-		obj = s.parse_string();
-	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '\'' || *s == '"' || *s == '[';
+		// Views point straight into the input text, which must outlive them
+		if constexpr(std::is_same_v<T, std::string_view>)
+			obj = s.parse_string_view();
+		else
+			obj = s.parse_string();
 	}
+	static constexpr uint8_t tokens = token::string;
 };
 
 template<is_listlike T>
@@ -572,19 +1496,26 @@ struct parser<T>
 	static void parse(T& obj, parse_state& s)
 	{
 		s.table_begin();
+		parse_run(obj, s, s.e);
+	}
+
+	// Elements up to the first separator at or past stop, which is returned, or null once the list is closed
+	static const char *parse_run(T& obj, parse_state& s, const char *stop)
+	{
 		while(s.table_array_implicit_key()) {
 			obj.emplace_back();
 			parser<typename T::value_type>::parse(obj.back(), s);
+			const char *sep = s.s;
 			if(!s.table_next()) {
 				s.table_end();
 				break;
 			}
+			if(sep >= stop)
+				return sep;
 		}
+		return nullptr;
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '{';
-	}
+	static constexpr uint8_t tokens = token::array;
 };
 
 template<typename T, typename U>
@@ -602,14 +1533,11 @@ struct parser<std::pair<T, U>>
 			throw status::bad_format;
 		if(!s.table_array_implicit_key())
 			throw status::bad_format;
-		parser<T>::parse(obj.second, s);
+		parser<U>::parse(obj.second, s);
 		s.table_next();
 		s.table_end();
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '{';
-	}
+	static constexpr uint8_t tokens = token::array;
 };
 
 template<is_maplike T>
@@ -627,45 +1555,41 @@ struct parser<T>
 			s.table_next();
 		}
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '{';
-	}
+	static constexpr uint8_t tokens = token::object | token::array;
 };
 
 template<typename... V>
 struct parser<std::variant<V...>>
 {
 	using type = std::variant<V...>;
+	static constexpr uint8_t tokens = (parser<V>::tokens | ...);
 
 	static void parse(type& obj, parse_state& s)
 	{
-		parse_helper(obj, s, std::make_index_sequence<sizeof...(V)>());
+		parse_helper(obj, s, s.classify(), std::make_index_sequence<sizeof...(V)>());
 	}
 	template<size_t... Index>
-	static void parse_helper(type& obj, parse_state& s, std::index_sequence<Index...>)
+	static void parse_helper(type& obj, parse_state& s, uint8_t cls, std::index_sequence<Index...>)
 	{
-		if(!(maybe_parse<Index>(obj, s) || ...)) {
+		if(!(maybe_parse<Index>(obj, s, cls) || ...)) {
 			if(!s.opts.allow_unknown_variant_values) [[unlikely]]
 				throw status::bad_variant_value;
 			s.skip_element();
 		}
 	}
+	// The first alternative accepting the class of the next value is parsed, any error there is a real one
 	template<size_t I>
-	static bool maybe_parse(type& obj, parse_state& s)
+	static bool maybe_parse(type& obj, parse_state& s, uint8_t cls)
 	{
-		if(!parser<std::variant_alternative_t<I, type>>::precheck_parse(s.s, s.e))
-			return false;
-		const char *at = s.s;
-		try {
-			std::variant_alternative_t<I, type> v{};
-			parser<std::variant_alternative_t<I, type>>::parse(v, s);
-			obj = v;
-			return true;
-		} catch(status) {
-			s.s = at;
+		using A = std::variant_alternative_t<I, type>;
+		if(!(parser<A>::tokens & cls))
 			return false;
+		if constexpr(std::is_integral_v<A> && !std::is_same_v<A, bool>) {
+			if(!integer_fits<A>(s.s, s.e))
+				return false;
 		}
+		parser<A>::parse(obj.template emplace<I>(), s);
+		return true;
 	}
 };
 
@@ -682,8 +1606,13 @@ struct parser<std::tuple<V...>>
 	static void parse_helper(type& obj, parse_state& s, std::index_sequence<Index...>)
 	{
 		s.table_begin();
-		(maybe_parse<Index>(obj, s) && ...);
-		while(s.table_array_implicit_key()) s.skip_element();
+		// Stops early once the table closes, anything left over after the last element is skipped
+		if((maybe_parse<Index>(obj, s) && ...)) {
+			while(s.table_array_implicit_key()) {
+				s.skip_element();
+				s.table_next();
+			}
+		}
 	}
 
 	template<size_t Index>
@@ -692,69 +1621,107 @@ struct parser<std::tuple<V...>>
 		if(!s.table_array_implicit_key())
 			return false;
 		parser<std::tuple_element_t<Index, type>>::parse(std::get<Index>(obj), s);
+		s.table_next();
 		return true;
 	}
 };
 
+// Lowest long bracket level whose closing bracket can't be confused with the text
+inline int long_string_level(std::string_view s)
+{
+	uint64_t used = 0;
+	const char *p = s.data(), *e = p + s.size();
+	while((p = static_cast<const char *>(memchr(p, ']', e - p)))) {
+		const char *q = p + 1;
+		while(q < e && *q == '=') q++;
+		// ]=*] inside the text, or ]=* at its end which the closing bracket would complete
+		if((q == e || *q == ']') && q - p - 1 < 64)
+			used |= uint64_t(1) << (q - p - 1);
+		p = q;
+	}
+	return std::countr_one(used);
+}
+
+inline bool is_lua_ident(std::string_view s)
+{
+	if(s.empty() || !((s[0] >= 'a' && s[0] <= 'z') || (s[0] >= 'A' && s[0] <= 'Z') || s[0] == '_'))
+		return false;
+	for(char c : s)
+		if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+			return false;
+	return true;
+}
+
 struct writer_state
 {
 	format_options opts;
+	// Text not yet handed to the sink. Flushes only happen between elements and omit_default only rolls back values
+	// that wrote no elements, so a rollback never reaches into text that has already gone.
 	std::string o;
+	chunk_sink sink;
+	// Pretty printing state, where the current line's content starts
+	int depth = 0;
+	size_t line_start = 0;
 
+	void flush()
+	{
+		sink.write(sink.ctx, o);
+		o.clear();
+	}
+
+	void indent()
+	{
+		o.push_back('\n');
+		o.append(depth, '\t');
+		line_start = o.size();
+	}
 	void newscope()
 	{
 		o.push_back('{');
+		if(opts.pretty) {
+			depth++;
+			indent();
+		}
 	}
 	void endscope()
 	{
+		if(opts.pretty) {
+			depth--;
+			// A line with nothing on it yet only needs its indent taken back
+			if(o.size() == line_start && o.back() == '\t')
+				o.pop_back();
+			else
+				indent();
+		}
 		o.push_back('}');
 	}
 	void next()
 	{
 		o.push_back(',');
+		if(sink.write && o.size() >= opts.chunk_size) [[unlikely]]
+			flush();
+		if(opts.pretty)
+			indent();
 	}
-	void prefix() {}
-
-	void writestr(std::string_view s)
-	{
-		size_t at = o.size();
-		o.reserve(at + s.size() + 8);
-		o.append("  [[");
-		int n = 0;
-		int level = -1;
-		const char *raw = s.data();
-		for(size_t i = 0; i < s.size(); i++) {
-			o.push_back(raw[i]);
-			if(raw[i] == ']') {
-				if(level == -1) {
-					level = 0;
-				} else if(level > n) {
-					n = level;
-					level = -1;
-				}
-			} else if(raw[i] == '=' && level >= 0) {
-				level++;
-			} else {
-				level = -1;
-			}
-		}
-
-		if(n > 2) [[unlikely]] {
-			o[at] = '=';
-			o[at + 1] = '=';
-			o[at + 2] = '=';
-			std::string extra;
-			for(int i = 3; i < n; i++) extra.push_back('=');
-			extra.push_back('[');
-			o.insert(at, extra);
-		} else if(n > 0) [[unlikely]] {
-			o[at + 2] = '=';
-			o[at + 1] = '=';
-			o[at + 2 - n] = '[';
-		}
+	void assign()
+	{
+		if(opts.pretty)
+			o.append(" = ");
+		else
+			o.push_back('=');
+	}
+	void prefix() {}
 
+	void writestr(std::string_view s)
+	{
+		int level = long_string_level(s);
+		o.reserve(o.size() + s.size() + 2 * level + 4);
+		o.push_back('[');
+		o.append(level, '=');
+		o.push_back('[');
+		o.append(s);
 		o.push_back(']');
-		for(int i = 0; i < n; i++) o.push_back('=');
+		o.append(level, '=');
 		o.push_back(']');
 	}
 };
@@ -778,7 +1745,11 @@ struct key_writer<T>
 {
 	static void write(const T& obj, writer_state& s)
 	{
-		s.writestr(obj);
+		// Pretty output writes identifier keys bare
+		if(s.opts.pretty && is_lua_ident(obj))
+			s.o.append(obj);
+		else
+			s.writestr(obj);
 	}
 };
 
@@ -791,7 +1762,7 @@ struct writer<T>
 		for(const auto& [k, v] : obj) {
 			s.prefix();
 			key_writer<typename T::key_type>::write(k, s);
-			s.o.push_back('=');
+			s.assign();
 			writer<typename T::mapped_type>::write(v, s);
 			s.next();
 		}
@@ -808,7 +1779,8 @@ struct writer<T>
 		for(const auto& k : obj) {
 			s.prefix();
 			key_writer<typename T::key_type>::write(*k, s);
-			s.o.append("=true");
+			s.assign();
+			s.o.append("true");
 			s.next();
 		}
 		s.endscope();
@@ -851,7 +1823,7 @@ struct writer<T>
 		s.prefix();
 		if(!s.opts.omit_names) {
 			s.o.append(name);
-			s.o.push_back('=');
+			s.assign();
 		}
 		writer<U>::write(obj, s);
 		s.next();
@@ -951,11 +1923,11 @@ struct writer<std::pair<T, U>>
 	using type = std::pair<T, U>;
 	static void write(const type& obj, writer_state& s)
 	{
-		s.o.push_back('{');
+		s.newscope();
 		writer<T>::write(obj.first, s);
-		s.o.push_back(',');
+		s.next();
 		writer<U>::write(obj.second, s);
-		s.o.push_back('}');
+		s.endscope();
 	}
 };
 
@@ -1262,6 +2234,79 @@ inline const char *prettyprint(std::string& s, const char *p, const char *e, int
 	return p;
 }
 
+// How the transcoder reads and writes Lua
+struct text_format
+{
+	using writer_state = detail::writer_state;
+	using parse_state = detail::parse_state;
+
+	template<typename T>
+	static constexpr bool custom_text = is_custom_text_serialized<T>;
+
+	template<typename T>
+	static void write(const T& obj, writer_state& s)
+	{
+		writer<T>::write(obj, s);
+	}
+	template<typename T>
+	static bool is_default(const T& obj)
+	{
+		return is_default_value(obj);
+	}
+	static void write_name(std::string_view name, writer_state& s)
+	{
+		s.o.append(name);
+		s.assign();
+	}
+	template<typename K>
+	static void write_key(const K& k, writer_state& s)
+	{
+		key_writer<K>::write(k, s);
+	}
+	static void open_list(writer_state& s)
+	{
+		s.newscope();
+	}
+	static void close_list(writer_state& s)
+	{
+		s.endscope();
+	}
+
+	template<typename T>
+	static void parse(T& obj, parse_state& s)
+	{
+		parser<T>::parse(obj, s);
+	}
+	static void begin_list(parse_state& s)
+	{
+		s.table_begin();
+	}
+	static void end_list(parse_state& s)
+	{
+		s.table_end();
+	}
+	static void begin_table(parse_state& s)
+	{
+		s.table_begin();
+	}
+	static void end_table(parse_state& s)
+	{
+		s.table_end();
+	}
+	// 1 for a named member, 0 once the table is closed, -1 for a positional table
+	static int member_key(parse_state& s, std::string_view& k)
+	{
+		if(s.s == s.e)
+			return 0;
+		bool closing = *s.s == '}';
+		if(s.table_literal_key()) {
+			k = s.table_key;
+			return 1;
+		}
+		return closing ? 0 : -1;
+	}
+};
+
 } // namespace detail
 
 template<typename T>
@@ -1270,6 +2315,20 @@ inline status parse(T& obj, std::string_view text, const parse_options& opts = p
 	detail::parse_state s{opts, text.data(), text.data() + text.size()};
 	try {
 		s.skip_ws();
+		if constexpr(detail::is_listlike<T> && !detail::is_stringlike<T>) {
+			size_t parts = std::min<size_t>(opts.threads, text.size() / std::max<size_t>(opts.split_size, 1));
+			if(parts > 1 && !opts.skip_initial_scope) {
+				s.table_begin();
+				return detail::parse_split(obj, s.s, s.e, parts, ",;", nullptr, opts.stats,
+				    [&](T& out, const char *from, const char *stop, const char *&end) {
+					    detail::parse_state run{opts, from, s.e};
+					    run.skip_ws();
+					    auto sep = detail::parser<T>::parse_run(out, run, stop);
+					    end = run.s;
+					    return sep;
+				    });
+			}
+		}
 		detail::parser<T>::parse(obj, s);
 		return s.finish();
 	} catch(status s) {
@@ -1285,6 +2344,58 @@ inline void format(const T& obj, std::string& text, const format_options& opts =
 	text.swap(s.o);
 }
 
+// Streams the text to `write` in chunks of about opts.chunk_size, memory use doesn't grow with the object
+template<typename T, std::invocable<std::string_view> F>
+inline void format(const T& obj, F&& write, const format_options& opts = format_options())
+{
+	detail::writer_state s{opts};
+	s.sink.ctx = &write;
+	s.sink.write = [](void *ctx, std::string_view chunk) { (*static_cast<std::remove_reference_t<F> *>(ctx))(chunk); };
+	s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	detail::writer<T>::write(obj, s);
+	s.flush();
+}
+
+template<typename T, typename C, typename Tr>
+inline void format(const T& obj, std::basic_ostream<C, Tr>& out, const format_options& opts = format_options())
+{
+	format(obj, [&](std::string_view chunk) { out.write(chunk.data(), chunk.size()); }, opts);
+}
+
+// Writes the text format() would give for the T encoded in bytes without unpacking a T. Only leaf values are decoded,
+// one at a time, so memory use stays flat however large the value is.
+template<typename T, options o = options::none, typename Container>
+inline status binary_to_text(Container& bytes, std::string& text, const format_options& opts = format_options())
+{
+	detail::writer_state s{opts};
+	status r = detail::binary_to_text<detail::text_format, T, o>(bytes, s);
+	text.swap(s.o);
+	return r;
+}
+
+// Streams the text to `write` in chunks of about opts.chunk_size
+template<typename T, options o = options::none, typename Container, std::invocable<std::string_view> F>
+inline status binary_to_text(Container& bytes, F&& write, const format_options& opts = format_options())
+{
+	detail::writer_state s{opts};
+	s.sink.ctx = &write;
+	s.sink.write = [](void *ctx, std::string_view chunk) { (*static_cast<std::remove_reference_t<F> *>(ctx))(chunk); };
+	s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	status r = detail::binary_to_text<detail::text_format, T, o>(bytes, s);
+	s.flush();
+	return r;
+}
+
+// Encodes text as pack() would encode the T it parses to. Structs are written as they are read while their keys come
+// in declaration order, a struct written positionally or out of order is parsed whole first, as are sparse structs
+// and maps.
+template<typename T, options o = options::none, typename Container>
+inline status text_to_binary(std::string_view text, Container& bytes, const parse_options& opts = parse_options())
+{
+	detail::parse_state s{opts, text.data(), text.data() + text.size()};
+	return detail::text_to_binary<detail::text_format, T, o>(s, bytes);
+}
+
 inline std::string prettyprint(std::string_view in)
 {
 	std::string s;
@@ -1293,6 +2404,138 @@ inline std::string prettyprint(std::string_view in)
 	return s;
 }
 
+// Reads a run of records, each a table, as record_writer writes them. A record that fails to parse is reported and
+// reading picks up again at the next line starting with '{'. Views in the records point into text.
+template<typename T>
+class record_reader
+{
+public:
+	explicit record_reader(std::string_view text, const parse_options& opts = parse_options())
+	    : begin(text.data()), state{opts, text.data(), text.data() + text.size()}
+	{
+		state.opts.skip_initial_scope = false;
+	}
+
+	// Parses the next record into obj, which is reset first so its containers keep their capacity.
+	// Returns false once the input is exhausted, otherwise result is the record's status.
+	bool next(T& obj, status& result)
+	{
+		const char *start = state.s;
+		try {
+			state.skip_ws();
+			if(state.s == state.e)
+				return false;
+			start = state.s;
+			state.depth = 0;
+			detail::reset_value(obj);
+			detail::parser<T>::parse(obj, state);
+			result = state.finish();
+		} catch(status s) {
+			result = s;
+			resync(start);
+		}
+		at = start - begin;
+		return true;
+	}
+
+	// Fills out with up to out.size() records and their statuses, returns how many were read
+	size_t next(std::span<T> out, std::span<status> results)
+	{
+		size_t n = 0;
+		while(n < out.size() && n < results.size() && next(out[n], results[n])) n++;
+		return n;
+	}
+
+	// Offset in text of the record last returned
+	size_t offset() const
+	{
+		return at;
+	}
+
+private:
+	void resync(const char *start)
+	{
+		for(const char *p = start;;) {
+			p = static_cast<const char *>(memchr(p, '\n', state.e - p));
+			if(!p) {
+				state.s = state.e;
+				return;
+			}
+			if(++p < state.e && *p == '{') {
+				state.s = p;
+				return;
+			}
+		}
+	}
+
+	const char *begin;
+	detail::parse_state state;
+	size_t at = 0;
+};
+
+// Writes records one per line straight into its output, without an intermediate string per record
+class record_writer
+{
+public:
+	// Records collect in text()
+	explicit record_writer(const format_options& opts = format_options())
+	{
+		s.opts = opts;
+		s.opts.skip_initial_scope = false;
+	}
+	// Records stream to `write` in chunks of about opts.chunk_size, `write` must outlive the writer
+	template<std::invocable<std::string_view> F>
+	explicit record_writer(F& write, const format_options& opts = format_options()) : record_writer(opts)
+	{
+		s.sink.ctx = &write;
+		s.sink.write = [](void *ctx, std::string_view chunk) { (*static_cast<F *>(ctx))(chunk); };
+		s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	}
+	template<typename C, typename Tr>
+	explicit record_writer(std::basic_ostream<C, Tr>& out, const format_options& opts = format_options())
+	    : record_writer(opts)
+	{
+		s.sink.ctx = &out;
+		s.sink.write = [](void *ctx, std::string_view chunk) {
+			static_cast<std::basic_ostream<C, Tr> *>(ctx)->write(chunk.data(), chunk.size());
+		};
+		s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	}
+	~record_writer()
+	{
+		flush();
+	}
+
+	template<typename T>
+	void write(const T& obj)
+	{
+		size_t at = s.o.size();
+		detail::writer<T>::write(obj, s);
+		// omit_default drops an all default record entirely, it still needs to be there to be read back
+		if(s.o.size() == at)
+			s.o.append("{}");
+		s.o.push_back('\n');
+		if(s.sink.write && s.o.size() >= s.opts.chunk_size)
+			s.flush();
+	}
+
+	// Hands everything pending to the sink
+	void flush()
+	{
+		if(s.sink.write && !s.o.empty())
+			s.flush();
+	}
+
+	// Records written so far when there is no sink
+	std::string& text()
+	{
+		return s.o;
+	}
+
+private:
+	detail::writer_state s;
+};
+
 } // namespace packall::lua
 
 namespace packall::json {
@@ -1311,6 +2554,17 @@ struct parse_options
 	bool allow_extra_array_entries = true;
 
 	bool skip_initial_scope = false;
+	// A top level list is parsed on up to this many threads, each taking at least split_size bytes of the text
+	unsigned threads = 1;
+	size_t split_size = 1 << 20;
+	// Counts what a split parse did with its pieces
+	split_stats *stats = nullptr;
+	// Reject strings that aren't valid UTF-8, escapes are always decoded to valid UTF-8
+	bool validate_utf8 = false;
+	// Index the whole document with a SIMD pass first. The parser then jumps over whitespace, string bodies and skipped
+	// values, and a split parse starts its pieces exactly at element boundaries. Documents with comments, or of 4GB or
+	// more, are parsed without it.
+	bool structural_index = false;
 };
 
 struct format_options
@@ -1321,6 +2575,10 @@ struct format_options
 	bool omit_names = false;
 
 	bool skip_initial_scope = false;
+	// Streaming format hands text to the sink once this much is pending
+	size_t chunk_size = 64 * 1024;
+	// Write indented output directly, as prettyprint would lay it out
+	bool pretty = false;
 };
 
 template<typename T>
@@ -1329,17 +2587,321 @@ status parse(T& obj, std::string_view text, const parse_options& opts);
 namespace detail {
 using namespace ::packall::detail;
 
+// Stage 1 of the indexed parser. One pass over the text in 64 byte blocks records where every token starts and where
+// every string ends, so that stage 2 can jump over whitespace and string bodies and count brackets without reading
+// the text between them.
+struct block_masks
+{
+	uint64_t quote, backslash, ws, op, slash;
+};
+
+inline void classify_block_scalar(const char *p, block_masks& m)
+{
+	m = {};
+	for(int i = 0; i < 64; i++) {
+		uint64_t bit = uint64_t(1) << i;
+		switch(p[i]) {
+		case '"':
+			m.quote |= bit;
+			break;
+		case '\\':
+			m.backslash |= bit;
+			break;
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			m.ws |= bit;
+			break;
+		case '{':
+		case '}':
+		case '[':
+		case ']':
+		case ':':
+		case ',':
+			m.op |= bit;
+			break;
+		case '/':
+			m.slash |= bit;
+			break;
+		}
+	}
+}
+
+#ifdef PACKALL_SIMD_X64
+// Brackets and braces differ only in 0x20, so or-ing it in folds [ ] onto { }
+inline void classify_block_sse2(const char *p, block_masks& m)
+{
+	m = {};
+	for(int i = 0; i < 64; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+		__m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+		    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+		__m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+		    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+		m.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))))) << i;
+		m.backslash |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))))) << i;
+		m.slash |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('/'))))) << i;
+		m.ws |= uint64_t(uint16_t(_mm_movemask_epi8(ws))) << i;
+		m.op |= uint64_t(uint16_t(_mm_movemask_epi8(op))) << i;
+	}
+}
+
+PACKALL_TARGET_AVX2 inline void classify_block_avx2(const char *p, block_masks& m)
+{
+	m = {};
+	for(int i = 0; i < 64; i += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+		__m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i ws = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+		    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+		__m256i op = _mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+		    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+		m.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))))) << i;
+		m.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))))) << i;
+		m.slash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'))))) << i;
+		m.ws |= uint64_t(uint32_t(_mm256_movemask_epi8(ws))) << i;
+		m.op |= uint64_t(uint32_t(_mm256_movemask_epi8(op))) << i;
+	}
+}
+
+inline bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	// The OS must also save the ymm registers
+	if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+		return false;
+	// AVX2 and BMI1
+	__cpuidex(info, 7, 0);
+	return (info[1] & 0x28) == 0x28;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+#endif
+}
+#endif
+
+inline uint64_t prefix_xor(uint64_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+// Scanner state carried from one block to the next
+struct index_carry
+{
+	uint64_t escaped = 0, in_string = 0, scalar = 0;
+};
+
+// Appends the offsets of every token start and every closing quote in a block. Returns null if the block has a comment.
+inline uint32_t *flatten_block(const block_masks& m, index_carry& c, uint32_t at, uint32_t *out)
+{
+	// Odd length runs of backslashes escape the next character
+	constexpr uint64_t even = 0x5555555555555555ULL;
+	uint64_t backslash = m.backslash & ~c.escaped;
+	uint64_t follows_escape = backslash << 1 | c.escaped;
+	uint64_t odd_starts = backslash & ~even & ~follows_escape;
+	uint64_t even_runs = odd_starts + backslash;
+	c.escaped = even_runs < odd_starts;
+	uint64_t escaped = (even ^ (even_runs << 1)) & follows_escape;
+
+	uint64_t quote = m.quote & ~escaped;
+	uint64_t in_string = prefix_xor(quote) ^ c.in_string;
+	c.in_string = uint64_t(int64_t(in_string) >> 63);
+	if(m.slash & ~in_string) [[unlikely]]
+		return nullptr;
+
+	uint64_t scalar = ~(m.op | m.ws);
+	uint64_t nonquote_scalar = scalar & ~quote;
+	uint64_t follows_scalar = nonquote_scalar << 1 | c.scalar;
+	c.scalar = nonquote_scalar >> 63;
+	uint64_t string_tail = in_string ^ quote;
+	uint64_t bits = ((m.op | (scalar & ~follows_scalar)) & ~string_tail) | (quote & ~in_string);
+
+	// Written eight at a time to branch once per eight, any extra stores land past the end
+	int count = std::popcount(bits);
+	for(int k = 0; k < count; k += 8) {
+		for(int i = 0; i < 8; i++) {
+			out[k + i] = at + std::countr_zero(bits);
+			bits &= bits - 1;
+		}
+	}
+	return out + count;
+}
+
+// One loop per instruction set so the classifier inlines into it, n is a multiple of 64
+inline uint32_t *index_blocks_scalar(const char *p, size_t n, uint32_t at, index_carry& c, uint32_t *out)
+{
+	for(size_t i = 0; i < n && out; i += 64) {
+		block_masks m;
+		classify_block_scalar(p + i, m);
+		out = flatten_block(m, c, at + i, out);
+	}
+	return out;
+}
+
+#ifdef PACKALL_SIMD_X64
+inline uint32_t *index_blocks_sse2(const char *p, size_t n, uint32_t at, index_carry& c, uint32_t *out)
+{
+	for(size_t i = 0; i < n && out; i += 64) {
+		block_masks m;
+		classify_block_sse2(p + i, m);
+		out = flatten_block(m, c, at + i, out);
+	}
+	return out;
+}
+
+PACKALL_TARGET_AVX2 inline uint32_t *index_blocks_avx2(const char *p, size_t n, uint32_t at, index_carry& c, uint32_t *out)
+{
+	for(size_t i = 0; i < n && out; i += 64) {
+		block_masks m;
+		classify_block_avx2(p + i, m);
+		out = flatten_block(m, c, at + i, out);
+	}
+	return out;
+}
+#endif
+
+using index_blocks_fn = uint32_t *(*)(const char *, size_t, uint32_t, index_carry&, uint32_t *);
+
+inline index_blocks_fn select_index_blocks()
+{
+#ifdef PACKALL_SIMD_X64
+	return cpu_has_avx2() ? &index_blocks_avx2 : &index_blocks_sse2;
+#else
+	return &index_blocks_scalar;
+#endif
+}
+
+// Offsets of every token start and every closing quote in the whole document, in order. Brackets and separators
+// inside strings never appear, so the entries alone give the nesting at any point.
+struct structural_index
+{
+	// Left uninitialized past count, zero filling would cost as much as the whole pass
+	std::unique_ptr<uint32_t[]> entries;
+	size_t count = 0, capacity = 0;
+
+	const uint32_t *begin() const
+	{
+		return entries.get();
+	}
+	const uint32_t *end() const
+	{
+		return entries.get() + count;
+	}
+
+	// Returns false for text with a comment or an unterminated string, or too long for 32 bit offsets
+	bool build(const char *text, size_t n)
+	{
+		static const index_blocks_fn index_blocks = select_index_blocks();
+		if(n >= UINT32_MAX)
+			return false;
+		// Grown a window at a time, starting from a typical density of one entry per four bytes. A block adds at most
+		// 64 entries, and stores run up to 8 past the last one.
+		constexpr size_t kWindow = 16384;
+		index_carry carry;
+		for(size_t at = 0; at < n; at += kWindow) {
+			size_t len = std::min(n - at, kWindow);
+			if(capacity < count + len + 72)
+				grow(std::max({capacity * 2, n / 4, count + len + 72}));
+			size_t whole = len & ~size_t(63);
+			uint32_t *out = index_blocks(text + at, whole, static_cast<uint32_t>(at), carry, entries.get() + count);
+			if(out && whole < len) {
+				char tail[64];
+				memset(tail, ' ', sizeof(tail));
+				memcpy(tail, text + at + whole, len - whole);
+				out = index_blocks(tail, 64, static_cast<uint32_t>(at + whole), carry, out);
+			}
+			if(!out) [[unlikely]]
+				return false;
+			count = out - entries.get();
+		}
+		return !carry.in_string;
+	}
+
+	void grow(size_t n)
+	{
+		auto bigger = std::make_unique_for_overwrite<uint32_t[]>(n);
+		if(count)
+			memcpy(bigger.get(), entries.get(), count * sizeof(uint32_t));
+		entries = std::move(bigger);
+		capacity = n;
+	}
+};
+
 struct parse_state
 {
 	parse_options opts;
 	const char *s, *e;
 	std::string_view token;
 	uint32_t depth = 0;
+	// Stage 2 state when parsing from a structural index: entries not yet passed, as offsets from base
+	const char *base = nullptr;
+	const uint32_t *next_entry = nullptr, *last_entry = nullptr;
+
+	void use_index(const structural_index& index, const char *text)
+	{
+		base = text;
+		last_entry = index.end();
+		next_entry = std::lower_bound(index.begin(), last_entry, static_cast<uint32_t>(s - text));
+	}
+	bool indexed() const
+	{
+		return base;
+	}
+	// First indexed position after p, or null past the last entry
+	const char *indexed_after(const char *p)
+	{
+		while(next_entry < last_entry && base + *next_entry <= p) next_entry++;
+		return next_entry < last_entry ? base + *next_entry : nullptr;
+	}
+	// Just past the bracket closing the one at s, or null if it never closes
+	const char *indexed_close()
+	{
+		size_t open = 0;
+		for(const char *p = s; p; p = indexed_after(p)) {
+			if(*p == '{' || *p == '[')
+				open++;
+			else if((*p == '}' || *p == ']') && --open == 0)
+				return p + 1;
+		}
+		return nullptr;
+	}
+	// Separators of the list s is inside, the first at or past each of the parts - 1 even shares of the rest of the text
+	std::vector<const char *> top_level_splits(size_t parts) const
+	{
+		std::vector<const char *> splits;
+		size_t open = 0;
+		for(const uint32_t *p = next_entry; p < last_entry && splits.size() + 1 < parts; p++) {
+			const char *c = base + *p;
+			if(c < s)
+				continue;
+			if(*c == '{' || *c == '[') {
+				open++;
+			} else if(*c == '}' || *c == ']') {
+				if(open-- == 0)
+					break;
+			} else if(*c == ',' && !open && c >= s + (e - s) * (splits.size() + 1) / parts) {
+				splits.push_back(c);
+			}
+		}
+		return splits;
+	}
 
 	bool maybe_nil()
 	{
 		if(e - s >= 4 && s[0] == 'n' && s[1] == 'u' && s[2] == 'l' && s[3] == 'l') {
 			s += 4;
+			skip_ws();
 			return true;
 		}
 		return false;
@@ -1351,6 +2913,13 @@ struct parse_state
 	}
 	void skip_ws()
 	{
+		if(base && s < e && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) {
+			// Whitespace always runs up to the next token start
+			if(auto next = indexed_after(s)) {
+				s = next;
+				return;
+			}
+		}
 		while(s < e && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) s++;
 		if(s + 1 < e && s[0] == '/' && s[1] == '/') {
 			// comment!
@@ -1401,7 +2970,12 @@ struct parse_state
 
 	void skip_element()
 	{
-		throw status::bad_data;
+		// Nested values are stepped over by counting the brackets in the index
+		const char *end = base && (*s == '{' || *s == '[') ? indexed_close() : skip_value<false>(s, e);
+		if(!end) [[unlikely]]
+			throw status::bad_format;
+		s = end;
+		skip_ws();
 	}
 
 	status finish()
@@ -1412,6 +2986,28 @@ struct parse_state
 	std::string_view table_key;
 	bool table_kv;
 
+	// Class of the next value, does not consume anything
+	uint8_t classify() const
+	{
+		if(s == e)
+			return 0;
+		switch(*s) {
+		case '"':
+			return token::string;
+		case '{':
+			return token::object;
+		case '[':
+			return token::array;
+		case 't':
+		case 'f':
+			return token::boolean;
+		case '-':
+			return classify_number(s, e);
+		default:
+			return (*s >= '0' && *s <= '9') ? classify_number(s, e) : 0;
+		}
+	}
+
 	void obj_begin()
 	{
 		expect('{');
@@ -1445,113 +3041,162 @@ struct parse_state
 	template<typename T>
 	void parse_primitive(T& v)
 	{
-		auto r = std::from_chars(s, e, v);
+		auto r = number_from_chars(s, e, v);
 		if(r.ec == std::errc::invalid_argument || r.ec == std::errc::result_out_of_range)
 			throw status::bad_format;
 		s = r.ptr;
+		skip_ws();
+	}
+	void parse_primitive(bool& v)
+	{
+		auto str = parse_ident();
+		if(str == "true")
+			v = true;
+		else if(str == "false")
+			v = false;
+		else
+			throw status::bad_format;
+	}
+
+	void check_utf8(const char *start, const char *end)
+	{
+		if(opts.validate_utf8 && !valid_utf8(start, end)) [[unlikely]]
+			throw status::bad_format;
+	}
+	uint32_t parse_hex4()
+	{
+		if(e - s < 4) [[unlikely]]
+			throw status::bad_format;
+		uint32_t v = 0;
+		for(int i = 0; i < 4; i++) {
+			char c = *s++;
+			if(c >= '0' && c <= '9')
+				v = v * 16 + (c - '0');
+			else if((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+				v = v * 16 + ((c | 0x20) - 'a' + 10);
+			else [[unlikely]]
+				throw status::bad_format;
+		}
+		return v;
+	}
+
+	// Closing quote of a string without escapes, the index knows it even past escapes
+	const char *string_end(const char *start)
+	{
+		if(base) {
+			if(auto end = indexed_after(start - 1); end && *end == '"')
+				return end;
+		}
+		return static_cast<const char *>(memchr(start, '"', e - start));
 	}
-	void parse_primitive(bool& v)
+
+	// Only strings without escapes can be handed back as a view into the input
+	std::string_view parse_string_view()
 	{
-		auto str = parse_ident();
-		if(str == "true")
-			v = true;
-		else if(str == "false")
-			v = false;
-		else
+		if(*s != '"') [[unlikely]]
+			throw status::bad_format;
+		const char *start = ++s;
+		auto end = string_end(start);
+		if(!end) [[unlikely]]
 			throw status::bad_format;
+		if(memchr(start, '\\', end - start)) [[unlikely]]
+			throw status::read_disjoint_into_span;
+		check_utf8(start, end);
+		s = end + 1;
+		skip_ws();
+		return std::string_view(start, end);
 	}
-
 	std::string parse_string()
 	{
-		if(*s == '"') {
-			std::string str;
-			const char *start = ++s;
-			while(s < e && *s != '"') {
-				if(*s == '\\') [[unlikely]] {
-					s++;
-					if(s == e) [[unlikely]] {
+		if(*s != '"') [[unlikely]]
+			throw status::bad_format;
+		std::string str;
+		s++;
+		// Copy the runs between escapes in bulk, the closing quote is only searched for again once an escape passes it
+		const char *quote = base ? string_end(s) : nullptr;
+		for(;;) {
+			if(!quote || quote < s)
+				quote = static_cast<const char *>(memchr(s, '"', e - s));
+			if(!quote) [[unlikely]]
+				throw status::bad_format;
+			auto esc = static_cast<const char *>(memchr(s, '\\', quote - s));
+			if(!esc) {
+				check_utf8(s, quote);
+				str.append(s, quote);
+				s = quote + 1;
+				break;
+			}
+			check_utf8(s, esc);
+			str.append(s, esc);
+			s = esc + 1;
+			if(s == e) [[unlikely]]
+				throw status::bad_format;
+			switch(*s++) {
+			case '"':
+				str.push_back('"');
+				break;
+			case '\\':
+				str.push_back('\\');
+				break;
+			case '/':
+				str.push_back('/');
+				break;
+			case 'b':
+				str.push_back('\b');
+				break;
+			case 'f':
+				str.push_back('\f');
+				break;
+			case 'n':
+				str.push_back('\n');
+				break;
+			case 'r':
+				str.push_back('\r');
+				break;
+			case 't':
+				str.push_back('\t');
+				break;
+			case 'u': {
+				uint32_t cp = parse_hex4();
+				// Characters past the BMP arrive as a surrogate pair
+				if(cp >= 0xD800 && cp < 0xDC00) {
+					if(e - s < 2 || s[0] != '\\' || s[1] != 'u') [[unlikely]]
 						throw status::bad_format;
-					}
-					switch(*s) {
-					case '"':
-					case '\\':
-					case '/':
-						break;
-					case 'b':
-						str.push_back('\b');
-						continue;
-					case 'f':
-						str.push_back('\f');
-						continue;
-					case 'n':
-						str.push_back('\n');
-						continue;
-					case 'r':
-						str.push_back('\r');
-						continue;
-					case 't':
-						str.push_back('\t');
-						continue;
-					case 'u':
-						s++;
-						throw status::incompatible;
-						continue;
-					default:
+					s += 2;
+					uint32_t low = parse_hex4();
+					if(low < 0xDC00 || low >= 0xE000) [[unlikely]]
 						throw status::bad_format;
-					}
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				} else if(cp >= 0xDC00 && cp < 0xE000) [[unlikely]] {
+					throw status::bad_format;
 				}
-				str.push_back(*s++);
+				append_utf8(str, cp);
+				break;
 			}
-			if(s == e) [[unlikely]]
+			default:
 				throw status::bad_format;
-			s++;
-			skip_ws();
-			return str;
+			}
 		}
-
-		throw status::bad_format;
+		skip_ws();
+		return str;
 	}
 	std::string_view parse_name_string()
 	{
-		if(*s == '"') {
-			const char *start = ++s;
-			while(s < e && *s != '"') {
-				if(*s == '\\') [[unlikely]] {
-					throw status::bad_format;
-				}
-				s++;
-			}
-			if(s == e) [[unlikely]]
-				throw status::bad_format;
-			auto e = s++;
-			skip_ws();
-			return std::string_view(start, e);
-		}
-
-		throw status::bad_format;
+		if(*s != '"') [[unlikely]]
+			throw status::bad_format;
+		const char *start = ++s;
+		auto end = string_end(start);
+		if(!end || memchr(start, '\\', end - start)) [[unlikely]]
+			throw status::bad_format;
+		s = end + 1;
+		skip_ws();
+		return std::string_view(start, end);
 	}
 };
 
 template<typename T>
 struct parser;
 
-struct nameparser
-{
-	parse_state& s;
-	uint32_t target;
-
-	constexpr void enter(std::string_view name) {}
-	constexpr void leave() {}
-
-	template<typename U>
-	void visit(uint32_t index, std::string_view name, U& obj)
-	{
-		if(index == target) {
-			parser<U>::parse(obj, s);
-		}
-	}
-};
-
 template<>
 struct parser<bool>
 {
@@ -1559,10 +3204,7 @@ struct parser<bool>
 	{
 		s.parse_primitive(obj);
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == 't' || *s == 'f';
-	}
+	static constexpr uint8_t tokens = token::boolean;
 };
 
 template<std::integral T>
@@ -1570,21 +3212,13 @@ struct parser<T>
 {
 	static void parse(T& obj, parse_state& s)
 	{
-		int base = 10;
-		if(s.s[0] == '0' && s.s[1] == 'x') {
-			s.s += 2;
-			base = 16;
-		}
-		auto r = std::from_chars(s.s, s.e, obj, base);
+		auto r = number_from_chars(s.s, s.e, obj);
 		if(r.ec == std::errc::invalid_argument || r.ec == std::errc::result_out_of_range)
 			throw status::bad_format;
 		s.s = r.ptr;
+		s.skip_ws();
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		// Hex & octal start with 0
-		return *s == '-' || (*s >= '0' && *s <= '9');
-	}
+	static constexpr uint8_t tokens = token::integer;
 };
 
 template<std::floating_point T>
@@ -1594,11 +3228,7 @@ struct parser<T>
 	{
 		s.parse_primitive(obj);
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		// Hex & octal start with 0
-		return *s == '-' || *s == '.' || (*s >= '0' && *s <= '9');
-	}
+	static constexpr uint8_t tokens = token::integer | token::real;
 };
 
 template<is_stringlike T>
@@ -1606,12 +3236,13 @@ struct parser<T>
 {
 	static void parse(T& obj, parse_state& s)
 	{
-		obj = s.parse_string();
-	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '"';
+		// Views point straight into the input text, which must outlive them
+		if constexpr(std::is_same_v<T, std::string_view>)
+			obj = s.parse_string_view();
+		else
+			obj = s.parse_string();
 	}
+	static constexpr uint8_t tokens = token::string;
 };
 
 // T[N] & array<T, N>
@@ -1657,10 +3288,7 @@ struct parser<T>
 			}
 		}
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '[';
-	}
+	static constexpr uint8_t tokens = token::array;
 };
 
 template<is_listlike T>
@@ -1670,19 +3298,26 @@ struct parser<T>
 	static void parse(T& obj, parse_state& s)
 	{
 		s.arr_begin();
+		parse_run(obj, s, s.e);
+	}
+
+	// Elements up to the first separator at or past stop, which is returned, or null once the list is closed
+	static const char *parse_run(T& obj, parse_state& s, const char *stop)
+	{
 		while(s.table_array_implicit_key()) {
 			obj.emplace_back();
 			parser<typename T::value_type>::parse(obj.back(), s);
+			const char *sep = s.s;
 			if(!s.table_next()) {
 				s.arr_end();
 				break;
 			}
+			if(sep >= stop)
+				return sep;
 		}
+		return nullptr;
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '[';
-	}
+	static constexpr uint8_t tokens = token::array;
 };
 
 template<typename T, typename U>
@@ -1700,14 +3335,11 @@ struct parser<std::pair<T, U>>
 			throw status::bad_format;
 		if(!s.table_array_implicit_key())
 			throw status::bad_format;
-		parser<T>::parse(obj.second, s);
+		parser<U>::parse(obj.second, s);
 		s.table_next();
 		s.arr_end();
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '{';
-	}
+	static constexpr uint8_t tokens = token::array;
 };
 
 template<is_maplike T>
@@ -1725,45 +3357,41 @@ struct parser<T>
 			s.table_next();
 		}
 	}
-	static bool precheck_parse(const char *s, const char *e)
-	{
-		return *s == '{';
-	}
+	static constexpr uint8_t tokens = token::object;
 };
 
 template<typename... V>
 struct parser<std::variant<V...>>
 {
 	using type = std::variant<V...>;
+	static constexpr uint8_t tokens = (parser<V>::tokens | ...);
 
 	static void parse(type& obj, parse_state& s)
 	{
-		parse_helper(obj, s, std::make_index_sequence<sizeof...(V)>());
+		parse_helper(obj, s, s.classify(), std::make_index_sequence<sizeof...(V)>());
 	}
 	template<size_t... Index>
-	static void parse_helper(type& obj, parse_state& s, std::index_sequence<Index...>)
+	static void parse_helper(type& obj, parse_state& s, uint8_t cls, std::index_sequence<Index...>)
 	{
-		if(!(maybe_parse<Index>(obj, s) || ...)) {
+		if(!(maybe_parse<Index>(obj, s, cls) || ...)) {
 			if(!s.opts.allow_unknown_variant_values) [[unlikely]]
 				throw status::bad_variant_value;
 			s.skip_element();
 		}
 	}
+	// The first alternative accepting the class of the next value is parsed, any error there is a real one
 	template<size_t I>
-	static bool maybe_parse(type& obj, parse_state& s)
+	static bool maybe_parse(type& obj, parse_state& s, uint8_t cls)
 	{
-		if(!parser<std::variant_alternative_t<I, type>>::precheck_parse(s.s, s.e))
-			return false;
-		const char *at = s.s;
-		try {
-			std::variant_alternative_t<I, type> v{};
-			parser<std::variant_alternative_t<I, type>>::parse(v, s);
-			obj = v;
-			return true;
-		} catch(status) {
-			s.s = at;
+		using A = std::variant_alternative_t<I, type>;
+		if(!(parser<A>::tokens & cls))
 			return false;
+		if constexpr(std::is_integral_v<A> && !std::is_same_v<A, bool>) {
+			if(!integer_fits<A>(s.s, s.e))
+				return false;
 		}
+		parser<A>::parse(obj.template emplace<I>(), s);
+		return true;
 	}
 };
 
@@ -1784,19 +3412,20 @@ struct parser<T>
 				return;
 		}
 		// JSON is limited to only string keys
+		uint32_t next = 0;
 		while(!s.maybe('}')) {
 			auto k = s.parse_name_string();
 			s.expect(':');
-			uint32_t index = get_member_index<T>(k);
-			if(index > typeinfo<T>::Arity) [[unlikely]] {
+			uint32_t index = get_member_index<T>(k, next);
+			if(index >= typeinfo<T>::Arity) [[unlikely]] {
 				if(!s.opts.allow_unknown_keys) [[unlikely]] {
 					throw status::unknown_key;
 				}
 				// Need to skip
 				s.skip_element();
 			} else {
-				nameparser p{s, index};
-				foreach_member(obj, p);
+				members[index](obj, s);
+				next = index + 1;
 			}
 			if(!s.table_next()) {
 				if(!skip) [[likely]]
@@ -1807,11 +3436,22 @@ struct parser<T>
 		s.depth--;
 	}
 
-	// This checks if it's worth maybe trying to parse this
-	static bool precheck_parse(const char *s, const char *e)
+	// Keys jump straight to their member's parser
+	template<size_t I>
+	static void parse_member(T& obj, parse_state& s)
+	{
+		auto& m = decompose<typeinfo<T>::Arity>::template get<I>(obj);
+		parser<std::remove_cvref_t<decltype(m)>>::parse(m, s);
+	}
+
+	template<size_t... I>
+	static constexpr auto make_members(std::index_sequence<I...>)
 	{
-		return *s == '{';
+		return std::array<void (*)(T&, parse_state&), sizeof...(I)>{&parse_member<I>...};
 	}
+	static constexpr auto members = make_members(std::make_index_sequence<typeinfo<T>::Arity>());
+
+	static constexpr uint8_t tokens = token::object;
 };
 
 inline const char *pp_shortstr(std::string& s, const char *p, const char *e)
@@ -1875,43 +3515,139 @@ inline const char *prettyprint(std::string& s, const char *p, const char *e, int
 	return p;
 }
 
+// First character that must be escaped: a quote, a backslash or a control character
+inline const char *find_escape(const char *p, const char *e)
+{
+#ifdef PACKALL_SIMD_X64
+	for(; e - p >= 16; p += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		__m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+		    _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F)));
+		if(int mask = _mm_movemask_epi8(hit))
+			return p + std::countr_zero(static_cast<unsigned>(mask));
+	}
+#endif
+	for(; p < e; p++)
+		if(*p == '"' || *p == '\\' || static_cast<uint8_t>(*p) < 0x20)
+			return p;
+	return e;
+}
+
 struct writer_state
 {
 	format_options opts;
+	// Text not yet handed to the sink. Flushes only happen between elements and omit_default only rolls back values
+	// that wrote no elements, so a rollback never reaches into text that has already gone.
 	std::string o;
+	chunk_sink sink;
+	// Pretty printing state, where the current line's content starts
+	int depth = 0;
+	size_t line_start = 0;
 
+	void flush()
+	{
+		sink.write(sink.ctx, o);
+		o.clear();
+	}
+
+	void indent()
+	{
+		o.push_back('\n');
+		o.append(depth, '\t');
+		line_start = o.size();
+	}
+	void open(char ch)
+	{
+		o.push_back(ch);
+		if(opts.pretty) {
+			depth++;
+			indent();
+		}
+	}
+	void close(char ch)
+	{
+		if(opts.pretty) {
+			depth--;
+			// A line with nothing on it yet only needs its indent taken back
+			if(o.size() == line_start && o.back() == '\t')
+				o.pop_back();
+			else
+				indent();
+		}
+		o.push_back(ch);
+	}
 	void newscope()
 	{
-		o.push_back('{');
+		open('{');
 	}
 	void endscope()
 	{
-		o.push_back('}');
+		close('}');
 	}
 	void newarr()
 	{
-		o.push_back('[');
+		open('[');
 	}
 	void endarr()
 	{
-		o.push_back(']');
+		close(']');
 	}
 	void next()
 	{
 		o.push_back(',');
+		if(sink.write && o.size() >= opts.chunk_size) [[unlikely]]
+			flush();
+		if(opts.pretty)
+			indent();
+	}
+	void assign()
+	{
+		if(opts.pretty)
+			o.append(": ");
+		else
+			o.push_back(':');
 	}
 	void prefix() {}
 
+	// Runs that need no escaping are copied whole
 	void writestr(std::string_view s)
 	{
-		size_t at = o.size();
-		o.reserve(at + s.size() + 8);
-		o.append(" \"");
-		int n = 0;
-		int level = -1;
-		const char *raw = s.data();
-		for(size_t i = 0; i < s.size(); i++) {
-			o.push_back(raw[i]);
+		o.reserve(o.size() + s.size() + 3);
+		o.append(opts.pretty ? "\"" : " \"");
+		const char *p = s.data(), *end = p + s.size();
+		for(;;) {
+			const char *esc = find_escape(p, end);
+			o.append(p, esc);
+			if(esc == end)
+				break;
+			switch(*esc) {
+			case '"':
+				o.append("\\\"");
+				break;
+			case '\\':
+				o.append("\\\\");
+				break;
+			case '\b':
+				o.append("\\b");
+				break;
+			case '\f':
+				o.append("\\f");
+				break;
+			case '\n':
+				o.append("\\n");
+				break;
+			case '\r':
+				o.append("\\r");
+				break;
+			case '\t':
+				o.append("\\t");
+				break;
+			default: {
+				char u[6] = {'\\', 'u', '0', '0', "0123456789abcdef"[*esc >> 4], "0123456789abcdef"[*esc & 15]};
+				o.append(u, 6);
+			}
+			}
+			p = esc + 1;
 		}
 		o.push_back('"');
 	}
@@ -1970,7 +3706,7 @@ struct writer<T>
 			s.o.push_back('"');
 			s.o.append(name);
 			s.o.push_back('"');
-			s.o.push_back(':');
+			s.assign();
 		}
 		writer<U>::write(obj, s);
 		s.next();
@@ -1986,7 +3722,7 @@ struct writer<T>
 		for(const auto& [k, v] : obj) {
 			s.prefix();
 			writer<typename T::key_type>::write(k, s);
-			s.o.push_back(':');
+			s.assign();
 			writer<typename T::mapped_type>::write(v, s);
 			s.next();
 		}
@@ -2087,11 +3823,11 @@ struct writer<std::pair<T, U>>
 	using type = std::pair<T, U>;
 	static void write(const type& obj, writer_state& s)
 	{
-		s.o.push_back('[');
+		s.newarr();
 		writer<T>::write(obj.first, s);
-		s.o.push_back(',');
+		s.next();
 		writer<U>::write(obj.second, s);
-		s.o.push_back(']');
+		s.endarr();
 	}
 };
 
@@ -2156,6 +3892,77 @@ struct writer<std::tuple<V...>>
 	}
 };
 
+// How the transcoder reads and writes JSON
+struct text_format
+{
+	using writer_state = detail::writer_state;
+	using parse_state = detail::parse_state;
+
+	template<typename T>
+	static constexpr bool custom_text = false;
+
+	template<typename T>
+	static void write(const T& obj, writer_state& s)
+	{
+		writer<T>::write(obj, s);
+	}
+	template<typename T>
+	static bool is_default(const T& obj)
+	{
+		return is_default_value(obj);
+	}
+	static void write_name(std::string_view name, writer_state& s)
+	{
+		s.o.push_back('"');
+		s.o.append(name);
+		s.o.push_back('"');
+		s.assign();
+	}
+	template<typename K>
+	static void write_key(const K& k, writer_state& s)
+	{
+		writer<K>::write(k, s);
+	}
+	static void open_list(writer_state& s)
+	{
+		s.newarr();
+	}
+	static void close_list(writer_state& s)
+	{
+		s.endarr();
+	}
+
+	template<typename T>
+	static void parse(T& obj, parse_state& s)
+	{
+		parser<T>::parse(obj, s);
+	}
+	static void begin_list(parse_state& s)
+	{
+		s.arr_begin();
+	}
+	static void end_list(parse_state& s)
+	{
+		s.arr_end();
+	}
+	static void begin_table(parse_state& s)
+	{
+		s.obj_begin();
+	}
+	static void end_table(parse_state& s)
+	{
+		s.obj_end();
+	}
+	// 1 for a member, 0 once the object is closed
+	static int member_key(parse_state& s, std::string_view& k)
+	{
+		if(s.s == s.e || s.maybe('}'))
+			return 0;
+		k = s.parse_name_string();
+		s.expect(':');
+		return 1;
+	}
+};
 
 } // namespace detail
 
@@ -2163,8 +3970,31 @@ template<typename T>
 inline status parse(T& obj, std::string_view text, const parse_options& opts = parse_options())
 {
 	detail::parse_state s{opts, text.data(), text.data() + text.size()};
+	detail::structural_index index;
 	try {
+		if(opts.structural_index && index.build(text.data(), text.size()))
+			s.use_index(index, text.data());
 		s.skip_ws();
+		if constexpr(detail::is_listlike<T> && !detail::is_stringlike<T>) {
+			size_t parts = std::min<size_t>(opts.threads, text.size() / std::max<size_t>(opts.split_size, 1));
+			if(parts > 1 && !opts.skip_initial_scope) {
+				s.arr_begin();
+				// The index knows which separators are at the top level, without it the pieces guess
+				std::vector<const char *> splits;
+				if(s.indexed())
+					splits = s.top_level_splits(parts);
+				return detail::parse_split(obj, s.s, s.e, parts, ",", s.indexed() ? &splits : nullptr, opts.stats,
+				    [&](T& out, const char *from, const char *stop, const char *&end) {
+					    detail::parse_state run{opts, from, s.e};
+					    if(s.indexed())
+						    run.use_index(index, text.data());
+					    run.skip_ws();
+					    auto sep = detail::parser<T>::parse_run(out, run, stop);
+					    end = run.s;
+					    return sep;
+				    });
+			}
+		}
 		detail::parser<T>::parse(obj, s);
 		return s.finish();
 	} catch(status s) {
@@ -2180,6 +4010,57 @@ inline void format(const T& obj, std::string& text, const format_options& opts =
 	text.swap(s.o);
 }
 
+// Streams the text to `write` in chunks of about opts.chunk_size, memory use doesn't grow with the object
+template<typename T, std::invocable<std::string_view> F>
+inline void format(const T& obj, F&& write, const format_options& opts = format_options())
+{
+	detail::writer_state s{opts};
+	s.sink.ctx = &write;
+	s.sink.write = [](void *ctx, std::string_view chunk) { (*static_cast<std::remove_reference_t<F> *>(ctx))(chunk); };
+	s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	detail::writer<T>::write(obj, s);
+	s.flush();
+}
+
+template<typename T, typename C, typename Tr>
+inline void format(const T& obj, std::basic_ostream<C, Tr>& out, const format_options& opts = format_options())
+{
+	format(obj, [&](std::string_view chunk) { out.write(chunk.data(), chunk.size()); }, opts);
+}
+
+// Writes the text format() would give for the T encoded in bytes without unpacking a T. Only leaf values are decoded,
+// one at a time, so memory use stays flat however large the value is.
+template<typename T, options o = options::none, typename Container>
+inline status binary_to_text(Container& bytes, std::string& text, const format_options& opts = format_options())
+{
+	detail::writer_state s{opts};
+	status r = detail::binary_to_text<detail::text_format, T, o>(bytes, s);
+	text.swap(s.o);
+	return r;
+}
+
+// Streams the text to `write` in chunks of about opts.chunk_size
+template<typename T, options o = options::none, typename Container, std::invocable<std::string_view> F>
+inline status binary_to_text(Container& bytes, F&& write, const format_options& opts = format_options())
+{
+	detail::writer_state s{opts};
+	s.sink.ctx = &write;
+	s.sink.write = [](void *ctx, std::string_view chunk) { (*static_cast<std::remove_reference_t<F> *>(ctx))(chunk); };
+	s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	status r = detail::binary_to_text<detail::text_format, T, o>(bytes, s);
+	s.flush();
+	return r;
+}
+
+// Encodes text as pack() would encode the T it parses to. Structs are written as they are read while their keys come
+// in declaration order, a struct with its keys out of order is parsed whole first, as are sparse structs and maps.
+template<typename T, options o = options::none, typename Container>
+inline status text_to_binary(std::string_view text, Container& bytes, const parse_options& opts = parse_options())
+{
+	detail::parse_state s{opts, text.data(), text.data() + text.size()};
+	return detail::text_to_binary<detail::text_format, T, o>(s, bytes);
+}
+
 inline std::string prettyprint(std::string_view in)
 {
 	std::string s;
@@ -2187,6 +4068,128 @@ inline std::string prettyprint(std::string_view in)
 	detail::prettyprint(s, in.data(), in.data() + in.size());
 	return s;
 }
+
+// Reads newline delimited JSON, one record per line. A record that fails to parse is reported and reading carries on
+// with the next line. Views in the records point into text.
+template<typename T>
+class record_reader
+{
+public:
+	explicit record_reader(std::string_view text, const parse_options& opts = parse_options())
+	    : begin(text.data()), end(text.data() + text.size()), line_end(text.data()), state{opts, begin, end}
+	{
+		state.opts.skip_initial_scope = false;
+	}
+
+	// Parses the next record into obj, which is reset first so its containers keep their capacity.
+	// Returns false once the input is exhausted, otherwise result is the record's status.
+	bool next(T& obj, status& result)
+	{
+		const char *p = line_end;
+		while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+		if(p == end)
+			return false;
+		line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+		if(!line_end)
+			line_end = end;
+		at = p - begin;
+		state.s = p;
+		state.e = line_end;
+		state.depth = 0;
+		detail::reset_value(obj);
+		try {
+			detail::parser<T>::parse(obj, state);
+			result = state.s == state.e ? state.finish() : status::bad_format;
+		} catch(status s) {
+			result = s;
+		}
+		return true;
+	}
+
+	// Fills out with up to out.size() records and their statuses, returns how many were read
+	size_t next(std::span<T> out, std::span<status> results)
+	{
+		size_t n = 0;
+		while(n < out.size() && n < results.size() && next(out[n], results[n])) n++;
+		return n;
+	}
+
+	// Offset in text of the record last returned
+	size_t offset() const
+	{
+		return at;
+	}
+
+private:
+	const char *begin, *end, *line_end;
+	detail::parse_state state;
+	size_t at = 0;
+};
+
+// Writes newline delimited JSON straight into its output, without an intermediate string per record. Records are always
+// compact so each stays on one line.
+class record_writer
+{
+public:
+	// Records collect in text()
+	explicit record_writer(const format_options& opts = format_options())
+	{
+		s.opts = opts;
+		s.opts.skip_initial_scope = false;
+		s.opts.pretty = false;
+	}
+	// Records stream to `write` in chunks of about opts.chunk_size, `write` must outlive the writer
+	template<std::invocable<std::string_view> F>
+	explicit record_writer(F& write, const format_options& opts = format_options()) : record_writer(opts)
+	{
+		s.sink.ctx = &write;
+		s.sink.write = [](void *ctx, std::string_view chunk) { (*static_cast<F *>(ctx))(chunk); };
+		s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	}
+	template<typename C, typename Tr>
+	explicit record_writer(std::basic_ostream<C, Tr>& out, const format_options& opts = format_options())
+	    : record_writer(opts)
+	{
+		s.sink.ctx = &out;
+		s.sink.write = [](void *ctx, std::string_view chunk) {
+			static_cast<std::basic_ostream<C, Tr> *>(ctx)->write(chunk.data(), chunk.size());
+		};
+		s.o.reserve(opts.chunk_size + opts.chunk_size / 8);
+	}
+	~record_writer()
+	{
+		flush();
+	}
+
+	template<typename T>
+	void write(const T& obj)
+	{
+		size_t at = s.o.size();
+		detail::writer<T>::write(obj, s);
+		// omit_default drops an all default record entirely, it still needs to be there to be read back
+		if(s.o.size() == at)
+			s.o.append("{}");
+		s.o.push_back('\n');
+		if(s.sink.write && s.o.size() >= s.opts.chunk_size)
+			s.flush();
+	}
+
+	// Hands everything pending to the sink
+	void flush()
+	{
+		if(s.sink.write && !s.o.empty())
+			s.flush();
+	}
+
+	// Records written so far when there is no sink
+	std::string& text()
+	{
+		return s.o;
+	}
+
+private:
+	detail::writer_state s;
+};
 } // namespace packall::json
 
 #endif
@@ -64,6 +64,44 @@ T(s32, int32_t, B(f, 6, 0x60, 0x79, 0xFE, 0xFF), B(v, 6, 0xBF, 0x9A, 0xC), -1000
 T(u64, uint64_t, B(f, 6, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0), B(v, 6, 0xFF, 0xFF, 3), 0xFFFF);
 T(s64, int64_t, B(f, 6, 0x60, 0x79, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF), B(v, 6, 0xBF, 0x9A, 0xC), -100000);
 
+// Widest encodings
+T(u32max, uint32_t, B(f, 6, 0xFF, 0xFF, 0xFF, 0xFF), B(v, 6, 0xFF, 0xFF, 0xFF, 0xFF, 0xF), 0xFFFFFFFF);
+T(u64max, uint64_t, B(f, 6, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF),
+    B(v, 6, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 1), ~(uint64_t)0);
+
+TEST(packall_canonical, varint_widths)
+{
+	// Values of every width, so some are decoded straight from the buffer and some near the end of it
+	std::vector<uint64_t> values;
+	for(int bits = 0; bits <= 64; bits++) {
+		values.push_back(bits == 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1);
+		values.push_back(bits == 64 ? 0 : ((uint64_t)1 << bits));
+	}
+	std::vector<uint8_t> bytes;
+	pack<options::variable_length_encoding>(values, bytes);
+	size_t expected = 2;
+	for(auto v : values) expected += v ? (std::bit_width(v) + 6) / 7 : 1;
+	EXPECT_EQ(bytes.size(), expected);
+
+	for(size_t n = 0; n <= values.size(); n++) {
+		std::vector<uint64_t> in(values.begin(), values.begin() + n), out;
+		bytes.clear();
+		pack<options::variable_length_encoding>(in, bytes);
+		EXPECT_EQ(unpack<options::variable_length_encoding>(out, bytes), status::ok);
+		EXPECT_EQ(out, in);
+	}
+
+	// Overlong encodings of a narrower type drop the high bits either way
+	std::vector<uint8_t> overlong = {0xFF, 0xFF, 0xFF, 0xFF, 0x7F};
+	uint32_t u32 = 0;
+	EXPECT_EQ(unpack<options::variable_length_encoding>(u32, overlong), status::ok);
+	EXPECT_EQ(u32, 0xFFFFFFFFu);
+	overlong.resize(12, 0);
+	u32 = 0;
+	EXPECT_EQ(unpack<options::variable_length_encoding>(u32, overlong), status::ok);
+	EXPECT_EQ(u32, 0xFFFFFFFFu);
+}
+
 // Floating point representations don't have variable encodings
 T(f32, float, B(f, 6, 0xDB, 0x0F, 0x49, 0x40), B(v, 6, 0xDB, 0x0F, 0x49, 0x40), 3.14159265359f);
 T(f64, double, B(f, 6, 0xEA, 0x2E, 0x44, 0x54, 0xFB, 0x21, 0x09, 0x40),
@@ -191,6 +229,57 @@ struct two_ints_inline_omit
 T(twoints_imm_omit, two_ints_inline_omit, B(f, 6, 0xFF, 0xFF, 0xFF, 0xFF, 0xE8, 3, 0, 0), B(v, 6, 1, 0xD0, 0xF),
     two_ints_inline_omit{std::string(), -1, 1000});
 
+// Immutable structs that are laid out exactly as they are encoded are copied as a single block
+struct vec3
+{
+	float x, y, z;
+	bool operator==(const vec3&) const = default;
+	static constexpr traits Traits = traits::immutable;
+};
+
+struct padded_inline
+{
+	uint8_t a;
+	uint32_t b;
+	bool operator==(const padded_inline&) const = default;
+	static constexpr traits Traits = traits::immutable;
+};
+
+static_assert(detail::typeinfo<vec3>::is_memcpy_encodable<false>);
+static_assert(detail::typeinfo<vec3>::is_memcpy_encodable<true>);
+static_assert(detail::typeinfo<two_ints_inline>::is_memcpy_encodable<false>);
+static_assert(!detail::typeinfo<two_ints_inline>::is_memcpy_encodable<true>);
+static_assert(!detail::typeinfo<two_ints>::is_memcpy_encodable<false>);
+static_assert(!detail::typeinfo<padded_inline>::is_memcpy_encodable<false>);
+
+T(vec3_imm, vec3, B(f, 6, 0, 0, 0x80, 0x3F, 0, 0, 0, 0x40, 0, 0, 0x80, 0xBF),
+    B(v, 6, 0, 0, 0x80, 0x3F, 0, 0, 0, 0x40, 0, 0, 0x80, 0xBF), vec3{1.0f, 2.0f, -1.0f});
+T(vec3_vector, std::vector<vec3>,
+    B(f, 6, 3, 0, 0, 0x80, 0x3F, 0, 0, 0, 0x40, 0, 0, 0x80, 0xBF, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x40),
+    B(v, 6, 3, 0, 0, 0x80, 0x3F, 0, 0, 0, 0x40, 0, 0, 0x80, 0xBF, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x40),
+    std::vector<vec3>{{1.0f, 2.0f, -1.0f}, {0.0f, 0.0f, 2.0f}});
+T(padded_imm, padded_inline, B(f, 6, 1, 2, 0, 0, 0), B(v, 6, 1, 2), padded_inline{1, 2});
+
+// Sparse structs write a presence bitmap after the prefix and then only members that differ from T{}
+struct sparse_ints
+{
+	int a, b, c;
+	bool operator==(const sparse_ints&) const = default;
+	static constexpr traits Traits = traits::sparse;
+};
+
+T(sparse_one, sparse_ints, B(f, 6, 0xC, 2, 0xFF, 0xFF, 0xFF, 0xFF), B(v, 6, 0xC, 2, 1), sparse_ints{0, -1, 0});
+T(sparse_none, sparse_ints, B(f, 6, 0xC, 0), B(v, 6, 0xC, 0), sparse_ints{});
+
+TEST(packall_canonical, memcpy_truncated)
+{
+	// A truncated buffer still decodes up to the last complete member
+	std::vector<uint8_t> bytes = {0xFF, 0xFF, 0xFF, 0xFF};
+	two_ints_inline v{};
+	EXPECT_EQ(unpack(v, bytes), status::ok);
+	EXPECT_EQ(v, (two_ints_inline{-1, 0}));
+}
+
 // Containers
 // All simple containers are created equal
 TEST(packall_canonical, linear_containers)
@@ -139,3 +139,112 @@ TEST(packall_compat, backwards)
 	EXPECT_EQ(v1.x.b, v2.x.b);
 	EXPECT_EQ(v1.y, v2.y);
 }
+
+struct dense_v1
+{
+	int a;
+	std::string b;
+	std::vector<int> c;
+};
+
+struct sparse_v1
+{
+	static constexpr packall::traits Traits = packall::traits::sparse;
+	int a;
+	std::string b;
+	std::vector<int> c;
+};
+
+// A newer version with a member the old one doesn't know
+struct sparse_v2
+{
+	static constexpr packall::traits Traits = packall::traits::sparse;
+	int a;
+	std::string b;
+	std::vector<int> c;
+	int d;
+};
+
+struct sparse_bc1
+{
+	static constexpr packall::traits Traits = packall::traits::sparse | packall::traits::backwards_compatible;
+	int a;
+	std::string b;
+};
+
+struct sparse_bc2
+{
+	static constexpr packall::traits Traits = packall::traits::sparse | packall::traits::backwards_compatible;
+	int a;
+	std::string b;
+	std::string c;
+};
+
+struct sparse_outer1
+{
+	sparse_bc1 x;
+	int y;
+};
+struct sparse_outer2
+{
+	sparse_bc2 x;
+	int y;
+};
+
+TEST(packall_compat, sparse)
+{
+	// Dense and sparse encodings of the same struct read as each other
+	std::vector<uint8_t> dense_bytes, sparse_bytes;
+	packall::pack(dense_v1{0, "b", {}}, dense_bytes);
+	packall::pack(sparse_v1{0, "b", {}}, sparse_bytes);
+	EXPECT_LT(sparse_bytes.size(), dense_bytes.size());
+
+	sparse_v1 s{7, "x", {1}};
+	EXPECT_EQ(packall::unpack(s, dense_bytes), packall::status::ok);
+	EXPECT_EQ(s.a, 0);
+	EXPECT_EQ(s.b, "b");
+	EXPECT_TRUE(s.c.empty());
+	// Absent members are reset to their defaults
+	dense_v1 d{7, "x", {1}};
+	EXPECT_EQ(packall::unpack(d, sparse_bytes), packall::status::ok);
+	EXPECT_EQ(d.a, 0);
+	EXPECT_EQ(d.b, "b");
+	EXPECT_TRUE(d.c.empty());
+
+	// A newer member is fine while it's absent, when it's set it can only be skipped with backwards_compatible
+	std::vector<uint8_t> bytes;
+	packall::pack(sparse_v2{1, "", {2, 3}, 0}, bytes);
+	sparse_v1 old{};
+	EXPECT_EQ(packall::unpack(old, bytes), packall::status::ok);
+	EXPECT_EQ(old.a, 1);
+	EXPECT_EQ(old.c, (std::vector<int>{2, 3}));
+	bytes.clear();
+	packall::pack(sparse_v2{1, "", {}, 4}, bytes);
+	EXPECT_EQ(packall::unpack(old, bytes), packall::status::incompatible);
+
+	bytes.clear();
+	packall::pack(sparse_outer2{{1, "", "new"}, 99}, bytes);
+	sparse_outer1 outer{};
+	EXPECT_EQ(packall::unpack(outer, bytes), packall::status::ok);
+	EXPECT_EQ(outer.x.a, 1);
+	EXPECT_EQ(outer.y, 99);
+
+	// The incremental encoder and decoder agree with pack and unpack
+	sparse_outer2 v{{0, "s", ""}, 5};
+	bytes.clear();
+	packall::pack(v, bytes);
+	packall::encoder<sparse_outer2> enc(v);
+	std::vector<uint8_t> streamed(bytes.size());
+	EXPECT_EQ(enc.pull(streamed), bytes.size());
+	EXPECT_EQ(streamed, bytes);
+	sparse_outer2 out{{3, "", "c"}, 0};
+	packall::decoder<sparse_outer2> dec(out);
+	packall::status st = packall::status::need_more;
+	for(size_t at = 0; at < bytes.size() && st == packall::status::need_more; at++)
+		st = dec.feed(std::span<const uint8_t>(bytes).subspan(at, 1));
+	EXPECT_EQ(st, packall::status::ok);
+	EXPECT_EQ(out.x.a, 0);
+	EXPECT_EQ(out.x.b, "s");
+	EXPECT_EQ(out.x.c, "");
+	EXPECT_EQ(out.y, 5);
+}
@@ -1,6 +1,11 @@
 #include "packall_test.h"
 
 #include <limits>
+#include <sstream>
+
+#include "../include/packall/packall_diff.h"
+#include "../include/packall/packall_instrument.h"
+#include "../include/packall/packall_schema.h"
 
 static_assert(packall::detail::has_predecode_info<Config>::value);
 static_assert(packall::detail::has_predecode_info<packall::deprecated<Config>>::value);
@@ -48,6 +53,70 @@ TEST(packall, explicit_arity)
 	EXPECT_EQ(b.y, a.y);
 }
 
+// At the member limit, well past the hand-written decompositions
+struct widest
+{
+	int m0, m1, m2, m3, m4, m5, m6, m7, m8, m9;
+	int m10, m11, m12, m13, m14, m15, m16, m17, m18, m19;
+	int m20, m21, m22, m23, m24, m25, m26, m27, m28, m29;
+	int m30, m31, m32, m33, m34, m35, m36, m37, m38, m39;
+	int m40, m41, m42, m43, m44, m45, m46, m47, m48, m49;
+	int m50, m51, m52, m53, m54, m55, m56, m57, m58, m59;
+	int m60, m61, m62, m63, m64, m65, m66, m67, m68, m69;
+	int m70, m71, m72, m73, m74, m75, m76, m77, m78, m79;
+	int m80, m81, m82, m83, m84, m85, m86, m87, m88, m89;
+	int m90, m91, m92, m93, m94, m95, m96, m97, m98, m99;
+	int m100, m101, m102, m103, m104, m105, m106, m107, m108, m109;
+	int m110, m111, m112, m113, m114, m115, m116, m117, m118, m119;
+	int m120, m121, m122, m123, m124, m125, m126, m127, m128, m129;
+	int m130, m131, m132, m133, m134, m135, m136, m137, m138, m139;
+	int m140, m141, m142, m143, m144, m145, m146, m147, m148, m149;
+	int m150, m151, m152, m153, m154, m155, m156, m157, m158, m159;
+	int m160, m161, m162, m163, m164, m165, m166, m167, m168, m169;
+	int m170, m171, m172, m173, m174, m175, m176, m177, m178, m179;
+	int m180, m181, m182, m183, m184, m185, m186, m187, m188, m189;
+	int m190, m191, m192, m193, m194, m195, m196, m197, m198, m199;
+	int m200, m201, m202, m203, m204, m205, m206, m207, m208, m209;
+	int m210, m211, m212, m213, m214, m215, m216, m217, m218, m219;
+	int m220, m221, m222, m223, m224, m225, m226, m227, m228, m229;
+	int m230, m231, m232, m233, m234, m235, m236, m237, m238, m239;
+	int m240, m241, m242, m243, m244, m245, m246, m247, m248, m249;
+};
+static_assert(packall::detail::aggregate_arity<widest>::value == 250);
+
+TEST(packall, widest_struct)
+{
+	widest a{};
+	a.m0 = 1;
+	a.m127 = 2;
+	a.m249 = 3;
+
+	std::vector<uint8_t> bytes;
+	packall::pack<packall::options::variable_length_encoding>(a, bytes);
+
+	widest b{};
+	EXPECT_EQ(packall::unpack<packall::options::variable_length_encoding>(b, bytes), packall::status::ok);
+	EXPECT_EQ(b.m0, 1);
+	EXPECT_EQ(b.m127, 2);
+	EXPECT_EQ(b.m249, 3);
+
+	EXPECT_EQ((packall::detail::get_member_name<widest, 249>()), "m249");
+	EXPECT_EQ(packall::detail::get_member_index<widest>("m127"), 127u);
+	EXPECT_EQ(packall::detail::get_member_index<widest>("m250"), ~0u);
+	EXPECT_EQ(packall::detail::get_member_index<widest>("m12", 12), 12u);
+	EXPECT_EQ(packall::detail::get_member_index<widest>("m12", 13), 12u);
+	// Every name resolves through the hash alone
+	const auto& names = packall::detail::member_names<widest>::names;
+	for(uint32_t i = 0; i < names.size(); i++) EXPECT_EQ(packall::detail::get_member_index<widest>(names[i]), i);
+}
+
+// Names with colliding hashes can't be placed and fall back to comparing every name
+static constexpr packall::detail::member_hash_table<3> kCollidingNames({7, 7, 9});
+static_assert(kCollidingNames.linear);
+static_assert(kCollidingNames.find("b", {"a", "b", "c"}) == 1);
+static_assert(kCollidingNames.find("d", {"a", "b", "c"}) == ~0u);
+static_assert(!packall::detail::member_lookup<widest>::table.linear);
+
 TEST(packall, empty)
 {
 	struct empty
@@ -242,3 +311,762 @@ TEST(packall, views)
 	EXPECT_EQ(packall::unpack(new_x, bytes), packall::status::ok);
 	EXPECT_EQ(new_x.sv, x.sv);
 }
+
+struct tick
+{
+	uint64_t timestamp;
+	double price;
+	uint32_t quantity;
+	std::variant<int8_t, std::array<char, 4>> venue;
+};
+
+static_assert(packall::max_packed_size_v<uint8_t> == 1);
+static_assert(packall::max_packed_size_v<uint32_t> == 4);
+static_assert(packall::max_packed_size_v<uint32_t, packall::options::variable_length_encoding> == 5);
+static_assert(packall::max_packed_size_v<uint64_t, packall::options::variable_length_encoding> == 10);
+static_assert(packall::max_packed_size_v<std::array<double, 9>> == 1 + 9 * 8);
+// prefix, members, variant index, array count and contents
+static_assert(packall::max_packed_size_v<tick> == 1 + 8 + 8 + 4 + 1 + 1 + 4);
+static_assert(packall::detail::fits_fixed_buffer<tick, packall::options::none, packall::fixed_buffer<27>>);
+static_assert(!packall::detail::fits_fixed_buffer<tick, packall::options::none, packall::fixed_buffer<26>>);
+static_assert(!packall::has_bounded_size<Config>);
+static_assert(!packall::has_bounded_size<std::vector<int>>);
+
+struct compat_tick
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	uint32_t a;
+	uint32_t b;
+};
+
+TEST(packall, fixed_buffer)
+{
+	tick t{1234, 99.5, 100, std::array<char, 4>{'X', 'N', 'Y', 'S'}};
+
+	packall::fixed_buffer<packall::max_packed_size_v<tick>> bytes;
+	packall::pack(t, bytes);
+	EXPECT_LE(bytes.size, bytes.bytes.size());
+
+	std::vector<uint8_t> reference;
+	packall::pack(t, reference);
+	EXPECT_EQ(std::vector<uint8_t>(bytes.span().begin(), bytes.span().end()), reference);
+
+	tick new_t{};
+	EXPECT_EQ(packall::unpack(new_t, bytes), packall::status::ok);
+	EXPECT_EQ(new_t.timestamp, t.timestamp);
+	EXPECT_EQ(new_t.price, t.price);
+	EXPECT_EQ(new_t.quantity, t.quantity);
+	EXPECT_EQ(new_t.venue, t.venue);
+
+	// A backwards compatible struct ending the buffer seeks to exactly its end
+	compat_tick c{1, 2}, new_c{};
+	packall::fixed_buffer<packall::max_packed_size_v<compat_tick>> compat;
+	packall::pack(c, compat);
+	EXPECT_EQ(packall::unpack(new_c, compat), packall::status::ok);
+	EXPECT_EQ(new_c.a, 1u);
+	EXPECT_EQ(new_c.b, 2u);
+
+	// Anything unbounded is still checked and fails rather than overflowing
+	packall::fixed_buffer<4> small;
+	EXPECT_THROW(packall::pack(std::string("too large to fit"), small), packall::status);
+}
+
+TEST(packall, vector_growth)
+{
+	// Bulk writes larger than the remaining space must still leave the end pointer on the new allocation
+	std::vector<std::vector<uint32_t>> v(8, std::vector<uint32_t>(5000, 0x12345678));
+	v.push_back(std::vector<uint32_t>(20000, 1));
+	std::vector<uint8_t> bytes;
+	packall::pack<packall::options::variable_length_encoding>(v, bytes);
+	std::vector<std::vector<uint32_t>> new_v;
+	EXPECT_EQ((packall::unpack<packall::options::variable_length_encoding>(new_v, bytes)), packall::status::ok);
+	EXPECT_EQ(new_v, v);
+}
+
+TEST(packall, packer)
+{
+	Config c{"/dev/video0", {640, 480},
+	    {223.28249888247538, 0.0, 152.30570853111396, 0.0, 223.8756535707556, 124.5606000035353, 0.0, 0.0, 1.0},
+	    {-0.44158343539568284, 0.23861463831967872, 0.0016338407443826572, 0.0034950038632981604, -0.05239245892096022},
+	    {{"start_server", bool{true}}, {"max_depth", uint16_t{5}}, {"model_path", std::string{"foo/bar.pt"}}}};
+
+	std::vector<uint8_t> reference;
+	packall::pack(c, reference);
+
+	packall::packer<> p;
+	auto bytes = p.pack(c);
+	EXPECT_EQ(std::vector<uint8_t>(bytes.begin(), bytes.end()), reference);
+
+	// Storage is kept between calls
+	const uint8_t *storage = bytes.data();
+	bytes = p.pack(uint32_t{7});
+	EXPECT_EQ(bytes.size(), 4u);
+	EXPECT_EQ(bytes.data(), storage);
+	bytes = p.pack(c);
+	EXPECT_EQ(bytes.data(), storage);
+
+	Config new_c;
+	std::span<uint8_t> in(const_cast<uint8_t *>(bytes.data()), bytes.size());
+	EXPECT_EQ(packall::unpack(new_c, in), packall::status::ok);
+	EXPECT_EQ(new_c.parameters, c.parameters);
+
+	auto& local = packall::thread_packer<packall::options::variable_length_encoding>();
+	EXPECT_EQ(local.pack(uint32_t{7}).size(), 1u);
+}
+
+struct instrumented_inner
+{
+	int32_t a;
+	std::string b;
+};
+struct instrumented_outer
+{
+	instrumented_inner x;
+	std::vector<instrumented_inner> y;
+};
+
+TEST(packall, instrumentation)
+{
+	instrumented_outer v{{1, "one"}, {{2, "two"}, {3, "three"}}};
+	packall::instrument_collector stats;
+	packall::set_instrumentation(&stats);
+
+	std::vector<uint8_t> bytes;
+	packall::pack(v, bytes);
+	EXPECT_TRUE(stats.snapshot().empty());
+
+	constexpr auto opts = packall::options::instrument | packall::options::instrument_nested;
+	bytes.clear();
+	packall::pack<opts>(v, bytes);
+	instrumented_outer new_v;
+	EXPECT_EQ(packall::unpack<packall::options::instrument>(new_v, bytes), packall::status::ok);
+	EXPECT_EQ(packall::set_instrumentation(nullptr), &stats);
+
+	size_t seen = 0;
+	for(auto& e : stats.snapshot()) {
+		if(e.type == packall::get_type_name<instrumented_outer>() && !e.nested) {
+			EXPECT_EQ(e.count, 1u);
+			EXPECT_EQ(e.bytes, bytes.size());
+			seen++;
+		} else if(e.type == packall::get_type_name<instrumented_inner>()) {
+			EXPECT_TRUE(e.nested);
+			EXPECT_EQ(e.op, packall::instrument_op::pack);
+			EXPECT_EQ(e.count, 3u);
+			seen++;
+		}
+	}
+	// Top-level pack and unpack, nested inner packs only
+	EXPECT_EQ(seen, 3u);
+	EXPECT_EQ(stats.snapshot().size(), 4u);
+
+	std::ostringstream out;
+	stats.dump(out);
+	EXPECT_NE(out.str().find("instrumented_inner pack nested: count=3"), std::string::npos);
+}
+
+struct sized_entry
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	uint32_t id;
+	std::string name;
+};
+struct sized_message
+{
+	std::vector<sized_entry> entries;
+	std::optional<sized_entry> extra;
+	uint64_t stamp;
+};
+
+TEST(packall, size_report)
+{
+	sized_message m{{{1, "a"}, {2, "bb"}, {3, "ccc"}}, sized_entry{4, "dddd"}, 5};
+	std::vector<uint8_t> bytes;
+	packall::pack(m, bytes);
+
+	auto report = packall::size_report(m);
+	EXPECT_EQ(report.samples(), 1u);
+	EXPECT_EQ(report.total_bytes(), bytes.size());
+
+	std::map<std::string, packall::size_profile::field> fields;
+	for(auto& f : report.fields()) fields[f.path] = f;
+	std::string root(packall::get_type_name<sized_message>());
+	ASSERT_TRUE(fields.count(root));
+	EXPECT_EQ(fields[root].bytes, bytes.size());
+	EXPECT_EQ(fields[root].prefix_bytes, 1u);
+
+	auto& entries = fields[root + ".entries"];
+	EXPECT_EQ(entries.count, 1u);
+	// One length, one element header
+	EXPECT_EQ(entries.length_bytes, 1u);
+	EXPECT_EQ(entries.prefix_bytes, 1u);
+
+	auto& names = fields[root + ".entries[*].name"];
+	EXPECT_EQ(names.count, 3u);
+	EXPECT_EQ(names.bytes, 3u + 1u + 2u + 3u);
+	EXPECT_EQ(names.length_bytes, 3u);
+	// Sizes 2 and 3 share a bucket, 4 starts the next one
+	EXPECT_EQ(names.percentile(0), 3u);
+	EXPECT_EQ(names.percentile(1), 7u);
+	EXPECT_EQ(names.max_size, 4u);
+	EXPECT_EQ(fields[root + ".extra[*].name"].count, 1u);
+	EXPECT_EQ(fields[root + ".stamp"].bytes, 8u);
+
+	// Every backwards_compatible struct has an offset, attributed to the member holding it
+	EXPECT_EQ(entries.offset_bytes, 12u);
+	EXPECT_EQ(fields[root + ".extra"].offset_bytes, 4u);
+
+	// Sizes follow the encoding
+	report.add<packall::options::variable_length_encoding>(m);
+	EXPECT_EQ(report.samples(), 2u);
+	EXPECT_EQ(report.fields().size(), fields.size());
+	std::ostringstream out;
+	report.dump(out);
+	EXPECT_NE(out.str().find(".entries[*].id: count=6"), std::string::npos);
+}
+
+struct streamed_record
+{
+	uint32_t id;
+	std::string name;
+	std::vector<double> samples;
+};
+struct streamed_frame
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	std::string source;
+	std::vector<streamed_record> records;
+	std::map<std::string, int> counters;
+	std::vector<uint64_t> raw;
+	bool operator==(const streamed_frame&) const = default;
+};
+bool operator==(const streamed_record& l, const streamed_record& r)
+{
+	return l.id == r.id && l.name == r.name && l.samples == r.samples;
+}
+
+struct compat_leaf
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	uint32_t id;
+	std::string name;
+};
+struct compat_fixed
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	uint32_t a;
+	uint32_t b;
+};
+struct compat_branch
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	std::vector<compat_leaf> leaves;
+	std::map<std::string, compat_leaf> named;
+	compat_fixed fixed;
+};
+struct compat_tree
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	std::string name;
+	std::vector<compat_branch> branches;
+};
+
+struct keyed_frame
+{
+	std::map<uint32_t, streamed_record> by_id;
+	std::variant<int32_t, std::string> note;
+};
+
+template<packall::options o>
+static void decode_in_chunks(const streamed_frame& f, size_t chunk)
+{
+	std::vector<uint8_t> bytes;
+	packall::pack<o>(f, bytes);
+	bytes.push_back(0xAB);
+
+	streamed_frame out;
+	packall::decoder<streamed_frame, o> dec(out);
+	packall::status s = packall::status::need_more;
+	size_t at = 0;
+	for(; at < bytes.size() && s == packall::status::need_more; at += chunk) {
+		s = dec.feed(std::span<const uint8_t>(bytes).subspan(at, std::min(chunk, bytes.size() - at)));
+	}
+	ASSERT_EQ(s, packall::status::ok);
+	EXPECT_EQ(out, f);
+	// Only the trailing byte can be left over, if it was part of the last chunk
+	size_t fed = std::min(at, bytes.size());
+	ASSERT_EQ(dec.remaining().size(), fed - (bytes.size() - 1));
+	if(fed == bytes.size()) {
+		EXPECT_EQ(dec.remaining()[0], 0xAB);
+	}
+}
+
+TEST(packall, decoder)
+{
+	streamed_frame f{"sensor", {}, {{"a", 1}, {"b", -2}}, {}};
+	for(uint32_t i = 0; i < 50; i++) {
+		f.records.push_back({i * 1000, std::string(i, 'x'), std::vector<double>(i, i * 0.5)});
+		f.raw.push_back(i * 0x123456789ull);
+	}
+
+	// The whole value at once must match unpack, including a top-level backwards_compatible struct
+	std::vector<uint8_t> bytes;
+	packall::pack(f, bytes);
+	streamed_frame reference;
+	EXPECT_EQ(packall::unpack(reference, bytes), packall::status::ok);
+	EXPECT_EQ(reference, f);
+
+	for(size_t chunk : {1, 3, 7, 64, 1000, 100000}) {
+		decode_in_chunks<packall::options::none>(f, chunk);
+		decode_in_chunks<packall::options::variable_length_encoding>(f, chunk);
+	}
+
+	// Capped work per call
+	streamed_frame out;
+	packall::decoder<streamed_frame> capped(out);
+	EXPECT_EQ(capped.feed(bytes, 256), packall::status::need_more);
+	int calls = 1;
+	while(capped.resume(256) == packall::status::need_more) calls++;
+	EXPECT_GT(calls, 4);
+	EXPECT_EQ(out, f);
+
+	// Map values resume, other values are decoded again only once the read that stopped them can complete
+	keyed_frame k;
+	for(uint32_t i = 0; i < 20; i++) k.by_id[i] = {i, std::string(i * 10, 'k'), std::vector<double>(i, 1.5)};
+	k.note = std::string(20000, 'n');
+	bytes.clear();
+	packall::pack(k, bytes);
+	for(size_t chunk : {1, 7, 1000}) {
+		keyed_frame new_k;
+		packall::decoder<keyed_frame> dec(new_k);
+		packall::status s = packall::status::need_more;
+		for(size_t at = 0; at < bytes.size() && s == packall::status::need_more; at += chunk)
+			s = dec.feed(std::span<const uint8_t>(bytes).subspan(at, std::min(chunk, bytes.size() - at)));
+		EXPECT_EQ(s, packall::status::ok);
+		EXPECT_EQ(new_k.by_id, k.by_id);
+		EXPECT_EQ(new_k.note, k.note);
+	}
+
+	// A stream that ends on a member boundary completes once finished, anything else is an error
+	struct two
+	{
+		int a;
+		int b;
+	} t{1, 2};
+	bytes.clear();
+	packall::pack(t, bytes);
+	two new_t{0, 99};
+	packall::decoder<two> partial(new_t);
+	EXPECT_EQ(partial.feed(std::span<const uint8_t>(bytes).first(5)), packall::status::need_more);
+	EXPECT_EQ(partial.finish(), packall::status::ok);
+	EXPECT_EQ(new_t.a, 1);
+	EXPECT_EQ(new_t.b, 99);
+
+	packall::decoder<two> truncated(new_t);
+	EXPECT_EQ(truncated.feed(std::span<const uint8_t>(bytes).first(3)), packall::status::need_more);
+	EXPECT_EQ(truncated.finish(), packall::status::data_underrun);
+	EXPECT_EQ(truncated.feed(bytes), packall::status::data_underrun);
+}
+
+TEST(packall, encoder)
+{
+	streamed_frame f{"sensor", {}, {{"a", 1}, {"b", -2}}, {}};
+	for(uint32_t i = 0; i < 50; i++) {
+		f.records.push_back({i * 1000, std::string(i * 7, 'x'), std::vector<double>(i, i * 0.5)});
+		f.raw.push_back(i * 0x123456789ull);
+	}
+	std::vector<uint8_t> reference;
+	packall::pack(f, reference);
+
+	for(size_t chunk : {1, 3, 7, 64, 1000, 100000}) {
+		packall::encoder<streamed_frame> enc(f);
+		std::vector<uint8_t> bytes, buf(chunk);
+		while(!enc.done()) {
+			size_t n = enc.pull(buf);
+			// Every pull is filled except the last
+			if(!enc.done()) {
+				EXPECT_EQ(n, chunk);
+			}
+			bytes.insert(bytes.end(), buf.begin(), buf.begin() + n);
+		}
+		EXPECT_EQ(bytes, reference);
+		EXPECT_EQ(enc.pull(buf), 0u);
+	}
+
+	// Nested backwards_compatible structs are measured along with the outermost one
+	compat_tree tree{"root", {}};
+	for(uint32_t i = 0; i < 6; i++) {
+		compat_branch b;
+		for(uint32_t j = 0; j < i; j++) b.leaves.push_back({j, std::string(j * 5, 'l')});
+		b.named["n" + std::to_string(i)] = {i, "named"};
+		b.fixed = {i * 2, i};
+		tree.branches.push_back(std::move(b));
+	}
+	std::vector<uint8_t> tree_bytes;
+	packall::pack<packall::options::variable_length_encoding>(tree, tree_bytes);
+	for(size_t chunk : {1, 5, 64, 100000}) {
+		packall::encoder<compat_tree, packall::options::variable_length_encoding> enc(tree);
+		std::vector<uint8_t> bytes, buf(chunk);
+		while(!enc.done()) {
+			size_t n = enc.pull(buf);
+			bytes.insert(bytes.end(), buf.begin(), buf.begin() + n);
+		}
+		EXPECT_EQ(bytes, tree_bytes);
+	}
+
+	// Straight into a decoder
+	packall::encoder<streamed_frame, packall::options::variable_length_encoding> enc(f);
+	streamed_frame out;
+	packall::decoder<streamed_frame, packall::options::variable_length_encoding> dec(out);
+	uint8_t buf[13];
+	packall::status s = packall::status::need_more;
+	while(s == packall::status::need_more && !enc.done()) {
+		size_t n = enc.pull(buf);
+		s = dec.feed(std::span<const uint8_t>(buf, n));
+	}
+	EXPECT_EQ(s, packall::status::ok);
+	EXPECT_EQ(out, f);
+
+	// Wide strings are copied as-is in either encoding
+	std::u16string wide(300, u'\x263A'), new_wide;
+	std::vector<uint8_t> wide_bytes;
+	packall::pack<packall::options::variable_length_encoding>(wide, wide_bytes);
+	packall::encoder<std::u16string, packall::options::variable_length_encoding> wide_enc(wide);
+	packall::decoder<std::u16string, packall::options::variable_length_encoding> wide_dec(new_wide);
+	s = packall::status::need_more;
+	for(size_t at = 0; s == packall::status::need_more; at += 13) {
+		size_t n = wide_enc.pull(buf);
+		EXPECT_TRUE(std::equal(buf, buf + n, wide_bytes.begin() + at));
+		s = wide_dec.feed(std::span<const uint8_t>(buf, n));
+	}
+	EXPECT_EQ(s, packall::status::ok);
+	EXPECT_EQ(new_wide, wide);
+
+	// Values without incremental support are still split across pulls
+	std::set<std::string> words = {"alpha", "beta", "gamma", "delta"};
+	reference.clear();
+	packall::pack(words, reference);
+	packall::encoder<std::set<std::string>> whole(words);
+	std::vector<uint8_t> bytes(reference.size() + 4);
+	EXPECT_EQ(whole.pull(std::span<uint8_t>(bytes).first(5)), 5u);
+	EXPECT_EQ(whole.pull(std::span<uint8_t>(bytes).subspan(5)), reference.size() - 5);
+	bytes.resize(reference.size());
+	EXPECT_EQ(bytes, reference);
+	EXPECT_TRUE(whole.done());
+}
+
+struct replicated_item
+{
+	uint32_t id;
+	std::string label;
+	std::vector<double> values;
+	bool operator==(const replicated_item&) const = default;
+};
+struct replicated_state
+{
+	std::string name;
+	std::vector<replicated_item> items;
+	std::map<std::string, replicated_item> by_name;
+	std::array<int, 4> slots;
+	std::optional<std::string> note;
+	std::unique_ptr<std::vector<int>> owned;
+	bool operator==(const replicated_state& o) const
+	{
+		return name == o.name && items == o.items && by_name == o.by_name && slots == o.slots && note == o.note &&
+		       !owned == !o.owned && (!owned || *owned == *o.owned);
+	}
+};
+
+template<packall::options o>
+static void check_patch(const replicated_state& old, const replicated_state& now)
+{
+	std::vector<uint8_t> patch;
+	EXPECT_EQ(packall::diff<o>(old, now, patch), !(old == now));
+	// unique_ptr rules out a copy
+	std::vector<uint8_t> bytes;
+	packall::pack(old, bytes);
+	replicated_state v;
+	ASSERT_EQ(packall::unpack(v, bytes), packall::status::ok);
+	ASSERT_EQ(packall::apply<o>(v, patch), packall::status::ok);
+	EXPECT_EQ(v, now);
+}
+
+TEST(packall, diff)
+{
+	replicated_state old{"state", {}, {}, {1, 2, 3, 4}, {}, {}};
+	for(uint32_t i = 0; i < 100; i++) {
+		old.items.push_back({i, std::string(i % 10, 'x'), std::vector<double>(i % 5, i * 0.5)});
+		old.by_name["k" + std::to_string(i)] = {i, "v", {}};
+	}
+	std::vector<uint8_t> full, patch;
+	packall::pack(old, full);
+
+	// Nothing changed, nothing to send
+	replicated_state now{old.name, old.items, old.by_name, old.slots, {}, {}};
+	EXPECT_FALSE(packall::diff(old, now, patch));
+	EXPECT_TRUE(patch.empty());
+	check_patch<packall::options::none>(old, now);
+
+	// One deep change costs a few bytes
+	now.items[57].label = "changed";
+	EXPECT_TRUE(packall::diff(old, now, patch));
+	EXPECT_LT(patch.size(), 20u);
+	EXPECT_LT(patch.size() * 100, full.size());
+	check_patch<packall::options::none>(old, now);
+	check_patch<packall::options::variable_length_encoding>(old, now);
+
+	now.items.resize(90);
+	now.items.push_back({7, "new", {1.0}});
+	now.by_name.erase("k3");
+	now.by_name["k4"].values.push_back(-0.0);
+	now.by_name["added"] = {1, "a", {2.0}};
+	now.slots[2] = 9;
+	now.note = "note";
+	now.owned = std::make_unique<std::vector<int>>(5, 1);
+	check_patch<packall::options::none>(old, now);
+	check_patch<packall::options::variable_length_encoding>(old, now);
+	check_patch<packall::options::none>(now, old);
+
+	// A patch only applies to the value it was made from
+	replicated_state empty{};
+	packall::diff(old, now, patch);
+	EXPECT_EQ(packall::apply(empty, patch), packall::status::incompatible);
+	patch.resize(patch.size() / 2);
+	replicated_state copy{old.name, old.items, old.by_name, old.slots, {}, {}};
+	EXPECT_EQ(packall::apply(copy, patch), packall::status::data_underrun);
+}
+
+enum class schema_kind : uint16_t
+{
+	a,
+	b,
+};
+
+struct schema_leaf
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	float x;
+	std::array<uint8_t, 300> raw;
+};
+
+struct schema_root
+{
+	std::string name;
+	std::vector<schema_leaf> leaves;
+	std::map<std::string, std::optional<schema_leaf>> by_name;
+	std::variant<int32_t, std::string> tag;
+	std::tuple<bool, char, double> misc;
+	schema_kind kind;
+	packall::deprecated<int64_t> old;
+	std::unique_ptr<schema_root> next;
+	std::set<uint64_t> ids;
+};
+
+TEST(packall, schema)
+{
+	auto s = packall::get_schema<schema_root>();
+	EXPECT_EQ(s.type_id(), packall::get_type_id<schema_root>());
+	EXPECT_EQ(packall::get_schema<std::vector<schema_root>>().type_id(), packall::get_type_id<std::vector<schema_root>>());
+
+	auto& root = s.nodes[0];
+	ASSERT_EQ(root.members.size(), 9u);
+	EXPECT_EQ(root.members[1].name, "leaves");
+	EXPECT_TRUE(root.members[6].deprecated);
+	EXPECT_EQ(s.type_name(root.members[6].node), "int64");
+	EXPECT_EQ(s.type_name(root.members[2].node), "map<string, optional<schema_leaf>>");
+	// The type id only records the width of an integer
+	EXPECT_EQ(s.type_name(root.members[5].node), "enum<int16>");
+	// Structs are described once, however often they appear
+	EXPECT_EQ(s.nodes[root.members[7].node].children[0], 0u);
+	auto leaf = s.nodes[root.members[1].node].children[0];
+	EXPECT_EQ(s.nodes[leaf].flags, packall::traits::backwards_compatible);
+	EXPECT_EQ(s.type_name(s.nodes[leaf].members[1].node), "array<int8, 300>");
+	EXPECT_EQ(s.to_string(), "schema_root\n"
+	                         "struct schema_root {\n"
+	                         "\tstring name;\n"
+	                         "\tlist<schema_leaf> leaves;\n"
+	                         "\tmap<string, optional<schema_leaf>> by_name;\n"
+	                         "\tvariant<int32, string> tag;\n"
+	                         "\ttuple<bool, uint8, double> misc;\n"
+	                         "\tenum<int16> kind;\n"
+	                         "\tdeprecated<int64> old;\n"
+	                         "\tunique_ptr<schema_root> next;\n"
+	                         "\tset<int64> ids;\n"
+	                         "};\n"
+	                         "struct schema_leaf backwards_compatible {\n"
+	                         "\tfloat x;\n"
+	                         "\tarray<int8, 300> raw;\n"
+	                         "};\n");
+}
+
+struct checksum_entry
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	uint32_t id;
+	std::string name;
+	std::vector<double> samples;
+};
+
+struct checksum_pair
+{
+	int32_t a;
+	int32_t b;
+};
+
+struct checksum_doc
+{
+	std::vector<checksum_entry> entries;
+	std::map<uint32_t, std::string> names;
+};
+
+TEST(packall, checksum)
+{
+	const char *check = "123456789";
+	EXPECT_EQ(packall::detail::crc32c(0, check, 9), 0xE3069283u);
+	// Split anywhere, and the same with or without the instruction
+	EXPECT_EQ(packall::detail::crc32c(packall::detail::crc32c(0, check, 4), check + 4, 5), 0xE3069283u);
+	std::vector<uint8_t> noise(1000);
+	for(size_t i = 0; i < noise.size(); i++) noise[i] = uint8_t(i * 37 + (i >> 3));
+	for(size_t n : {0, 1, 7, 8, 9, 63, 1000})
+		EXPECT_EQ(packall::detail::crc32c(0, noise.data(), n), ~packall::detail::crc32c_table(~0u, noise.data(), n));
+
+	checksum_doc doc;
+	for(uint32_t i = 0; i < 600; i++) {
+		doc.entries.push_back({i, "entry " + std::to_string(i), std::vector<double>(i % 20, i * 0.5)});
+		doc.names[i] = std::to_string(i * 3);
+	}
+	std::vector<uint8_t> plain, bytes;
+	packall::pack(doc, plain);
+	packall::pack<packall::options::checksum>(doc, bytes);
+	// Large enough to be folded in several blocks
+	ASSERT_GT(plain.size(), 2 * packall::detail::kChecksumBlock);
+	ASSERT_EQ(bytes.size(), plain.size() + packall::detail::kChecksumSize);
+	EXPECT_TRUE(std::equal(plain.begin(), plain.end(), bytes.begin()));
+	uint32_t crc;
+	memcpy(&crc, bytes.data() + plain.size(), 4);
+	EXPECT_EQ(crc, packall::detail::crc32c(0, plain.data(), plain.size()));
+
+	checksum_doc back;
+	ASSERT_EQ(packall::unpack<packall::options::checksum>(back, bytes), packall::status::ok);
+	std::vector<uint8_t> again;
+	packall::pack(back, again);
+	EXPECT_EQ(again, plain);
+
+	for(size_t at : {size_t(0), size_t(100), plain.size() / 2, plain.size() - 1, bytes.size() - 1}) {
+		std::vector<uint8_t> bad = bytes;
+		bad[at] ^= 0x10;
+		checksum_doc v;
+		EXPECT_EQ(packall::unpack<packall::options::checksum>(v, bad), packall::status::checksum_mismatch) << at;
+	}
+	std::vector<uint8_t> cut(bytes.begin(), bytes.end() - 1);
+	checksum_doc v;
+	EXPECT_NE(packall::unpack<packall::options::checksum>(v, cut), packall::status::ok);
+	std::vector<uint8_t> tiny{1, 2};
+	EXPECT_EQ(packall::unpack<packall::options::checksum>(v, tiny), packall::status::data_underrun);
+
+	// The trailer is counted in the bounded size, so a fixed buffer still fits it
+	constexpr auto opts = packall::options::checksum | packall::options::variable_length_encoding;
+	constexpr size_t max = packall::max_packed_size_v<checksum_pair, opts>;
+	EXPECT_EQ(max, (packall::max_packed_size_v<checksum_pair, packall::options::variable_length_encoding>) + 4);
+	packall::fixed_buffer<max> fixed;
+	checksum_pair pair{-5, 300}, pair_back{};
+	packall::pack<opts>(pair, fixed);
+	EXPECT_EQ(packall::unpack<opts>(pair_back, fixed), packall::status::ok);
+	EXPECT_EQ(pair_back.a, -5);
+	EXPECT_EQ(pair_back.b, 300);
+}
+
+struct reader_item_v1
+{
+	static constexpr packall::traits Traits = packall::traits::sparse;
+	int32_t id;
+	std::string label;
+	std::vector<int16_t> extra;
+};
+
+struct reader_v1
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	uint32_t version;
+	std::vector<reader_item_v1> items;
+	packall::deprecated<int32_t> legacy;
+	std::map<std::string, reader_item_v1> by_name;
+	std::tuple<int, std::string> dropped;
+	std::variant<int, std::string> dropped_too;
+	std::optional<std::vector<reader_item_v1>> more;
+};
+
+// Reordered, renamed types with members added and removed
+struct reader_item_v2
+{
+	std::string label;
+	int32_t id;
+	double weight = 1.5;
+};
+
+struct reader_v2
+{
+	std::map<std::string, reader_item_v2> by_name;
+	std::optional<std::vector<reader_item_v2>> more;
+	std::vector<reader_item_v2> items;
+	uint32_t version;
+	std::string added = "none";
+};
+
+struct reader_clash
+{
+	std::string version;
+};
+
+TEST(packall, schema_reader)
+{
+	packall::schema peer;
+	std::vector<uint8_t> blob = packall::get_schema_blob<reader_v1>();
+	ASSERT_EQ(peer.from_blob(blob), packall::status::ok);
+	EXPECT_EQ(peer.type_id(), packall::get_type_id<reader_v1>());
+
+	reader_v1 v1{7, {{1, "one", {1, 2}}, {2, "", {}}}, {}, {{"k", {3, "three", {}}}}, {4, "four"}, "five",
+	    std::vector<reader_item_v1>{{5, "five", {5}}}};
+	std::vector<uint8_t> bytes;
+	packall::pack(v1, bytes);
+
+	packall::schema_reader<reader_v1> same(peer);
+	EXPECT_TRUE(same.trusted());
+	reader_v1 back;
+	ASSERT_EQ(same.unpack(back, bytes), packall::status::ok);
+	std::vector<uint8_t> again;
+	packall::pack(back, again);
+	EXPECT_EQ(again, bytes);
+
+	packall::schema_reader<reader_v2> remapped(peer);
+	ASSERT_TRUE(remapped.compatible());
+	EXPECT_FALSE(remapped.trusted());
+	for(int i = 0; i < 2; i++) {
+		reader_v2 v2;
+		ASSERT_EQ(remapped.unpack(v2, bytes), packall::status::ok);
+		EXPECT_EQ(v2.version, 7u);
+		ASSERT_EQ(v2.items.size(), 2u);
+		EXPECT_EQ(v2.items[0].id, 1);
+		EXPECT_EQ(v2.items[0].label, "one");
+		EXPECT_EQ(v2.items[0].weight, 1.5);
+		EXPECT_EQ(v2.items[1].id, 2);
+		EXPECT_EQ(v2.items[1].label, "");
+		ASSERT_EQ(v2.by_name.count("k"), 1u);
+		EXPECT_EQ(v2.by_name["k"].label, "three");
+		ASSERT_TRUE(v2.more.has_value());
+		ASSERT_EQ(v2.more->size(), 1u);
+		EXPECT_EQ((*v2.more)[0].id, 5);
+		EXPECT_EQ(v2.added, "none");
+	}
+	reader_v2 cut;
+	bytes.pop_back();
+	EXPECT_EQ(remapped.unpack(cut, bytes), packall::status::data_underrun);
+
+	packall::schema_reader<reader_clash> clash(peer);
+	EXPECT_FALSE(clash.compatible());
+	reader_clash c;
+	EXPECT_EQ(clash.unpack(c, bytes), packall::status::incompatible);
+
+	std::vector<uint8_t> junk{2, 3, 200, 1};
+	EXPECT_NE(peer.from_blob(junk), packall::status::ok);
+	EXPECT_TRUE(peer.nodes.empty());
+}
@@ -1,5 +1,6 @@
 #include "packall_test.h"
 #include "../include/packall/packall_text.h"
+#include <sstream>
 
 TEST(packall_lua, Config)
 {
@@ -58,6 +59,115 @@ TEST(packall_lua, no_members)
 	EXPECT_EQ(pt2, pt);
 }
 
+struct keyed
+{
+	int a;
+	int bb;
+	int ccc;
+	std::string name;
+};
+
+TEST(packall_lua, member_lookup)
+{
+	keyed k;
+	EXPECT_EQ(packall::lua::parse(k, R"({ccc = 3, name = "x", a = 1, bb = 2})"), packall::status::ok);
+	EXPECT_EQ(k.a, 1);
+	EXPECT_EQ(k.bb, 2);
+	EXPECT_EQ(k.ccc, 3);
+	EXPECT_EQ(k.name, "x");
+
+	packall::lua::parse_options strict;
+	strict.allow_unknown_keys = false;
+	EXPECT_EQ(packall::lua::parse(k, R"({a = 1, b = 2})", strict), packall::status::unknown_key);
+}
+
+TEST(packall_lua, unknown_keys)
+{
+	// Fields from a newer version are stepped over, brackets inside strings and comments don't count
+	keyed k;
+	EXPECT_EQ(packall::lua::parse(k, R"({a = 1, extra = {x = {1, {2, "}"}}, ['y]'] = [==[ ]] } ]==]}, bb = 2,
+	--[[ } ]] ccc = 3, -- }
+	more = -1.5e3, flag = true, s = 'it\'s }', name = "x", tail = nil})"), packall::status::ok);
+	EXPECT_EQ(k.a, 1);
+	EXPECT_EQ(k.bb, 2);
+	EXPECT_EQ(k.ccc, 3);
+	EXPECT_EQ(k.name, "x");
+	EXPECT_EQ(packall::lua::parse(k, R"({a = 1, extra = {x = "unterminated})"), packall::status::bad_format);
+
+	// As are trailing tuple elements
+	std::tuple<int, std::string> t;
+	EXPECT_EQ(packall::lua::parse(t, R"({4, "four", {5}, [[6]]})"), packall::status::ok);
+	EXPECT_EQ(t, std::make_tuple(4, std::string("four")));
+}
+
+TEST(packall_lua, variant_prediction)
+{
+	// Integers go to the first alternative that can hold them, anything with a fraction or exponent to a float
+	std::vector<std::variant<uint16_t, int64_t, double, std::string, bool>> v;
+	EXPECT_EQ(packall::lua::parse(v, R"({7, 70000, -3, 1.5, 2e3, "s", [[long]], true})"), packall::status::ok);
+	ASSERT_EQ(v.size(), 8u);
+	EXPECT_EQ(v[0].index(), 0u);
+	EXPECT_EQ(v[1].index(), 1u);
+	EXPECT_EQ(v[2].index(), 1u);
+	EXPECT_EQ(v[3], (std::variant<uint16_t, int64_t, double, std::string, bool>{1.5}));
+	EXPECT_EQ(v[4].index(), 2u);
+	EXPECT_EQ(v[5].index(), 3u);
+	EXPECT_EQ(v[6], (std::variant<uint16_t, int64_t, double, std::string, bool>{std::string("long")}));
+	EXPECT_EQ(v[7].index(), 4u);
+
+	// Hex takes either prefix case and a sign, hex floats have a fraction or a binary exponent
+	v.clear();
+	EXPECT_EQ(packall::lua::parse(v, R"({0X10, 0x10000, -0x10, 0x1p3, 0x.8, -0X1.8P1})"), packall::status::ok);
+	ASSERT_EQ(v.size(), 6u);
+	EXPECT_EQ(v[0], (std::variant<uint16_t, int64_t, double, std::string, bool>{uint16_t(16)}));
+	EXPECT_EQ(v[1], (std::variant<uint16_t, int64_t, double, std::string, bool>{int64_t(0x10000)}));
+	EXPECT_EQ(v[2], (std::variant<uint16_t, int64_t, double, std::string, bool>{int64_t(-16)}));
+	EXPECT_EQ(v[3], (std::variant<uint16_t, int64_t, double, std::string, bool>{8.0}));
+	EXPECT_EQ(v[4], (std::variant<uint16_t, int64_t, double, std::string, bool>{0.5}));
+	EXPECT_EQ(v[5], (std::variant<uint16_t, int64_t, double, std::string, bool>{-3.0}));
+	int8_t i8;
+	EXPECT_EQ(packall::lua::parse(i8, "-0x80"), packall::status::ok);
+	EXPECT_EQ(i8, -128);
+	EXPECT_NE(packall::lua::parse(i8, "0x80"), packall::status::ok);
+	EXPECT_NE(packall::lua::parse(i8, "0x-1"), packall::status::ok);
+
+	// Positional tables go to lists, keyed tables to structs
+	std::vector<std::variant<std::vector<int>, keyed>> t;
+	EXPECT_EQ(packall::lua::parse(t, R"({{1, 2}, {a = 1, name = "n"}})"), packall::status::ok);
+	ASSERT_EQ(t.size(), 2u);
+	EXPECT_EQ(std::get<0>(t[0]), (std::vector<int>{1, 2}));
+	EXPECT_EQ(std::get<1>(t[1]).name, "n");
+}
+
+struct views
+{
+	std::string_view name;
+	std::string text;
+	std::map<std::string_view, int> counts;
+};
+
+TEST(packall_lua, strings)
+{
+	// Views point into the input, long strings only close at their own level
+	std::string_view in = R"({name = "abc", text = [==[a]]b]=]c]==], -- [ not a long comment
+	counts = {x = 1, ['y'] = 2}})";
+	views v;
+	EXPECT_EQ(packall::lua::parse(v, in), packall::status::ok);
+	EXPECT_EQ(v.name, "abc");
+	EXPECT_TRUE(v.name.data() > in.data() && v.name.data() < in.data() + in.size());
+	EXPECT_EQ(v.text, "a]]b]=]c");
+	EXPECT_EQ(v.counts.at("x"), 1);
+	EXPECT_EQ(v.counts.at("y"), 2);
+	EXPECT_TRUE(v.counts.begin()->first.data() > in.data() && v.counts.begin()->first.data() < in.data() + in.size());
+
+	EXPECT_EQ(packall::lua::parse(v, R"({["name"] = "q", [ [[text]] ] = 'r'})"), packall::status::ok);
+	EXPECT_EQ(v.name, "q");
+	EXPECT_EQ(v.text, "r");
+
+	EXPECT_EQ(packall::lua::parse(v, R"({text = [[unterminated]=]})"), packall::status::bad_format);
+	EXPECT_EQ(packall::lua::parse(v, R"({name = "unterminated})"), packall::status::bad_format);
+}
+
 TEST(packall_json, Config)
 {
 	static const char kStr[] = R"({
@@ -95,3 +205,642 @@ TEST(packall_json, Config)
 	EXPECT_EQ(text_c.distortion_coeffients, c.distortion_coeffients);
 	EXPECT_EQ(text_c.parameters, c.parameters);
 }
+
+TEST(packall_json, member_lookup)
+{
+	keyed k;
+	EXPECT_EQ(packall::json::parse(k, R"({"ccc": 3, "name": "x", "a": 1, "bb": 2})"), packall::status::ok);
+	EXPECT_EQ(k.a, 1);
+	EXPECT_EQ(k.bb, 2);
+	EXPECT_EQ(k.ccc, 3);
+	EXPECT_EQ(k.name, "x");
+
+	packall::json::parse_options strict;
+	strict.allow_unknown_keys = false;
+	EXPECT_EQ(packall::json::parse(k, R"({"a": 1, "cc": 2})", strict), packall::status::unknown_key);
+}
+
+TEST(packall_json, unknown_keys)
+{
+	keyed k;
+	EXPECT_EQ(packall::json::parse(k, R"({"a": 1, "extra": {"x": [1, [2, "]}"]], "y": "q\"}"}, "bb": 2, "ccc": 3,
+	"more": -1.5e3, "flag": false, "none": null, "name": "x", "tail": []})"), packall::status::ok);
+	EXPECT_EQ(k.a, 1);
+	EXPECT_EQ(k.bb, 2);
+	EXPECT_EQ(k.ccc, 3);
+	EXPECT_EQ(k.name, "x");
+	EXPECT_EQ(packall::json::parse(k, R"({"a": 1, "extra": [1, 2})"), packall::status::bad_format);
+}
+
+TEST(packall_json, variant_prediction)
+{
+	std::vector<std::variant<uint16_t, int64_t, double, std::string, bool>> v;
+	EXPECT_EQ(packall::json::parse(v, R"([7, 70000, -3, 1.5, 2e3, "s", false])"), packall::status::ok);
+	ASSERT_EQ(v.size(), 7u);
+	EXPECT_EQ(v[0].index(), 0u);
+	EXPECT_EQ(v[1].index(), 1u);
+	EXPECT_EQ(v[2].index(), 1u);
+	EXPECT_EQ(v[3].index(), 2u);
+	EXPECT_EQ(v[4].index(), 2u);
+	EXPECT_EQ(v[5].index(), 3u);
+	EXPECT_EQ(v[6].index(), 4u);
+
+	std::vector<std::variant<std::map<std::string, int>, std::vector<int>>> t;
+	EXPECT_EQ(packall::json::parse(t, R"([[1, 2], {"a": 1}])"), packall::status::ok);
+	ASSERT_EQ(t.size(), 2u);
+	EXPECT_EQ(std::get<1>(t[0]), (std::vector<int>{1, 2}));
+	EXPECT_EQ(std::get<0>(t[1]).at("a"), 1);
+}
+
+TEST(packall_json, strings)
+{
+	std::string_view in = R"({"name": "abc", "text": "q\"b\\s\/n\nt\t", "counts": {"x": 1}})";
+	views v;
+	EXPECT_EQ(packall::json::parse(v, in), packall::status::ok);
+	EXPECT_EQ(v.name, "abc");
+	EXPECT_TRUE(v.name.data() > in.data() && v.name.data() < in.data() + in.size());
+	EXPECT_EQ(v.text, "q\"b\\s/n\nt\t");
+	EXPECT_EQ(v.counts.at("x"), 1);
+
+	// An escaped string cannot be a view into the input
+	EXPECT_EQ(packall::json::parse(v, R"({"name": "a\nb"})"), packall::status::read_disjoint_into_span);
+	EXPECT_EQ(packall::json::parse(v, R"({"text": "unterminated\"})"), packall::status::bad_format);
+}
+
+TEST(packall_json, whitespace)
+{
+	// Padding around every token, escapes and structural characters inside long strings
+	std::string padding(100, ' ');
+	std::string long_text(40000, 'x');
+	long_text[20000] = '"';
+	std::string in = "{" + padding + "\"name\"" + padding + ":" + padding + "\"a{b}[c],:\"" + padding + ",\n\t\"text\": \"" +
+	                 long_text.substr(0, 20000) + "\\\"" + long_text.substr(20001) + "\\\\\",\n\t\"counts\": {\"x\": 1 , \"y\": 2\n\t}\n}\n";
+	views v;
+	EXPECT_EQ(packall::json::parse(v, in), packall::status::ok);
+	EXPECT_EQ(v.name, "a{b}[c],:");
+	EXPECT_EQ(v.text, long_text.substr(0, 20000) + "\"" + long_text.substr(20001) + "\\");
+	EXPECT_EQ(v.counts.at("x"), 1);
+	EXPECT_EQ(v.counts.at("y"), 2);
+}
+
+TEST(packall_json, unicode)
+{
+	views v;
+	EXPECT_EQ(packall::json::parse(v, R"({"text": "A\u00e9\u20ac\ud83d\ude00!"})"), packall::status::ok);
+	EXPECT_EQ(v.text, "A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80!");
+	EXPECT_EQ(packall::json::parse(v, R"({"text": "\ud83d"})"), packall::status::bad_format);
+	EXPECT_EQ(packall::json::parse(v, R"({"text": "\ude00"})"), packall::status::bad_format);
+	EXPECT_EQ(packall::json::parse(v, R"({"text": "\u12g4"})"), packall::status::bad_format);
+
+	packall::json::parse_options opts;
+	opts.validate_utf8 = true;
+	EXPECT_EQ(packall::json::parse(v, "{\"text\": \"caf\xc3\xa9 \xf0\x9f\x98\x80\"}", opts), packall::status::ok);
+	EXPECT_EQ(v.text, "caf\xc3\xa9 \xf0\x9f\x98\x80");
+	for(const char *bad : {"\xc0\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82", "\x80", "\xff"}) {
+		std::string in = std::string("{\"name\": \"0123456789abcdef") + bad + "\"}";
+		EXPECT_EQ(packall::json::parse(v, in, opts), packall::status::bad_format) << in;
+		EXPECT_EQ(packall::json::parse(v, in), packall::status::ok);
+	}
+
+	// Everything that needs escaping survives a round trip
+	views w{"", std::string("quote\" backslash\\ newline\n tab\t bell\x07 nul") + '\0' + " caf\xc3\xa9 " + std::string(40, 'x') + "\"",
+	    {}};
+	std::string text;
+	packall::json::format(w, text);
+	EXPECT_EQ(text.find('\n'), std::string::npos);
+	EXPECT_EQ(packall::json::parse(v, text, opts), packall::status::ok);
+	EXPECT_EQ(v.text, w.text);
+}
+
+struct stream_inner
+{
+	bool operator==(const stream_inner&) const = default;
+	int x;
+	int y;
+};
+
+struct stream_item
+{
+	int id;
+	std::string name;
+	std::vector<int> values;
+	stream_inner inner;
+	std::tuple<int, int> pair;
+};
+
+// Every third item is entirely default so omit_default rolls it back
+std::vector<stream_item> stream_items()
+{
+	std::vector<stream_item> items(500);
+	for(int i = 0; i < 500; i++) {
+		if(i % 3)
+			items[i] = {i, "item " + std::to_string(i), std::vector<int>(i % 7, i), {i % 2, 0}, {0, i % 5}};
+	}
+	return items;
+}
+
+TEST(packall_lua, streaming)
+{
+	// Streamed output must match formatting into one string, whatever the chunk boundaries
+	auto items = stream_items();
+	for(bool omit : {false, true}) {
+		packall::lua::format_options opts{.omit_default = omit, .chunk_size = 256};
+		std::string whole;
+		packall::lua::format(items, whole, opts);
+		std::string streamed;
+		size_t chunks = 0, largest = 0;
+		packall::lua::format(items, [&](std::string_view chunk) {
+			streamed.append(chunk);
+			chunks++;
+			largest = std::max(largest, chunk.size());
+		}, opts);
+		EXPECT_EQ(streamed, whole);
+		EXPECT_GT(chunks, 10u);
+		EXPECT_LT(largest, 512u);
+
+		std::ostringstream out;
+		packall::lua::format(items, out, opts);
+		EXPECT_EQ(out.str(), whole);
+	}
+}
+
+TEST(packall_json, streaming)
+{
+	auto items = stream_items();
+	for(bool omit : {false, true}) {
+		packall::json::format_options opts{.omit_default = omit, .chunk_size = 256};
+		std::string whole;
+		packall::json::format(items, whole, opts);
+		std::string streamed;
+		size_t chunks = 0, largest = 0;
+		packall::json::format(items, [&](std::string_view chunk) {
+			streamed.append(chunk);
+			chunks++;
+			largest = std::max(largest, chunk.size());
+		}, opts);
+		EXPECT_EQ(streamed, whole);
+		EXPECT_GT(chunks, 10u);
+		EXPECT_LT(largest, 512u);
+
+		std::ostringstream out;
+		packall::json::format(items, out, opts);
+		EXPECT_EQ(out.str(), whole);
+	}
+}
+
+TEST(packall_lua, pretty)
+{
+	// Pretty output is laid out exactly as prettyprint would lay out the compact text
+	Config c{"/dev/video0", {640, 480}, {1.0, 0.5}, {}, {{"max_depth", uint16_t{5}}, {"two words", std::string{"x"}}}};
+	std::vector<stream_item> items{{}, {1, "one", {1, 2}, {1, 0}, {3, 4}}};
+	std::string compact, pretty;
+	packall::lua::format(c, compact);
+	packall::lua::format(c, pretty, {.pretty = true});
+	EXPECT_EQ(pretty, packall::lua::prettyprint(compact));
+	packall::lua::format(items, compact);
+	packall::lua::format(items, pretty, {.pretty = true});
+	EXPECT_EQ(pretty, packall::lua::prettyprint(compact));
+
+	std::string text;
+	packall::lua::format(c, text, {.pretty = true});
+	Config back;
+	EXPECT_EQ(packall::lua::parse(back, text), packall::status::ok);
+	EXPECT_EQ(back.parameters, c.parameters);
+
+	// Long brackets pick a level the text can't close early
+	views v{"", "a]]b]=]c]", {{"]]", 1}, {"k]=", 2}}};
+	packall::lua::format(v, text, {.pretty = true});
+	views v2;
+	EXPECT_EQ(packall::lua::parse(v2, text), packall::status::ok);
+	EXPECT_EQ(v2.text, v.text);
+	EXPECT_EQ(v2.counts, v.counts);
+}
+
+TEST(packall_json, pretty)
+{
+	Config c{"/dev/video0", {640, 480}, {1.0, 0.5}, {}, {{"max_depth", uint16_t{5}}, {"two words", std::string{"x"}}}};
+	std::vector<stream_item> items{{}, {1, "one", {1, 2}, {1, 0}, {3, 4}}};
+	std::string compact, pretty;
+	packall::json::format(c, compact);
+	packall::json::format(c, pretty, {.pretty = true});
+	EXPECT_EQ(pretty, packall::json::prettyprint(compact));
+	packall::json::format(items, compact);
+	packall::json::format(items, pretty, {.pretty = true});
+	EXPECT_EQ(pretty, packall::json::prettyprint(compact));
+
+	std::string text;
+	packall::json::format(c, text, {.pretty = true});
+	Config back;
+	EXPECT_EQ(packall::json::parse(back, text), packall::status::ok);
+	EXPECT_EQ(back.parameters, c.parameters);
+}
+
+struct record_item
+{
+	bool operator==(const record_item&) const = default;
+	int id;
+	std::string name;
+	std::vector<int> values;
+	stream_inner inner;
+	std::map<std::string, int> tags;
+};
+
+std::vector<record_item> record_items()
+{
+	std::vector<record_item> items(50);
+	for(int i = 1; i < 50; i++)
+		items[i] = {i, "item " + std::to_string(i), std::vector<int>(i % 7, i), {i % 2, 0}, {{"k" + std::to_string(i % 3), i}}};
+	return items;
+}
+
+struct record_defaults
+{
+	int id;
+	int version = 3;
+	std::vector<int> values;
+};
+
+TEST(packall_lua, records)
+{
+	// Records round trip through the writer, a bad one is reported without losing the rest
+	auto items = record_items();
+	std::ostringstream out;
+	{
+		packall::lua::record_writer w(out, {.omit_default = true, .chunk_size = 256});
+		for(auto& item : items)
+			w.write(item);
+	}
+	packall::lua::record_writer w({.omit_default = true});
+	for(auto& item : items)
+		w.write(item);
+	const std::string whole = out.str();
+	EXPECT_EQ(whole, w.text());
+
+	std::string text = whole;
+	size_t second = text.find('\n') + 1;
+	text.insert(second, "{id = 1, name = }\n");
+
+	packall::lua::record_reader<record_item> r(text);
+	record_item item;
+	packall::status st;
+	std::vector<packall::status> statuses;
+	std::vector<record_item> read;
+	while(r.next(item, st)) {
+		statuses.push_back(st);
+		if(st == packall::status::ok)
+			read.push_back(item);
+		if(statuses.size() == 2) {
+			EXPECT_EQ(r.offset(), second);
+		}
+	}
+	ASSERT_EQ(statuses.size(), 51u);
+	EXPECT_NE(statuses[1], packall::status::ok);
+	EXPECT_EQ(std::count(statuses.begin(), statuses.end(), packall::status::ok), 50);
+	EXPECT_EQ(read, items);
+
+	// Batches reuse the caller's objects
+	packall::lua::record_reader<record_item> batched(whole);
+	std::array<record_item, 16> batch;
+	std::array<packall::status, 16> results;
+	size_t total = 0;
+	while(size_t n = batched.next(batch, results)) {
+		for(size_t i = 0; i < n; i++) {
+			EXPECT_EQ(results[i], packall::status::ok);
+			EXPECT_EQ(batch[i], items[total + i]);
+		}
+		total += n;
+	}
+	EXPECT_EQ(total, items.size());
+
+	// Members a record leaves out go back to their initializers, not to zero
+	packall::lua::record_reader<record_defaults> defaults("{id = 1, version = 5, values = {1}}\n{id = 2}\n");
+	record_defaults d;
+	ASSERT_TRUE(defaults.next(d, st));
+	EXPECT_EQ(d.version, 5);
+	ASSERT_TRUE(defaults.next(d, st));
+	EXPECT_EQ(st, packall::status::ok);
+	EXPECT_EQ(d.id, 2);
+	EXPECT_EQ(d.version, 3);
+	EXPECT_TRUE(d.values.empty());
+}
+
+TEST(packall_json, records)
+{
+	// Records round trip through the writer, a bad one is reported without losing the rest
+	auto items = record_items();
+	std::ostringstream out;
+	{
+		packall::json::record_writer w(out, {.omit_default = true, .chunk_size = 256});
+		for(auto& item : items)
+			w.write(item);
+	}
+	packall::json::record_writer w({.omit_default = true});
+	for(auto& item : items)
+		w.write(item);
+	const std::string whole = out.str();
+	EXPECT_EQ(whole, w.text());
+
+	std::string text = whole;
+	size_t second = text.find('\n') + 1;
+	text.insert(second, "{\"id\": 1, \"name\": }\n");
+
+	packall::json::record_reader<record_item> r(text);
+	record_item item;
+	packall::status st;
+	std::vector<packall::status> statuses;
+	std::vector<record_item> read;
+	while(r.next(item, st)) {
+		statuses.push_back(st);
+		if(st == packall::status::ok)
+			read.push_back(item);
+		if(statuses.size() == 2) {
+			EXPECT_EQ(r.offset(), second);
+		}
+	}
+	ASSERT_EQ(statuses.size(), 51u);
+	EXPECT_NE(statuses[1], packall::status::ok);
+	EXPECT_EQ(std::count(statuses.begin(), statuses.end(), packall::status::ok), 50);
+	EXPECT_EQ(read, items);
+
+	// Batches reuse the caller's objects
+	packall::json::record_reader<record_item> batched(whole);
+	std::array<record_item, 16> batch;
+	std::array<packall::status, 16> results;
+	size_t total = 0;
+	while(size_t n = batched.next(batch, results)) {
+		for(size_t i = 0; i < n; i++) {
+			EXPECT_EQ(results[i], packall::status::ok);
+			EXPECT_EQ(batch[i], items[total + i]);
+		}
+		total += n;
+	}
+	EXPECT_EQ(total, items.size());
+
+	packall::json::record_reader<record_defaults> defaults(
+	    "{\"id\": 1}\n{\"id\": 2, \"version\": 5, \"values\": [1]}\n{\"id\": 3}\n");
+	record_defaults d;
+	ASSERT_TRUE(defaults.next(d, st));
+	EXPECT_EQ(st, packall::status::ok);
+	EXPECT_EQ(d.version, 3);
+	ASSERT_TRUE(defaults.next(d, st));
+	EXPECT_EQ(d.version, 5);
+	ASSERT_TRUE(defaults.next(d, st));
+	EXPECT_EQ(d.id, 3);
+	EXPECT_EQ(d.version, 3);
+	EXPECT_TRUE(d.values.empty());
+}
+
+struct split_item
+{
+	bool operator==(const split_item&) const = default;
+	int id;
+	std::string text;
+	std::vector<stream_inner> inner;
+};
+
+std::vector<split_item> split_items(const std::string& text)
+{
+	std::vector<split_item> items(300);
+	for(int i = 0; i < 300; i++)
+		items[i] = {i, i % 4 ? text : "", std::vector<stream_inner>(i % 5, {i, 1})};
+	return items;
+}
+
+TEST(packall_lua, split)
+{
+	// Split parsing has to agree with the serial parse wherever the pieces land, separators inside strings and
+	// nested lists included
+	auto items = split_items("a,{b}, [c]");
+	std::string text;
+	packall::lua::format(items, text);
+	for(unsigned threads : {2u, 3u, 8u, 64u}) {
+		std::vector<split_item> split;
+		EXPECT_EQ(packall::lua::parse(split, text, {.threads = threads, .split_size = 16}), packall::status::ok);
+		EXPECT_EQ(split, items);
+	}
+
+	// Without separators inside strings every guessed start is an element boundary, so no piece is parsed twice
+	auto plain = split_items("abc");
+	packall::lua::format(plain, text);
+	for(unsigned threads : {2u, 8u, 64u}) {
+		packall::split_stats stats;
+		std::vector<split_item> split;
+		EXPECT_EQ(packall::lua::parse(split, text, {.threads = threads, .split_size = 16, .stats = &stats}),
+		    packall::status::ok);
+		EXPECT_EQ(split, plain);
+		EXPECT_EQ(stats.pieces, threads - 1);
+		EXPECT_EQ(stats.reparsed, 0u);
+	}
+
+	// A broken element fails the same way
+	packall::lua::format(items, text);
+	std::string broken = text;
+	broken.insert(broken.find(",{", text.size() / 2) + 1, "@");
+	std::vector<split_item> serial, split;
+	auto expected = packall::lua::parse(serial, broken);
+	EXPECT_NE(expected, packall::status::ok);
+	EXPECT_EQ(packall::lua::parse(split, broken, {.threads = 4, .split_size = 16}), expected);
+}
+
+TEST(packall_json, split)
+{
+	auto items = split_items("a,{b}, [c]");
+	std::string text;
+	packall::json::format(items, text);
+	for(unsigned threads : {2u, 3u, 8u, 64u}) {
+		std::vector<split_item> split;
+		EXPECT_EQ(packall::json::parse(split, text, {.threads = threads, .split_size = 16}), packall::status::ok);
+		EXPECT_EQ(split, items);
+	}
+
+	auto plain = split_items("abc");
+	packall::json::format(plain, text);
+	for(unsigned threads : {2u, 8u, 64u}) {
+		packall::split_stats stats;
+		std::vector<split_item> split;
+		EXPECT_EQ(packall::json::parse(split, text, {.threads = threads, .split_size = 16, .stats = &stats}),
+		    packall::status::ok);
+		EXPECT_EQ(split, plain);
+		EXPECT_EQ(stats.pieces, threads - 1);
+		EXPECT_EQ(stats.reparsed, 0u);
+	}
+
+	packall::json::format(items, text);
+	std::string broken = text;
+	broken.insert(broken.find(",{", text.size() / 2) + 1, "@");
+	std::vector<split_item> serial, split;
+	auto expected = packall::json::parse(serial, broken);
+	EXPECT_NE(expected, packall::status::ok);
+	EXPECT_EQ(packall::json::parse(split, broken, {.threads = 4, .split_size = 16}), expected);
+}
+
+TEST(packall_json, structural_index)
+{
+	// Spans several index windows, with escapes, padding, and brackets and separators inside strings
+	std::string padding(100, ' ');
+	std::string long_text(40000, 'x');
+	long_text[20000] = '"';
+	std::string in = "{" + padding + "\"name\"" + padding + ":" + padding + "\"a{b}[c],:\"" + padding +
+	                 ",\n\t\"skipped\": {\"x\": [\"]}\", {}, [1]], \"y\": \"\\\\\"},\n\t\"text\": \"" +
+	                 long_text.substr(0, 20000) + "\\\"" + long_text.substr(20001) + "\\\\\",\n\t\"counts\": {\"x\": 1 , \"y\": 2\n\t}\n}\n";
+	views plain, indexed;
+	EXPECT_EQ(packall::json::parse(plain, in), packall::status::ok);
+	EXPECT_EQ(packall::json::parse(indexed, in, {.structural_index = true}), packall::status::ok);
+	EXPECT_EQ(indexed.name, "a{b}[c],:");
+	EXPECT_EQ(indexed.text, plain.text);
+	EXPECT_EQ(indexed.counts, plain.counts);
+	EXPECT_EQ(indexed.counts.at("y"), 2);
+	EXPECT_EQ(packall::json::parse(indexed, R"({"text": "unterminated\"})", {.structural_index = true}),
+	    packall::status::bad_format);
+
+	// Pieces start at separators the index places at the top level, so none is parsed twice even when the strings hold
+	// text that parses as elements
+	auto items = split_items(",{},{},{},{},{},{},{},{}");
+	std::string text;
+	packall::json::format(items, text, {.pretty = true});
+	for(unsigned threads : {2u, 8u, 64u}) {
+		packall::split_stats stats;
+		std::vector<split_item> split;
+		EXPECT_EQ(packall::json::parse(split, text, {.threads = threads, .split_size = 16, .stats = &stats, .structural_index = true}),
+		    packall::status::ok);
+		EXPECT_EQ(split, items);
+		EXPECT_EQ(stats.pieces, threads - 1);
+		EXPECT_EQ(stats.reparsed, 0u);
+	}
+}
+
+struct transcode_sparse
+{
+	static constexpr packall::traits Traits = packall::traits::sparse;
+	int a = 1;
+	std::string b;
+	int c;
+};
+
+struct transcode_compat
+{
+	static constexpr packall::traits Traits = packall::traits::backwards_compatible;
+	bool operator==(const transcode_compat&) const = default;
+	int x;
+	std::vector<std::string> tags;
+};
+
+struct transcode_item
+{
+	int id;
+	std::string name;
+	std::vector<stream_inner> inner;
+	std::map<std::string, transcode_compat> groups;
+	transcode_sparse sparse;
+	std::array<int, 3> fixed;
+	std::vector<std::vector<int>> nested;
+};
+
+using transcode_list = std::vector<transcode_item>;
+
+transcode_list transcode_items()
+{
+	transcode_list items(60);
+	for(int i = 0; i < 60; i++) {
+		if(i % 3)
+			items[i] = {i, "item " + std::to_string(i), std::vector<stream_inner>(i % 4, {i, 1}),
+			    {{"g", {i, {"a", "b"}}}, {"h", {0, {"c"}}}}, {2, "s", i}, {1, 2, i}, {{i}, {}, {1, 2}}};
+	}
+	return items;
+}
+
+// Counts too large for one byte, at every level
+std::vector<std::vector<std::vector<int>>> transcode_wide()
+{
+	std::vector<std::vector<std::vector<int>>> wide(200, std::vector<std::vector<int>>(130, std::vector<int>(3, 1)));
+	wide[5][7] = std::vector<int>(1000, 2);
+	return wide;
+}
+
+TEST(packall_lua, transcode)
+{
+	// Transcoding gives exactly what going through T would, in both directions
+	auto items = transcode_items();
+	std::vector<uint8_t> bytes;
+	packall::pack(items, bytes);
+	for(int mode = 0; mode < 3; mode++) {
+		packall::lua::format_options opts{.omit_default = mode == 1, .chunk_size = 256, .pretty = mode == 2};
+		std::string expected, text, streamed;
+		packall::lua::format(items, expected, opts);
+		EXPECT_EQ(packall::lua::binary_to_text<transcode_list>(bytes, text, opts), packall::status::ok);
+		EXPECT_EQ(text, expected);
+		EXPECT_EQ(packall::lua::binary_to_text<transcode_list>(bytes, [&](std::string_view chunk) { streamed.append(chunk); }, opts),
+		    packall::status::ok);
+		EXPECT_EQ(streamed, expected);
+
+		std::vector<uint8_t> back;
+		EXPECT_EQ(packall::lua::text_to_binary<transcode_list>(text, back), packall::status::ok);
+		EXPECT_EQ(back, bytes);
+	}
+
+	auto wide = transcode_wide();
+	std::vector<uint8_t> wide_bytes, wide_back;
+	std::string wide_text;
+	packall::pack(wide, wide_bytes);
+	packall::lua::format(wide, wide_text);
+	EXPECT_EQ(packall::lua::text_to_binary<decltype(wide)>(wide_text, wide_back), packall::status::ok);
+	EXPECT_EQ(wide_back, wide_bytes);
+
+	std::vector<uint8_t> truncated(bytes.begin(), bytes.begin() + bytes.size() / 2);
+	std::string text;
+	EXPECT_EQ(packall::lua::binary_to_text<transcode_list>(truncated, text), packall::status::data_underrun);
+
+	// Keys out of order or missing fall back to the default or to parsing that struct
+	std::string_view reordered =
+	    "{name = 'x', inner = {{y = 2, x = 1}, {3, 4,}}, fixed = {5}, id = 7, groups = {h = {x = 1}, g = {tags = {'t'}}, g = {x = 2}}, nested = {{1, 2}, {}}}";
+	transcode_item item{};
+	EXPECT_EQ(packall::lua::parse(item, reordered), packall::status::ok);
+	std::vector<uint8_t> expected, back;
+	packall::pack(item, expected);
+	EXPECT_EQ(packall::lua::text_to_binary<transcode_item>(reordered, back), packall::status::ok);
+	EXPECT_EQ(back, expected);
+	EXPECT_EQ(item.groups.at("g").x, 2);
+}
+
+TEST(packall_json, transcode)
+{
+	auto items = transcode_items();
+	std::vector<uint8_t> bytes;
+	packall::pack(items, bytes);
+	for(int mode = 0; mode < 3; mode++) {
+		packall::json::format_options opts{.omit_default = mode == 1, .chunk_size = 256, .pretty = mode == 2};
+		std::string expected, text, streamed;
+		packall::json::format(items, expected, opts);
+		EXPECT_EQ(packall::json::binary_to_text<transcode_list>(bytes, text, opts), packall::status::ok);
+		EXPECT_EQ(text, expected);
+		EXPECT_EQ(packall::json::binary_to_text<transcode_list>(bytes, [&](std::string_view chunk) { streamed.append(chunk); }, opts),
+		    packall::status::ok);
+		EXPECT_EQ(streamed, expected);
+
+		std::vector<uint8_t> back;
+		EXPECT_EQ(packall::json::text_to_binary<transcode_list>(text, back), packall::status::ok);
+		EXPECT_EQ(back, bytes);
+	}
+
+	auto wide = transcode_wide();
+	std::vector<uint8_t> wide_bytes, wide_back;
+	std::string wide_text;
+	packall::pack(wide, wide_bytes);
+	packall::json::format(wide, wide_text);
+	EXPECT_EQ(packall::json::text_to_binary<decltype(wide)>(wide_text, wide_back), packall::status::ok);
+	EXPECT_EQ(wide_back, wide_bytes);
+
+	std::vector<uint8_t> truncated(bytes.begin(), bytes.begin() + bytes.size() / 2);
+	std::string text;
+	EXPECT_EQ(packall::json::binary_to_text<transcode_list>(truncated, text), packall::status::data_underrun);
+
+	std::string_view reordered =
+	    R"({"name": "x", "inner": [{"y": 2, "x": 1}, {"x": 3}], "fixed": [5], "id": 7, "groups": {"h": {"x": 1}, "g": {"tags": ["t"]}, "g": {"x": 2}}, "nested": [[1, 2], []]})";
+	transcode_item item{};
+	EXPECT_EQ(packall::json::parse(item, reordered), packall::status::ok);
+	std::vector<uint8_t> expected, back;
+	packall::pack(item, expected);
+	EXPECT_EQ(packall::json::text_to_binary<transcode_item>(reordered, back), packall::status::ok);
+	EXPECT_EQ(back, expected);
+	EXPECT_EQ(item.groups.at("g").x, 2);
+}
@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+# Regenerates include/packall/struct_decompose.inc.
+# usage: gen_struct_decompose.py [max_members] > include/packall/struct_decompose.inc
+
+import sys
+
+PER_LINE = 16
+TIER = 50
+
+
+def main():
+    limit = int(sys.argv[1]) if len(sys.argv) > 1 else 250
+    out = sys.stdout
+    out.write('// Generated by tools/gen_struct_decompose.py, do not edit.\n')
+    out.write('#define PACKALL_DECOMPOSE(N, ...)                                                                       \\\n')
+    out.write('\ttemplate<>                                                                                         \\\n')
+    out.write('\tstruct decompose<N> : decompose_get<decompose<N>>                                                  \\\n')
+    out.write('\t{                                                                                                  \\\n')
+    out.write('\t\ttemplate<class T, class F>                                                                     \\\n')
+    out.write('\t\tconstexpr static decltype(auto) apply(T&& o, F&& f)                                            \\\n')
+    out.write('\t\t{                                                                                              \\\n')
+    out.write('\t\t\tauto& [__VA_ARGS__] = o;                                                                   \\\n')
+    out.write('\t\t\treturn f(__VA_ARGS__);                                                                     \\\n')
+    out.write('\t\t}                                                                                              \\\n')
+    out.write('\t};\n')
+    for n in range(1, limit + 1):
+        # Tiers past the first are skipped when PACKALL_MAX_DECOMPOSE is lowered, trimming parse time
+        if n > TIER and n % TIER == 1:
+            out.write('#if PACKALL_MAX_DECOMPOSE > %d\n' % (n - 1))
+        lines = [', '.join('_%d' % i for i in range(s, min(n, s + PER_LINE))) for s in range(0, n, PER_LINE)]
+        out.write('PACKALL_DECOMPOSE(%d, %s)\n' % (n, ',\n\t'.join(lines)))
+        if n > TIER and (n % TIER == 0 or n == limit):
+            out.write('#endif\n')
+    out.write('#undef PACKALL_DECOMPOSE\n')
+
+
+if __name__ == '__main__':
+    main()